@@ -2,24 +2,315 @@
 // Created by wangnan on 16-1-19.
 //
 
+#include <fstream>
 #include "Estimating.h"
 
 using std::function;
 namespace Estimating
 {
+    void SamplingResult::AddBatch(const double *sample, const double *weight, size_t count)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        // four independent lanes, so that the sums pipeline (and vectorize) without reassociating a single chain
+        const size_t lane_count = 4;
+        double weight_sum[lane_count] = {0.0, 0.0, 0.0, 0.0};
+        double weighted_sum[lane_count] = {0.0, 0.0, 0.0, 0.0};
+        double squared_weight_sum[lane_count] = {0.0, 0.0, 0.0, 0.0};
+        size_t i = 0;
+        for (; i + lane_count <= count; i += lane_count)
+        {
+            for (size_t lane = 0; lane < lane_count; lane++)
+            {
+                weight_sum[lane] += weight[i + lane];
+                weighted_sum[lane] += weight[i + lane] * sample[i + lane];
+                squared_weight_sum[lane] += weight[i + lane] * weight[i + lane];
+            }
+        }
+        for (; i < count; i++)
+        {
+            weight_sum[0] += weight[i];
+            weighted_sum[0] += weight[i] * sample[i];
+            squared_weight_sum[0] += weight[i] * weight[i];
+        }
+        double batch_weight = (weight_sum[0] + weight_sum[1]) + (weight_sum[2] + weight_sum[3]);
+        double batch_average = ((weighted_sum[0] + weighted_sum[1]) + (weighted_sum[2] + weighted_sum[3])) /
+                               batch_weight;
+        // second pass around the batch average, which keeps the variance sum free of cancellation
+        double variance_sum[lane_count] = {0.0, 0.0, 0.0, 0.0};
+        double residual_sum[lane_count] = {0.0, 0.0, 0.0, 0.0};
+        for (i = 0; i + lane_count <= count; i += lane_count)
+        {
+            for (size_t lane = 0; lane < lane_count; lane++)
+            {
+                double deviation = sample[i + lane] - batch_average;
+                variance_sum[lane] += weight[i + lane] * deviation * deviation;
+                residual_sum[lane] += weight[i + lane] * deviation;
+            }
+        }
+        for (; i < count; i++)
+        {
+            double deviation = sample[i] - batch_average;
+            variance_sum[0] += weight[i] * deviation * deviation;
+            residual_sum[0] += weight[i] * deviation;
+        }
+        // the residual corrects the rounding of the average (corrected two-pass algorithm)
+        double residual = (residual_sum[0] + residual_sum[1]) + (residual_sum[2] + residual_sum[3]);
+        double batch_variance_sum = (variance_sum[0] + variance_sum[1]) + (variance_sum[2] + variance_sum[3]) -
+                                    residual * residual / batch_weight;
+        *this += FromMoments(batch_average + residual / batch_weight, std::max(batch_variance_sum, 0.0),
+                             batch_weight,
+                             (squared_weight_sum[0] + squared_weight_sum[1]) +
+                             (squared_weight_sum[2] + squared_weight_sum[3]));
+    }
+
+    void SamplingResult::Save(Serialization::Writer &writer) const
+    {
+        writer.WriteDouble(_average);
+        writer.WriteDouble(_variance_sum);
+        writer.WriteDouble(_total_weight);
+        writer.WriteDouble(_squared_weight_sum);
+    }
+
+    SamplingResult SamplingResult::Load(Serialization::Reader &reader)
+    {
+        double average = reader.ReadDouble();
+        double variance_sum = reader.ReadDouble();
+        double total_weight = reader.ReadDouble();
+        return FromMoments(average, variance_sum, total_weight, reader.ReadDouble());
+    }
+
+    void LogHistogram::AddNewSample(double sample, double weight)
+    {
+        if (weight <= 0.0)
+        {
+            return;
+        }
+        _total_weight += weight;
+        _squared_weight_sum += weight * weight;
+        double magnitude = std::abs(sample);
+        if (magnitude < std::numeric_limits<double>::min())
+        {
+            _zero_weight += weight;
+            return;
+        }
+        int bucket_index = (int) std::ceil(std::log(magnitude) / _log_gamma);
+        (sample > 0.0 ? _positive_bucket_map : _negative_bucket_map)[bucket_index] += weight;
+    }
+
+    double LogHistogram::ValueAtRank(double rank) const
+    {
+        if (_total_weight <= 0.0)
+        {
+            return 0.0;
+        }
+        // from the most negative value up
+        double weight_sum = 0.0;
+        for (auto it = _negative_bucket_map.rbegin(); it != _negative_bucket_map.rend(); ++it)
+        {
+            weight_sum += it->second;
+            if (weight_sum >= rank)
+            {
+                return -BucketValue(it->first);
+            }
+        }
+        weight_sum += _zero_weight;
+        if (weight_sum >= rank && _zero_weight > 0.0)
+        {
+            return 0.0;
+        }
+        for (const auto &bucket:_positive_bucket_map)
+        {
+            weight_sum += bucket.second;
+            if (weight_sum >= rank)
+            {
+                return BucketValue(bucket.first);
+            }
+        }
+        // rounding left the rank beyond the largest value
+        if (!_positive_bucket_map.empty())
+        {
+            return BucketValue(_positive_bucket_map.rbegin()->first);
+        }
+        return _zero_weight > 0.0 ? 0.0 : -BucketValue(_negative_bucket_map.begin()->first);
+    }
+
+    std::pair<double, double> LogHistogram::QuantileInterval(double probability, double confidence_coefficient) const
+    {
+        double effective_count = _total_weight > 0.0 ? _total_weight * _total_weight / _squared_weight_sum : 0.0;
+        double z = std::abs(Statistics::StdNormQuantile((1.0 - confidence_coefficient) / 2.0));
+        // normal approximation of the binomial number of samples below the quantile
+        double half_width = z * std::sqrt(probability * (1.0 - probability) / effective_count);
+        double lower = std::max(probability - half_width, 0.0);
+        double upper = std::min(probability + half_width, 1.0);
+        return std::make_pair(ValueAtRank(lower * _total_weight), ValueAtRank(upper * _total_weight));
+    }
+
+    LogHistogram &LogHistogram::operator+=(const LogHistogram &rhs)
+    {
+        if (_log_gamma != rhs._log_gamma)
+        {
+            if (BucketCount() > 0)
+            {
+                throw HistogramMismatch();
+            }
+            _log_gamma = rhs._log_gamma;
+        }
+        for (const auto &bucket:rhs._positive_bucket_map)
+        {
+            _positive_bucket_map[bucket.first] += bucket.second;
+        }
+        for (const auto &bucket:rhs._negative_bucket_map)
+        {
+            _negative_bucket_map[bucket.first] += bucket.second;
+        }
+        _zero_weight += rhs._zero_weight;
+        _total_weight += rhs._total_weight;
+        _squared_weight_sum += rhs._squared_weight_sum;
+        return *this;
+    }
+
+    void LogHistogram::Save(Serialization::Writer &writer) const
+    {
+        writer.WriteDouble(_log_gamma);
+        writer.WriteDouble(_zero_weight);
+        writer.WriteDouble(_total_weight);
+        writer.WriteDouble(_squared_weight_sum);
+        for (const auto *bucket_map:{&_positive_bucket_map, &_negative_bucket_map})
+        {
+            writer.WriteUint64(bucket_map->size());
+            for (const auto &bucket:*bucket_map)
+            {
+                writer.WriteUint64((uint64_t) (int64_t) bucket.first);
+                writer.WriteDouble(bucket.second);
+            }
+        }
+    }
+
+    LogHistogram LogHistogram::Load(Serialization::Reader &reader)
+    {
+        LogHistogram histogram;
+        histogram._log_gamma = reader.ReadDouble();
+        histogram._zero_weight = reader.ReadDouble();
+        histogram._total_weight = reader.ReadDouble();
+        histogram._squared_weight_sum = reader.ReadDouble();
+        for (auto *bucket_map:{&histogram._positive_bucket_map, &histogram._negative_bucket_map})
+        {
+            uint64_t bucket_count = reader.ReadUint64();
+            for (uint64_t i = 0; i < bucket_count; i++)
+            {
+                int bucket_index = (int) (int64_t) reader.ReadUint64();
+                (*bucket_map)[bucket_index] = reader.ReadDouble();
+            }
+        }
+        if (!(histogram._log_gamma > 0.0) || !std::isfinite(histogram._log_gamma) ||
+            !(histogram._total_weight >= 0.0) || !(histogram._zero_weight >= 0.0))
+        {
+            throw Serialization::SerializationError();
+        }
+        return histogram;
+    }
+
+    void ResultSet::Add(const string &name, const SamplingResult &result)
+    {
+        for (size_t index = 0; index < _name_list.size(); index++)
+        {
+            if (_name_list[index] == name)
+            {
+                _result_list[index] += result;
+                return;
+            }
+        }
+        _name_list.push_back(name);
+        _result_list.push_back(result);
+    }
+
+    ResultSet &ResultSet::operator+=(const ResultSet &rhs)
+    {
+        for (size_t index = 0; index < rhs.Size(); index++)
+        {
+            Add(rhs._name_list[index], rhs._result_list[index]);
+        }
+        return *this;
+    }
+
+    const SamplingResult *ResultSet::Find(const string &name) const
+    {
+        for (size_t index = 0; index < _name_list.size(); index++)
+        {
+            if (_name_list[index] == name)
+            {
+                return &_result_list[index];
+            }
+        }
+        return nullptr;
+    }
+
+    static const char *ResultFileMagic = "SPNP results";
+    static const uint64_t ResultFileVersion = 1;
+
+    void ResultSet::Write(const string &path) const
+    {
+        Serialization::WriteFileAtomically(path, [this](Serialization::Writer &writer)
+        {
+            writer.WriteString(ResultFileMagic);
+            writer.WriteUint64(ResultFileVersion);
+            writer.WriteUint64(_name_list.size());
+            for (size_t index = 0; index < _name_list.size(); index++)
+            {
+                writer.WriteString(_name_list[index]);
+                _result_list[index].Save(writer);
+            }
+        });
+    }
+
+    ResultSet ResultSet::Read(const string &path)
+    {
+        std::ifstream stream(path, std::ios::binary);
+        if (!stream)
+        {
+            throw Serialization::SerializationError();
+        }
+        Serialization::Reader reader(stream);
+        reader.ExpectString(ResultFileMagic);
+        if (reader.ReadUint64() > ResultFileVersion)
+        {
+            throw Serialization::SerializationError();
+        }
+        ResultSet result_set;
+        uint64_t entry_count = reader.ReadUint64();
+        for (uint64_t i = 0; i < entry_count; i++)
+        {
+            string name = reader.ReadString();
+            result_set.Add(name, SamplingResult::Load(reader));
+        }
+        return result_set;
+    }
+
     template<typename SampleType>
     void MeanEstimatorGeneric<SampleType>::InputSample(size_t source_index, const SampleType &sample,
-                                                       double weight)
+                                                       double weight, double value_scale)
     {
-        ResultList &result_list = _source_mean_list[source_index];
+        vector<BatchedSamplingResult> &result_list = _source_mean_list[source_index];
         for (size_t rand_index = 0; rand_index < _random_variable_list.size(); rand_index++)
         {
             const RandomVariableGeneric<SampleType> &rand_variable = _random_variable_list[rand_index];
-            SamplingResult &result = result_list[rand_index];
+            BatchedSamplingResult &result = result_list[rand_index];
             double value;
             if (rand_variable(sample, value))
             {
-                result.AddNewSample(value, weight);
+                result.AddNewSample(value * value_scale, weight);
+            }
+        }
+        vector<BatchedSamplingResult> &control_list = _source_control_mean_list[source_index];
+        for (size_t control_index = 0; control_index < _control_variate_list.size(); control_index++)
+        {
+            double value;
+            if (_control_variate_list[control_index](sample, value))
+            {
+                control_list[control_index].AddNewSample(value * value_scale, weight);
             }
         }
     }
@@ -39,21 +330,259 @@ namespace Estimating
     {
         std::lock_guard<std::mutex> lock(_source_result_mutex_list[source_index]);
         for (size_t rand_index = 0; rand_index < _random_variable_list.size(); rand_index++)
+        {
+            _random_variable_list[rand_index].CombineHistogram(_source_histogram_list[source_index][rand_index]);
+        }
+        if (!_control_variate_list.empty())
+        {
+            SubmitControlledResult(source_index);
+            return;
+        }
+        for (size_t rand_index = 0; rand_index < _random_variable_list.size(); rand_index++)
         {
             _random_variable_list[rand_index].CombineResult(_source_result_list[source_index][rand_index]);
         }
     }
 
+    template<typename SampleType>
+    void MeanEstimatorGeneric<SampleType>::SubmitControlledResult(size_t source_index)
+    {
+        const ControlMoments &moments = _source_moment_list[source_index];
+        if (moments.total_weight <= 0.0)
+        {
+            return;
+        }
+        size_t rand_count = _random_variable_list.size();
+        size_t control_count = _control_variate_list.size();
+        size_t dimension = rand_count + control_count;
+        vector<double> control_comoment(control_count * control_count);
+        vector<double> coefficient(control_count);
+        for (size_t rand_index = 0; rand_index < rand_count; rand_index++)
+        {
+            for (size_t i = 0; i < control_count; i++)
+            {
+                for (size_t j = 0; j < control_count; j++)
+                {
+                    control_comoment[i * control_count + j] =
+                            moments.comoment[(rand_count + i) * dimension + rand_count + j];
+                }
+                coefficient[i] = moments.comoment[(rand_count + i) * dimension + rand_index];
+            }
+            if (!Statistics::SolveLinearSystem(control_comoment, coefficient, control_count))
+            {
+                std::fill(coefficient.begin(), coefficient.end(), 0.0);
+            }
+            double average = moments.mean[rand_index];
+            double variance_sum = moments.comoment[rand_index * dimension + rand_index];
+            for (size_t i = 0; i < control_count; i++)
+            {
+                average -= coefficient[i] * (moments.mean[rand_count + i] - _control_expectation_list[i]);
+                variance_sum -= coefficient[i] * moments.comoment[(rand_count + i) * dimension + rand_index];
+            }
+            _random_variable_list[rand_index].CombineResult(
+                    SamplingResult::FromMoments(average, std::max(variance_sum, 0.0), moments.total_weight,
+                                                moments.squared_weight_sum));
+        }
+    }
+
     template<typename SampleType>
     void MeanEstimatorGeneric<SampleType>::SubmitMean(size_t source_index)
+    {
+        SubmitReplication(source_index, 0.0);
+    }
+
+    template<typename SampleType>
+    void MeanEstimatorGeneric<SampleType>::SubmitMean(size_t source_index, double total_weight)
+    {
+        SubmitReplication(source_index, total_weight);
+    }
+
+    template<typename SampleType>
+    void MeanEstimatorGeneric<SampleType>::SubmitReplication(size_t source_index, double total_weight)
+    {
+        std::lock_guard<std::mutex> lock(_source_result_mutex_list[source_index]);
+        vector<BatchedSamplingResult> &mean_list = _source_mean_list[source_index];
+        if (_control_variate_list.empty())
+        {
+            for (size_t rand_index = 0; rand_index < _random_variable_list.size(); rand_index++)
+            {
+                const SamplingResult &result = mean_list[rand_index].GetResult();
+                double weight = total_weight > 0.0 ? total_weight : result.TotalWeight();
+                double value = weight > 0.0 ? result.Average() * result.TotalWeight() / weight : 0.0;
+                _source_result_list[source_index][rand_index].AddNewSample(value, weight);
+                _source_histogram_list[source_index][rand_index].AddNewSample(value, weight);
+                mean_list[rand_index].Clear();
+            }
+            return;
+        }
+
+        // one joint observation of all random variables and controls per replication
+        vector<BatchedSamplingResult> &control_list = _source_control_mean_list[source_index];
+        double weight = total_weight > 0.0 ? total_weight : control_list[0].GetResult().TotalWeight();
+        vector<double> observation;
+        for (BatchedSamplingResult &batch:mean_list)
+        {
+            const SamplingResult &result = batch.GetResult();
+            observation.push_back(weight > 0.0 ? result.Average() * result.TotalWeight() / weight : 0.0);
+            batch.Clear();
+        }
+        for (BatchedSamplingResult &batch:control_list)
+        {
+            const SamplingResult &result = batch.GetResult();
+            observation.push_back(weight > 0.0 ? result.Average() * result.TotalWeight() / weight : 0.0);
+            batch.Clear();
+        }
+        if (weight <= 0.0)
+        {
+            return;
+        }
+        for (size_t rand_index = 0; rand_index < mean_list.size(); rand_index++)
+        {
+            _source_histogram_list[source_index][rand_index].AddNewSample(observation[rand_index], weight);
+        }
+        ControlMoments &moments = _source_moment_list[source_index];
+        size_t dimension = observation.size();
+        if (moments.mean.size() != dimension)
+        {
+            moments = ControlMoments();
+            moments.mean.assign(dimension, 0.0);
+            moments.comoment.assign(dimension * dimension, 0.0);
+        }
+        moments.total_weight += weight;
+        moments.squared_weight_sum += weight * weight;
+        vector<double> delta(dimension);
+        for (size_t i = 0; i < dimension; i++)
+        {
+            delta[i] = observation[i] - moments.mean[i];
+            moments.mean[i] += delta[i] * weight / moments.total_weight;
+        }
+        for (size_t i = 0; i < dimension; i++)
+        {
+            for (size_t j = 0; j < dimension; j++)
+            {
+                moments.comoment[i * dimension + j] += weight * delta[i] * (observation[j] - moments.mean[j]);
+            }
+        }
+    }
+
+    template<typename SampleType>
+    void MeanEstimatorGeneric<SampleType>::SaveSource(size_t source_index, Serialization::Writer &writer)
+    {
+        std::lock_guard<std::mutex> lock(_source_result_mutex_list[source_index]);
+        writer.WriteUint64(_random_variable_list.size());
+        for (size_t rand_index = 0; rand_index < _random_variable_list.size(); rand_index++)
+        {
+            writer.WriteString(_random_variable_list[rand_index].GetName());
+            _source_result_list[source_index][rand_index].Save(writer);
+            _source_histogram_list[source_index][rand_index].Save(writer);
+        }
+        writer.WriteUint64(_control_variate_list.size());
+        for (const auto &control_variate:_control_variate_list)
+        {
+            writer.WriteString(control_variate.GetName());
+        }
+        const ControlMoments &moments = _source_moment_list[source_index];
+        writer.WriteDouble(moments.total_weight);
+        writer.WriteDouble(moments.squared_weight_sum);
+        writer.WriteUint64(moments.mean.size());
+        for (double mean:moments.mean)
+        {
+            writer.WriteDouble(mean);
+        }
+        for (double comoment:moments.comoment)
+        {
+            writer.WriteDouble(comoment);
+        }
+    }
+
+    template<typename SampleType>
+    void MeanEstimatorGeneric<SampleType>::LoadSource(size_t source_index, Serialization::Reader &reader)
     {
         std::lock_guard<std::mutex> lock(_source_result_mutex_list[source_index]);
+        if (reader.ReadUint64() != _random_variable_list.size())
+        {
+            throw Serialization::SerializationError();
+        }
         for (size_t rand_index = 0; rand_index < _random_variable_list.size(); rand_index++)
         {
-            SamplingResult &result = _source_mean_list[source_index][rand_index];
-            _source_result_list[source_index][rand_index].AddNewSample(result.Average(), result.TotalWeight());
-            result = SamplingResult();
+            reader.ExpectString(_random_variable_list[rand_index].GetName());
+            _source_result_list[source_index][rand_index] = SamplingResult::Load(reader);
+            _source_histogram_list[source_index][rand_index] = LogHistogram::Load(reader);
+        }
+        if (reader.ReadUint64() != _control_variate_list.size())
+        {
+            throw Serialization::SerializationError();
+        }
+        for (const auto &control_variate:_control_variate_list)
+        {
+            reader.ExpectString(control_variate.GetName());
+        }
+        ControlMoments moments;
+        moments.total_weight = reader.ReadDouble();
+        moments.squared_weight_sum = reader.ReadDouble();
+        uint64_t dimension = reader.ReadUint64();
+        if (dimension != 0 && dimension != _random_variable_list.size() + _control_variate_list.size())
+        {
+            throw Serialization::SerializationError();
+        }
+        moments.mean.resize(dimension);
+        for (double &mean:moments.mean)
+        {
+            mean = reader.ReadDouble();
+        }
+        moments.comoment.resize(dimension * dimension);
+        for (double &comoment:moments.comoment)
+        {
+            comoment = reader.ReadDouble();
         }
+        _source_moment_list[source_index] = moments;
     }
 
+    RandomVariable CumulativeDerivative(const RandomVariable &variable, size_t parameter_index,
+                                        const string &parameter_name)
+    {
+        return RandomVariable("d(" + variable.GetName() + ")/d(" + parameter_name + ")",
+                              [variable, parameter_index](const PetriNetModel::PetriNet &petri_net, double &value)
+                              {
+                                  if (!variable(petri_net, value))
+                                  {
+                                      return false;
+                                  }
+                                  value *= petri_net.GetMeanScore(parameter_index);
+                                  return true;
+                              });
+    }
+
+    RandomVariable TransientDerivative(const RandomVariable &variable, size_t parameter_index,
+                                       const string &parameter_name)
+    {
+        return RandomVariable("d(" + variable.GetName() + ")/d(" + parameter_name + ")",
+                              [variable, parameter_index](const PetriNetModel::PetriNet &petri_net, double &value)
+                              {
+                                  if (!variable(petri_net, value))
+                                  {
+                                      return false;
+                                  }
+                                  value *= petri_net.GetScore(parameter_index);
+                                  return true;
+                              });
+    }
+
+    RandomVariable HittingProbability()
+    {
+        return RandomVariable("HittingProbability", [](const PetriNetModel::PetriNet &petri_net, double &value)
+        {
+            value = petri_net.IsStopped() ? 1.0 : 0.0;
+            return true;
+        });
+    }
+
+    RandomVariable CensoredHittingTime(double end_time)
+    {
+        return RandomVariable("CensoredHittingTime", [end_time](const PetriNetModel::PetriNet &petri_net, double &value)
+        {
+            value = petri_net.IsStopped() ? petri_net.GetTime() : end_time;
+            return true;
+        });
+    }
 }
@@ -18,7 +18,9 @@
 #include <sstream>
 #include <shared_mutex>
 #include <mutex>
+#include <map>
 #include "PetriNetModel/PetriNetModel.h"
+#include "Serialization.h"
 namespace Estimating
 {
     using std::string;
@@ -36,6 +38,18 @@ namespace Estimating
         double _total_weight = 0;
         double _squared_weight_sum = 0;
     public:
+        // a result summarizing samples that were accumulated elsewhere
+        static SamplingResult FromMoments(double average, double variance_sum, double total_weight,
+                                          double squared_weight_sum)
+        {
+            SamplingResult result;
+            result._average = average;
+            result._variance_sum = variance_sum;
+            result._total_weight = total_weight;
+            result._squared_weight_sum = squared_weight_sum;
+            return result;
+        }
+
         void AddNewSample(double sample, double weight)
         {
             if (weight <= 0.0)
@@ -49,6 +63,10 @@ namespace Estimating
             _squared_weight_sum += weight * weight;
         }
 
+        // Adds count samples at once: their moments are reduced with independent partial sums and merged like
+        // operator+=, so there is one division per batch instead of one per sample. Weights must be positive.
+        void AddBatch(const double *sample, const double *weight, size_t count);
+
         double Variance() const
         { return _variance_sum / _total_weight; }
 
@@ -76,6 +94,13 @@ namespace Estimating
         double TotalWeight() const
         { return _total_weight; }
 
+        double SquaredWeightSum() const
+        { return _squared_weight_sum; }
+
+        void Save(Serialization::Writer &writer) const;
+
+        static SamplingResult Load(Serialization::Reader &reader);
+
         SamplingResult &operator+=(const SamplingResult &rhs)
         {
             if (rhs._total_weight <= 0.0)
@@ -103,6 +128,104 @@ namespace Estimating
         return lhs;
     }
 
+    // Buffers samples and adds them to its SamplingResult a batch at a time, for accumulators that receive a sample
+    // per event.
+    class BatchedSamplingResult
+    {
+    private:
+        static const size_t BatchSize = 32;
+        double _sample[BatchSize];
+        double _weight[BatchSize];
+        size_t _count = 0;
+        SamplingResult _result;
+    public:
+        void AddNewSample(double sample, double weight)
+        {
+            if (weight <= 0.0)
+            {
+                return;
+            }
+            _sample[_count] = sample;
+            _weight[_count] = weight;
+            if (++_count == BatchSize)
+            {
+                Flush();
+            }
+        }
+
+        void Flush()
+        {
+            _result.AddBatch(_sample, _weight, _count);
+            _count = 0;
+        }
+
+        // flushes the pending samples first
+        const SamplingResult &GetResult()
+        {
+            Flush();
+            return _result;
+        }
+
+        void Clear()
+        {
+            _count = 0;
+            _result = SamplingResult();
+        }
+    };
+
+    // merging histograms of different relative accuracy
+    class HistogramMismatch : public std::exception
+    {
+    };
+
+    // Weighted histogram with logarithmic buckets: every quantile is returned within the relative accuracy, and the
+    // number of buckets only grows with the logarithm of the range of the magnitudes. Histograms of the same
+    // accuracy merge by adding up their buckets, like SamplingResult.
+    class LogHistogram
+    {
+    private:
+        double _log_gamma; //log of the ratio between the bounds of a bucket
+        std::map<int, double> _positive_bucket_map; //bucket i holds (gamma^(i-1), gamma^i]
+        std::map<int, double> _negative_bucket_map; //the same for the magnitudes of negative values
+        double _zero_weight = 0.0;
+        double _total_weight = 0.0;
+        double _squared_weight_sum = 0.0;
+
+        // the value of weighted rank `rank` in [0, total weight]
+        double ValueAtRank(double rank) const;
+
+        double BucketValue(int bucket_index) const
+        { return 2.0 * std::exp(_log_gamma * bucket_index) / (1.0 + std::exp(_log_gamma)); }
+
+    public:
+        LogHistogram(double relative_accuracy = 0.01) :
+                _log_gamma(std::log((1.0 + relative_accuracy) / (1.0 - relative_accuracy)))
+        { }
+
+        void AddNewSample(double sample, double weight);
+
+        double Quantile(double probability) const
+        { return ValueAtRank(probability * _total_weight); }
+
+        // Distribution-free bounds from the order statistics around the quantile, with the effective sample size
+        // of the weights. Conservative by up to the relative accuracy.
+        std::pair<double, double> QuantileInterval(double probability, double confidence_coefficient = 0.95) const;
+
+        double TotalWeight() const
+        { return _total_weight; }
+
+        size_t BucketCount() const
+        { return _positive_bucket_map.size() + _negative_bucket_map.size() + (_zero_weight > 0.0 ? 1 : 0); }
+
+        // an empty histogram takes the accuracy of rhs; otherwise both must have the same accuracy
+        LogHistogram &operator+=(const LogHistogram &rhs);
+
+        void Save(Serialization::Writer &writer) const;
+
+        // throws Serialization::SerializationError on a corrupt accuracy or weights
+        static LogHistogram Load(Serialization::Reader &reader);
+    };
+
     class ConfidenceInterval
     {
     private:
@@ -157,6 +280,7 @@ namespace Estimating
         const string _name;
         const RandomVariableFunc _func;
         SamplingResult _result;
+        LogHistogram _histogram; //of the replication values
     public:
         RandomVariableGeneric(const string &name, const RandomVariableFunc &func) : _name(name), _func(func), _result()
         { }
@@ -170,12 +294,21 @@ namespace Estimating
         const SamplingResult &GetSamplingResult() const
         { return _result; }
 
+        const LogHistogram &GetHistogram() const
+        { return _histogram; }
+
         void ClearResult()
-        { _result = SamplingResult(); }
+        {
+            _result = SamplingResult();
+            _histogram = LogHistogram();
+        }
 
         void CombineResult(const SamplingResult &other)
         { _result += other; }
 
+        void CombineHistogram(const LogHistogram &other)
+        { _histogram += other; }
+
     };
 
 
@@ -185,11 +318,26 @@ namespace Estimating
     private:
         typedef vector<SamplingResult> ResultList;
         typedef vector<ResultList> SourceList;
+        typedef vector<vector<LogHistogram>> SourceHistogramList;
+        typedef vector<vector<BatchedSamplingResult>> SourceBatchList;
         typedef vector<RandomVariableGeneric<SampleType>> RandomVariableList;
+        // weighted mean and co-moments of the replication averages of (random variables..., control variates...)
+        struct ControlMoments
+        {
+            double total_weight = 0.0;
+            double squared_weight_sum = 0.0;
+            vector<double> mean;
+            vector<double> comoment; //row major
+        };
         RandomVariableList _random_variable_list;
         SourceList _source_result_list;
+        SourceHistogramList _source_histogram_list; //of the replication values, next to _source_result_list
         vector<std::mutex> _source_result_mutex_list;
-        SourceList _source_mean_list;
+        SourceBatchList _source_mean_list; //of the current replication
+        RandomVariableList _control_variate_list;
+        vector<double> _control_expectation_list;
+        SourceBatchList _source_control_mean_list;
+        vector<ControlMoments> _source_moment_list;
     private:
         void AddNewResultToSource()
         {
@@ -197,16 +345,23 @@ namespace Estimating
             {
                 result_list.push_back(SamplingResult());
             }
-            for (ResultList &mean_list: _source_mean_list)
+            for (auto &histogram_list: _source_histogram_list)
             {
-                mean_list.push_back(SamplingResult());
+                histogram_list.push_back(LogHistogram());
+            }
+            for (auto &mean_list: _source_mean_list)
+            {
+                mean_list.push_back(BatchedSamplingResult());
             }
         }
 
     public:
         MeanEstimatorGeneric(size_t source_count) : _source_result_list(source_count),
+                                                    _source_histogram_list(source_count),
                                                     _source_result_mutex_list(source_count),
-                                                    _source_mean_list(source_count)
+                                                    _source_mean_list(source_count),
+                                                    _source_control_mean_list(source_count),
+                                                    _source_moment_list(source_count)
         {
         }
 
@@ -218,16 +373,95 @@ namespace Estimating
             AddNewResultToSource();
         }
 
-        void InputSample(size_t source_index, const SampleType &sample, double weight);
+        // Control variates: rewards with a known expectation, observed alongside the random variables. Every
+        // random variable is then estimated by its regression on the controls (the coefficients minimizing the
+        // variance are estimated from the replications of each source), i.e.
+        //     mean(Y) - beta * (mean(C) - expectation).
+        // Add random variables and controls before the first sample.
+        void AddControlVariate(const RandomVariableGeneric<SampleType> &control_variate, double expectation)
+        {
+            _control_variate_list.push_back(control_variate);
+            _control_expectation_list.push_back(expectation);
+            for (auto &mean_list: _source_control_mean_list)
+            {
+                mean_list.push_back(BatchedSamplingResult());
+            }
+        }
+
+        // value_scale multiplies the observed values, e.g. by the likelihood ratio under importance sampling
+        void InputSample(size_t source_index, const SampleType &sample, double weight, double value_scale = 1.0);
 
         void SubmitMean(size_t source_index);
 
+        // normalizes by total_weight instead of the weight of the inputs, for replications made of several branches
+        void SubmitMean(size_t source_index, double total_weight);
+
         void ClearResult();
 
         void SubmitResult(size_t source_index);
 
+        // adds a result estimated elsewhere, e.g. by another process, to random variable rand_index
+        void CombineResult(size_t rand_index, const SamplingResult &result)
+        { _random_variable_list[rand_index].CombineResult(result); }
+
         const vector<RandomVariableGeneric<SampleType>> &GetRandomVariableList() const
         { return _random_variable_list; }
+
+        // The accumulated replications of a source, for checkpoints: call between replications, i.e. with no
+        // samples since the last SubmitMean. The variables are identified by name, and LoadSource throws
+        // SerializationError unless they match.
+        void SaveSource(size_t source_index, Serialization::Writer &writer);
+
+        void LoadSource(size_t source_index, Serialization::Reader &reader);
+
+    private:
+        // a total_weight of 0 keeps the weight of the inputs
+        void SubmitReplication(size_t source_index, double total_weight);
+
+        void SubmitControlledResult(size_t source_index);
+    };
+
+    // Named results that outlive the process: written to versioned result files by independent runs (other
+    // processes, hosts or seeds) and merged with the exact formula of SamplingResult::operator+=, e.g. into one
+    // ConfidenceInterval. Entries are kept in the order they were first added.
+    class ResultSet
+    {
+    private:
+        vector<string> _name_list;
+        vector<SamplingResult> _result_list;
+    public:
+        // merges into the entry of the same name, if any
+        void Add(const string &name, const SamplingResult &result);
+
+        // the results of all random variables of the estimator, named prefix + variable name
+        template<typename SampleType>
+        void AddEstimator(const MeanEstimatorGeneric<SampleType> &estimator, const string &prefix = "")
+        {
+            for (const auto &rand_var:estimator.GetRandomVariableList())
+            {
+                Add(prefix + rand_var.GetName(), rand_var.GetSamplingResult());
+            }
+        }
+
+        ResultSet &operator+=(const ResultSet &rhs);
+
+        size_t Size() const
+        { return _name_list.size(); }
+
+        const string &GetName(size_t index) const
+        { return _name_list[index]; }
+
+        const SamplingResult &GetResult(size_t index) const
+        { return _result_list[index]; }
+
+        // nullptr if there is no entry of that name
+        const SamplingResult *Find(const string &name) const;
+
+        // atomically, so that readers on a shared file system never see a partial file
+        void Write(const string &path) const;
+
+        // throws SerializationError if the file is missing, corrupt or of a newer version
+        static ResultSet Read(const string &path);
     };
 
     template
@@ -239,6 +473,22 @@ namespace Estimating
     typedef RandomVariableGeneric<PetriNetModel::PetriNet> RandomVariable;
     typedef MeanEstimatorGeneric<PetriNetModel::PetriNet> MeanEstimator;
 
+    // Score-function estimators of the derivative of a reward with respect to a rate parameter of the net (see
+    // PetriNetCreator::AddRateParameter), estimated in the same run as the reward itself. They rely on the horizon
+    // of the net being the end time of the simulation, which the simulators take care of.
+    RandomVariable CumulativeDerivative(const RandomVariable &variable, size_t parameter_index,
+                                        const string &parameter_name);
+
+    RandomVariable TransientDerivative(const RandomVariable &variable, size_t parameter_index,
+                                       const string &parameter_name);
+
+    // First passage times into the markings of the stopping predicate of the net, for transient estimators: the
+    // probability of hitting them by the end time, and the hitting time censored at the end time. Their ratio
+    // estimates the mean time to failure when the hitting time is about exponential (total time on test).
+    RandomVariable HittingProbability();
+
+    RandomVariable CensoredHittingTime(double end_time);
+
 }
 
 #endif //SPNP_ESTIMATOR_H
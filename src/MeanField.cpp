@@ -0,0 +1,229 @@
+//
+
+#include <cmath>
+#include <algorithm>
+#include "MeanField.h"
+
+namespace MeanField
+{
+    const vector<double> &MeanFieldResult::GetValueList(const string &name) const
+    {
+        for (size_t i = 0; i < _name_list.size(); i++)
+        {
+            if (_name_list[i] == name)
+            {
+                return _value_list[i];
+            }
+        }
+        throw NameNotFound();
+    }
+
+    MeanFieldSolver::MeanFieldSolver(const PetriNetCreator &creator) : _creator(creator)
+    {
+        if (!creator.GetFluidPlaceCmdList().empty())
+        {
+            throw MeanFieldNotApplicable();
+        }
+        for (const auto &cmd:creator.GetPlaceCmdList())
+        {
+            _init_mean.push_back(cmd.init_mark);
+        }
+        for (const auto &cmd:creator.GetTransitionCmdList())
+        {
+            const ExpSampler *sampler = cmd.firing_time_func ? cmd.firing_time_func.target<ExpSampler>() : nullptr;
+            if (cmd.immediate || cmd.rate_func || sampler == nullptr)
+            {
+                throw MeanFieldNotApplicable();
+            }
+            Flow flow;
+            flow.rate = sampler->lambda;
+            flow.server_policy = cmd.server_policy;
+            flow.server_count = cmd.server_count;
+            _flow_list.push_back(flow);
+        }
+        for (const auto &cmd:creator.GetArcCmdList())
+        {
+            Flow &flow = _flow_list[cmd.transition_index];
+            ArcTerm term{cmd.place_index, (double) cmd.multiplicity};
+            switch (cmd.type)
+            {
+                case Arc::Type::Input:
+                    if (creator.IsDegreeArc(cmd))
+                    {
+                        flow.degree_arcs.push_back(term);
+                    } else
+                    {
+                        flow.enabling_arcs.push_back(term);
+                    }
+                    flow.change.push_back(ArcTerm{cmd.place_index, -term.multiplicity});
+                    break;
+                case Arc::Type::Output:
+                    flow.change.push_back(term);
+                    break;
+                case Arc::Type::Inhibitor:
+                    flow.inhibitor_arcs.push_back(term);
+                    break;
+            }
+        }
+    }
+
+    void MeanFieldSolver::Derivative(const vector<double> &mean, vector<double> &derivative) const
+    {
+        std::fill(derivative.begin(), derivative.end(), 0.0);
+        for (const auto &flow:_flow_list)
+        {
+            double speed = 1.0;
+            if (flow.server_policy != Transition::ServerPolicy::SingleServer && !flow.degree_arcs.empty())
+            {
+                speed = std::numeric_limits<double>::infinity();
+                for (const auto &arc:flow.degree_arcs)
+                {
+                    speed = std::min(speed, mean[arc.place_index] / arc.multiplicity);
+                }
+                if (flow.server_policy == Transition::ServerPolicy::MultipleServer)
+                {
+                    speed = std::min(speed, flow.server_count);
+                }
+            }
+            for (const auto &arc:flow.enabling_arcs)
+            {
+                speed = std::min(speed, mean[arc.place_index] / arc.multiplicity);
+            }
+            for (const auto &arc:flow.inhibitor_arcs)
+            {
+                speed *= std::min(std::max(arc.multiplicity - mean[arc.place_index], 0.0), 1.0);
+            }
+            if (speed <= 0.0)
+            {
+                continue;
+            }
+            for (const auto &change:flow.change)
+            {
+                derivative[change.place_index] += flow.rate * speed * change.multiplicity;
+            }
+        }
+    }
+
+    void MeanFieldSolver::Jacobian(const vector<double> &mean, const vector<double> &derivative,
+                                   vector<double> &jacobian) const
+    {
+        size_t n = mean.size();
+        vector<double> shifted(mean);
+        vector<double> shifted_derivative(n);
+        for (size_t col = 0; col < n; col++)
+        {
+            double step = std::sqrt(std::numeric_limits<double>::epsilon()) * std::max(std::abs(mean[col]), 1.0);
+            shifted[col] = mean[col] + step;
+            Derivative(shifted, shifted_derivative);
+            for (size_t row = 0; row < n; row++)
+            {
+                jacobian[row * n + col] = (shifted_derivative[row] - derivative[row]) / step;
+            }
+            shifted[col] = mean[col];
+        }
+    }
+
+    void MeanFieldSolver::Record(MeanFieldResult &result, const vector<double> &mean, double time) const
+    {
+        MeanFieldState state(_creator, mean, time);
+        result._time_list.push_back(time);
+        for (size_t i = 0; i < _random_variable_list.size(); i++)
+        {
+            double value;
+            if (!_random_variable_list[i](state, value))
+            {
+                value = std::numeric_limits<double>::quiet_NaN();
+            }
+            result._value_list[i].push_back(value);
+        }
+    }
+
+    MeanFieldResult MeanFieldSolver::Solve(double end_time, size_t point_count) const
+    {
+        const double gamma = 1.0 + 1.0 / std::sqrt(2.0);
+        MeanFieldResult result;
+        result._value_list.resize(_random_variable_list.size());
+        for (const auto &rand_var:_random_variable_list)
+        {
+            result._name_list.push_back(rand_var.GetName());
+        }
+
+        size_t n = _init_mean.size();
+        vector<double> mean(_init_mean);
+        vector<double> derivative(n);
+        vector<double> jacobian(n * n);
+        vector<double> matrix(n * n);
+        vector<double> k1(n);
+        vector<double> k2(n);
+        vector<double> stage(n);
+        vector<double> next_mean(n);
+        double time = 0.0;
+        double step = end_time > 0.0 ? end_time * 1e-6 : 0.0;
+        Record(result, mean, time);
+        for (size_t point = 1; point < point_count; point++)
+        {
+            double point_time = end_time * point / (point_count - 1);
+            while (time < point_time)
+            {
+                double h = std::min(step, point_time - time);
+                Derivative(mean, derivative);
+                Jacobian(mean, derivative, jacobian);
+                for (size_t i = 0; i < n * n; i++)
+                {
+                    matrix[i] = -gamma * h * jacobian[i];
+                }
+                for (size_t i = 0; i < n; i++)
+                {
+                    matrix[i * n + i] += 1.0;
+                }
+                // both stages share one matrix, so solve them on copies
+                vector<double> lu(matrix);
+                k1 = derivative;
+                SolveLinearSystem(lu, k1, n);
+                for (size_t i = 0; i < n; i++)
+                {
+                    stage[i] = mean[i] + h * k1[i];
+                }
+                Derivative(stage, k2);
+                for (size_t i = 0; i < n; i++)
+                {
+                    k2[i] -= 2.0 * k1[i];
+                }
+                lu = matrix;
+                SolveLinearSystem(lu, k2, n);
+
+                double error = 0.0;
+                for (size_t i = 0; i < n; i++)
+                {
+                    next_mean[i] = mean[i] + 1.5 * h * k1[i] + 0.5 * h * k2[i];
+                    double scale = _absolute_tolerance +
+                                   _relative_tolerance * std::max(std::abs(mean[i]), std::abs(next_mean[i]));
+                    double component_error = std::abs(0.5 * h * (k1[i] + k2[i])) / scale;
+                    if (!std::isfinite(component_error))
+                    {
+                        throw MeanFieldDiverged();
+                    }
+                    error = std::max(error, component_error);
+                }
+                double factor = error > 0.0 ? 0.9 / std::sqrt(error) : 5.0;
+                double next_step = h * std::min(5.0, std::max(0.2, factor));
+                if (error <= 1.0)
+                {
+                    time += h;
+                    mean.swap(next_mean);
+                    // a step cut short at a point does not shrink the next one
+                    step = h < step ? std::max(step, next_step) : next_step;
+                } else
+                {
+                    step = next_step;
+                    if (step < 1e-12 * point_time)
+                    {
+                        throw MeanFieldDiverged();
+                    }
+                }
+            }
+            Record(result, mean, point_time);
+        }
+        return result;
+    }
+}
@@ -0,0 +1,132 @@
+//
+
+#ifndef SPNP_MEAN_FIELD_H
+#define SPNP_MEAN_FIELD_H
+
+#include <string>
+#include <vector>
+#include <limits>
+#include "PetriNetModel/PetriNetModel.h"
+#include "Estimating.h"
+
+namespace MeanField
+{
+    using std::string;
+    using std::vector;
+    using std::size_t;
+    using namespace PetriNetModel;
+
+    // transitions that are not exponential, immediate transitions, marking dependent rates and fluid places
+    // have no mean-field counterpart
+    class MeanFieldNotApplicable : public std::exception
+    {
+    };
+
+    // the step size collapsed, e.g. because the rates are not finite
+    class MeanFieldDiverged : public std::exception
+    {
+    };
+
+    // The sample type of mean-field reward variables: the mean marking at one point in time.
+    class MeanFieldState
+    {
+    private:
+        const PetriNetCreator &_creator;
+        const vector<double> &_mean;
+        double _time;
+    public:
+        MeanFieldState(const PetriNetCreator &creator, const vector<double> &mean, double time) :
+                _creator(creator), _mean(mean), _time(time)
+        { }
+
+        double GetTime() const
+        { return _time; }
+
+        double GetPlaceMean(size_t p_index) const
+        { return _mean[p_index]; }
+
+        double GetPlaceMean(const string &p_name) const
+        { return _mean[_creator.GetPlaceIndex(p_name)]; }
+    };
+
+    typedef Estimating::RandomVariableGeneric<MeanFieldState> MeanFieldVariable;
+
+    class MeanFieldResult
+    {
+        friend class MeanFieldSolver;
+
+    private:
+        vector<double> _time_list;
+        vector<string> _name_list;
+        vector<vector<double>> _value_list; //per variable, NaN where the variable is undefined
+    public:
+        const vector<double> &GetTimeList() const
+        { return _time_list; }
+
+        const vector<double> &GetValueList(size_t variable_index) const
+        { return _value_list[variable_index]; }
+
+        const vector<double> &GetValueList(const string &name) const;
+
+        const vector<string> &GetNameList() const
+        { return _name_list; }
+    };
+
+    // Deterministic approximation of the mean marking of large population nets: every transition moves tokens at
+    // its exponential rate times its fluid enabling
+    //     single server:   min(1, x/w) over the input arcs
+    //     infinite server: min(x/w) over the arcs counting servers, k servers: bounded by k
+    // and an inhibitor arc of multiplicity w scales that by clamp(w - x, 0, 1). The ODEs are integrated with the
+    // L-stable two stage Rosenbrock method ROS2, with step size control against linearly implicit Euler, so stiff
+    // nets (rates many orders of magnitude apart) are fine. The cost does not depend on the token counts, but every
+    // step builds a dense Jacobian by finite differences and factors it in O(n^3) for n places, so nets beyond a few
+    // hundred places are slow.
+    class MeanFieldSolver
+    {
+    private:
+        struct ArcTerm
+        {
+            size_t place_index;
+            double multiplicity;
+        };
+        struct Flow
+        {
+            double rate;
+            Transition::ServerPolicy server_policy;
+            double server_count;
+            vector<ArcTerm> degree_arcs;
+            vector<ArcTerm> enabling_arcs;
+            vector<ArcTerm> inhibitor_arcs;
+            vector<ArcTerm> change;
+        };
+        const PetriNetCreator &_creator;
+        vector<Flow> _flow_list;
+        vector<double> _init_mean;
+        vector<MeanFieldVariable> _random_variable_list;
+        double _relative_tolerance = 1e-6;
+        double _absolute_tolerance = 1e-9;
+    public:
+        MeanFieldSolver(const PetriNetCreator &creator);
+
+        void AddRandomVariable(const MeanFieldVariable &random_variable)
+        { _random_variable_list.push_back(random_variable); }
+
+        void SetTolerance(double relative_tolerance, double absolute_tolerance)
+        {
+            _relative_tolerance = relative_tolerance;
+            _absolute_tolerance = absolute_tolerance;
+        }
+
+        // the reward variables at point_count equidistant points of [0, end_time]; throws MeanFieldDiverged
+        MeanFieldResult Solve(double end_time, size_t point_count) const;
+
+        void Derivative(const vector<double> &mean, vector<double> &derivative) const;
+
+    private:
+        void Jacobian(const vector<double> &mean, const vector<double> &derivative, vector<double> &jacobian) const;
+
+        void Record(MeanFieldResult &result, const vector<double> &mean, double time) const;
+    };
+}
+
+#endif //SPNP_MEAN_FIELD_H
@@ -0,0 +1,132 @@
+//
+
+#include <cmath>
+#include "ModelChecking.h"
+#include "Statistics.h"
+
+namespace ModelChecking
+{
+    bool PathFormula::Check(PetriNet &petri_net, UniformRandomNumberGenerator &generator) const
+    {
+        petri_net.Reset(generator);
+        while (true)
+        {
+            if (_psi(petri_net))
+            {
+                return !_negated;
+            }
+            // the trajectory ends at the stopping predicate of the net without reaching psi
+            if ((_phi && !_phi(petri_net)) || petri_net.IsStopped() || petri_net.GetNextFiringTime() > _time_bound)
+            {
+                return _negated;
+            }
+            petri_net.NextState(generator);
+        }
+    }
+
+    SprtTest::SprtTest(double threshold, double indifference, double alpha, double beta)
+    {
+        double p0 = threshold + indifference;
+        double p1 = threshold - indifference;
+        if (p1 <= 0.0 || p0 >= 1.0 || p1 >= p0 || alpha <= 0.0 || beta <= 0.0 || alpha + beta >= 1.0)
+        {
+            throw InvalidSequentialTest();
+        }
+        _success_log_ratio = std::log(p1 / p0);
+        _failure_log_ratio = std::log((1.0 - p1) / (1.0 - p0));
+        _lower_bound = std::log(beta / (1.0 - alpha));
+        _upper_bound = std::log((1.0 - beta) / alpha);
+    }
+
+    Verdict SprtTest::GetVerdict() const
+    {
+        if (_log_ratio >= _upper_bound)
+        {
+            return Verdict::Below;
+        }
+        if (_log_ratio <= _lower_bound)
+        {
+            return Verdict::AtLeast;
+        }
+        return Verdict::Undecided;
+    }
+
+    BayesianTest::BayesianTest(double threshold, double bayes_factor, double prior_a, double prior_b) :
+            _threshold(threshold), _bayes_factor(bayes_factor), _prior_a(prior_a), _prior_b(prior_b)
+    {
+        if (threshold <= 0.0 || threshold >= 1.0 || bayes_factor <= 1.0 || prior_a <= 0.0 || prior_b <= 0.0)
+        {
+            throw InvalidSequentialTest();
+        }
+        double prior_below = Statistics::RegularizedIncompleteBeta(threshold, prior_a, prior_b);
+        _prior_odds = prior_below / (1.0 - prior_below);
+    }
+
+    Verdict BayesianTest::GetVerdict() const
+    {
+        double posterior_below = Statistics::RegularizedIncompleteBeta(_threshold, _prior_a + _success_count,
+                                                                       _prior_b + _failure_count);
+        // Bayes factor of "at least" against "below": posterior odds over prior odds
+        double posterior_at_least = 1.0 - posterior_below;
+        if (posterior_at_least * _prior_odds >= _bayes_factor * posterior_below)
+        {
+            return Verdict::AtLeast;
+        }
+        if (posterior_below >= _bayes_factor * posterior_at_least * _prior_odds)
+        {
+            return Verdict::Below;
+        }
+        return Verdict::Undecided;
+    }
+
+    Verdict ModelChecker::Check(const PathFormula &formula, SequentialTest &test, uint64_t max_replication_count,
+                                unsigned long seed)
+    {
+        if (_creator.CreatePetriNet().IsImportanceSampling())
+        {
+            throw ModelCheckingNotSupported();
+        }
+        test.Reset();
+        _next_replication = 0;
+        _decided = false;
+        _pending_outcome_map.clear();
+        _observation_count = 0;
+        _satisfied_count = 0;
+        vector<std::thread> thread_list;
+        for (size_t i = 0; i < _worker_count; i++)
+        {
+            thread_list.push_back(std::thread(&ModelChecker::RunWorker, this, std::cref(formula), std::ref(test),
+                                              max_replication_count, seed + i));
+        }
+        for (auto &worker_thread:thread_list)
+        {
+            worker_thread.join();
+        }
+        return test.GetVerdict();
+    }
+
+    void ModelChecker::RunWorker(const PathFormula &formula, SequentialTest &test, uint64_t max_replication_count,
+                                 unsigned long seed)
+    {
+        PetriNet petri_net = _creator.CreatePetriNet();
+        Statistics::DefaultUniformRandomNumberGenerator generator(seed);
+        uint64_t replication;
+        while (!_decided && (replication = _next_replication++) < max_replication_count)
+        {
+            generator.StartReplication();
+            bool satisfied = formula.Check(petri_net, generator);
+            std::lock_guard<std::mutex> lock(_test_mutex);
+            _pending_outcome_map[replication] = satisfied;
+            auto it = _pending_outcome_map.find(_observation_count);
+            while (!_decided && it != _pending_outcome_map.end())
+            {
+                test.AddObservation(it->second);
+                _satisfied_count += it->second ? 1 : 0;
+                _observation_count++;
+                _pending_outcome_map.erase(it);
+                _decided = test.GetVerdict() != Verdict::Undecided;
+                it = _pending_outcome_map.find(_observation_count);
+            }
+        }
+    }
+}
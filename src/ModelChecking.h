@@ -0,0 +1,171 @@
+//
+
+#ifndef SPNP_MODELCHECKING_H
+#define SPNP_MODELCHECKING_H
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include "PetriNetModel/PetriNetModel.h"
+
+namespace ModelChecking
+{
+    using namespace PetriNetModel;
+    using std::vector;
+
+    // trajectories of importance sampling carry likelihood ratios, so they are no Bernoulli observations
+    class ModelCheckingNotSupported : public std::exception
+    {
+    };
+
+    // probabilities of the test must lie strictly between 0 and 1
+    class InvalidSequentialTest : public std::exception
+    {
+    };
+
+    typedef std::function<bool(const PetriNet &)> StateFormula;
+
+    // A time-bounded path formula: phi U[0,t] psi holds if psi is reached by time t through markings satisfying phi.
+    // It is decided as soon as psi holds, phi fails, the stopping predicate of the net holds or the next event comes
+    // after t, so a trajectory is simulated only as far as its verdict needs.
+    class PathFormula
+    {
+    private:
+        StateFormula _phi;
+        StateFormula _psi;
+        double _time_bound;
+        bool _negated;
+
+        PathFormula(const StateFormula &phi, const StateFormula &psi, double time_bound, bool negated) :
+                _phi(phi), _psi(psi), _time_bound(time_bound), _negated(negated)
+        { }
+
+    public:
+        static PathFormula Until(const StateFormula &phi, const StateFormula &psi, double time_bound)
+        { return PathFormula(phi, psi, time_bound, false); }
+
+        // F[0,t] psi, i.e. true U[0,t] psi
+        static PathFormula Eventually(const StateFormula &psi, double time_bound)
+        { return PathFormula(nullptr, psi, time_bound, false); }
+
+        // G[0,t] phi, i.e. not F[0,t] not phi
+        static PathFormula Globally(const StateFormula &phi, double time_bound)
+        {
+            return PathFormula(nullptr, [phi](const PetriNet &petri_net)
+            { return !phi(petri_net); }, time_bound, true);
+        }
+
+        // simulates one trajectory from the initial marking until the formula is decided on it
+        bool Check(PetriNet &petri_net, UniformRandomNumberGenerator &generator) const;
+    };
+
+    // whether the probability of the formula is at least the threshold of the test
+    enum class Verdict
+    {
+        Undecided,
+        AtLeast,
+        Below,
+    };
+
+    // decides between P >= threshold and P < threshold from a sequence of Bernoulli observations
+    class SequentialTest
+    {
+    public:
+        virtual ~SequentialTest()
+        { }
+
+        virtual void Reset() = 0;
+
+        virtual void AddObservation(bool satisfied) = 0;
+
+        virtual Verdict GetVerdict() const = 0;
+    };
+
+    // Wald's sequential probability ratio test of p >= threshold + indifference against p <= threshold -
+    // indifference, wrong with probability at most alpha in the first case and beta in the second.
+    class SprtTest : public SequentialTest
+    {
+    private:
+        double _success_log_ratio;
+        double _failure_log_ratio;
+        double _lower_bound;
+        double _upper_bound;
+        double _log_ratio = 0.0; //of the hypothesis "below" against "at least"
+    public:
+        SprtTest(double threshold, double indifference, double alpha = 0.05, double beta = 0.05);
+
+        virtual void Reset() override
+        { _log_ratio = 0.0; }
+
+        virtual void AddObservation(bool satisfied) override
+        { _log_ratio += satisfied ? _success_log_ratio : _failure_log_ratio; }
+
+        virtual Verdict GetVerdict() const override;
+    };
+
+    // Bayesian sequential test (Jha et al.): with a Beta(prior_a, prior_b) prior on p, decides once the Bayes factor
+    // of p >= threshold against p < threshold exceeds bayes_factor or falls below its inverse.
+    class BayesianTest : public SequentialTest
+    {
+    private:
+        double _threshold;
+        double _bayes_factor;
+        double _prior_a;
+        double _prior_b;
+        double _prior_odds; //of "below" against "at least"
+        uint64_t _success_count = 0;
+        uint64_t _failure_count = 0;
+    public:
+        BayesianTest(double threshold, double bayes_factor = 1000.0, double prior_a = 1.0, double prior_b = 1.0);
+
+        virtual void Reset() override
+        {
+            _success_count = 0;
+            _failure_count = 0;
+        }
+
+        virtual void AddObservation(bool satisfied) override
+        { (satisfied ? _success_count : _failure_count)++; }
+
+        virtual Verdict GetVerdict() const override;
+    };
+
+    // Runs trajectories on worker threads and feeds their outcomes to the test in the order of their replication
+    // index, not of their completion, since short trajectories often have a particular outcome.
+    class ModelChecker
+    {
+    private:
+        const PetriNetCreator &_creator;
+        size_t _worker_count;
+        std::atomic<uint64_t> _next_replication;
+        std::atomic<bool> _decided;
+        std::mutex _test_mutex;
+        std::unordered_map<uint64_t, bool> _pending_outcome_map; //finished ahead of their turn
+        uint64_t _observation_count = 0;
+        uint64_t _satisfied_count = 0;
+    public:
+        ModelChecker(const PetriNetCreator &creator, size_t worker_count) :
+                _creator(creator), _worker_count(worker_count), _next_replication(0), _decided(false)
+        { }
+
+        ModelChecker(const ModelChecker &) = delete;
+
+        // Undecided if the test needs more than max_replication_count trajectories; worker i is seeded with seed + i
+        Verdict Check(const PathFormula &formula, SequentialTest &test, uint64_t max_replication_count,
+                      unsigned long seed);
+
+        // the number of trajectories the last verdict was based on
+        uint64_t GetObservationCount() const
+        { return _observation_count; }
+
+        uint64_t GetSatisfiedCount() const
+        { return _satisfied_count; }
+
+    private:
+        void RunWorker(const PathFormula &formula, SequentialTest &test, uint64_t max_replication_count,
+                       unsigned long seed);
+    };
+}
+
+#endif //SPNP_MODELCHECKING_H
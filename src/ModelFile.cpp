@@ -0,0 +1,710 @@
+//
+
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ModelFile.h"
+#include "Serialization.h"
+
+namespace ModelFile
+{
+    static const char ImageMagic[8] = {'S', 'P', 'N', 'P', 'M', 'D', 'L', '1'};
+    static const uint64_t ByteOrderMark = 0x0102030405060708ULL;
+
+    struct ImageHeader
+    {
+        char magic[8];
+        uint64_t byte_order; //a cache is only read on machines of the same byte order
+        uint64_t image_size;
+        uint64_t source_size;
+        int64_t source_time;
+        uint64_t place_count;
+        uint64_t transition_count;
+        uint64_t arc_count;
+        uint64_t parameter_count;
+        uint64_t name_pool_size;
+    };
+
+    struct PlaceRecord
+    {
+        uint64_t name_offset;
+        uint32_t name_length;
+        int32_t init_mark;
+    };
+
+    struct TransitionRecord
+    {
+        uint64_t name_offset;
+        uint64_t sampler_name_offset;
+        uint64_t parameter_offset;
+        double weight;
+        uint32_t name_length;
+        uint32_t sampler_name_length;
+        uint32_t parameter_count;
+        int32_t priority;
+        uint8_t immediate;
+        uint8_t policy;
+        uint8_t padding[6];
+    };
+
+    struct ArcRecord
+    {
+        uint32_t transition_index;
+        uint32_t place_index;
+        int32_t multiplicity;
+        uint8_t type;
+        uint8_t padding[3];
+    };
+
+    static_assert(sizeof(ImageHeader) % 8 == 0 && sizeof(PlaceRecord) % 8 == 0 &&
+                  sizeof(TransitionRecord) % 8 == 0 && sizeof(ArcRecord) % 8 == 0, "records must stay aligned");
+
+    static size_t Align8(size_t size)
+    { return (size + 7) & ~(size_t) 7; }
+
+    // where the sections of an image start
+    struct ImageLayout
+    {
+        size_t place_offset;
+        size_t transition_offset;
+        size_t arc_offset;
+        size_t parameter_offset;
+        size_t name_offset;
+        size_t size;
+
+        ImageLayout(const ImageHeader &header)
+        {
+            place_offset = sizeof(ImageHeader);
+            transition_offset = place_offset + header.place_count * sizeof(PlaceRecord);
+            arc_offset = transition_offset + header.transition_count * sizeof(TransitionRecord);
+            parameter_offset = arc_offset + header.arc_count * sizeof(ArcRecord);
+            name_offset = parameter_offset + header.parameter_count * sizeof(double);
+            size = name_offset + Align8(header.name_pool_size);
+        }
+    };
+
+    SamplerRegistry::SamplerRegistry()
+    {
+        AddSampler("exp", 1, [](const vector<double> &parameter_list)
+        { return Statistics::Exp(parameter_list[0]); });
+        AddSampler("det", 1, [](const vector<double> &parameter_list)
+        { return Statistics::Deterministic(parameter_list[0]); });
+        AddSampler("weibull", 2, [](const vector<double> &parameter_list)
+        { return Statistics::Weibull(parameter_list[0], parameter_list[1]); });
+        AddSampler("pareto", 3, [](const vector<double> &parameter_list)
+        { return Statistics::ParetoTrunc(parameter_list[0], parameter_list[1], parameter_list[2]); });
+    }
+
+    void SamplerRegistry::AddSampler(const string &name, size_t parameter_count, const SamplerFactory &factory)
+    {
+        _entry_map[name] = Entry{parameter_count, factory};
+    }
+
+    bool SamplerRegistry::GetParameterCount(const string &name, size_t &parameter_count) const
+    {
+        auto it = _entry_map.find(name);
+        if (it == _entry_map.end())
+        {
+            return false;
+        }
+        parameter_count = it->second.parameter_count;
+        return true;
+    }
+
+    Transition::FiringTimeFuncType SamplerRegistry::CreateSampler(const string &name,
+                                                                  const vector<double> &parameter_list) const
+    {
+        auto it = _entry_map.find(name);
+        if (it == _entry_map.end() || it->second.parameter_count != parameter_list.size())
+        {
+            throw UnknownSampler();
+        }
+        return it->second.factory(parameter_list);
+    }
+
+    // a range of the text, valid as long as the text
+    struct Token
+    {
+        const char *begin;
+        const char *end;
+
+        size_t Length() const
+        { return (size_t) (end - begin); }
+
+        bool Equals(const char *word) const
+        { return Length() == std::strlen(word) && std::memcmp(begin, word, Length()) == 0; }
+    };
+
+    static uint64_t HashName(const char *name, size_t length)
+    {
+        uint64_t hash = 0xcbf29ce484222325ULL; //FNV-1a
+        for (size_t i = 0; i < length; i++)
+        {
+            hash = (hash ^ (unsigned char) name[i]) * 0x100000001b3ULL;
+        }
+        return hash;
+    }
+
+    // Open addressing from names to indices. The keys are offsets into the name pool of the image being built, so
+    // tokens are looked up in place.
+    class NameTable
+    {
+    private:
+        struct Slot
+        {
+            uint64_t hash;
+            size_t name_offset;
+            size_t name_length;
+            size_t index;
+            bool used;
+        };
+        const string &_name_pool;
+        vector<Slot> _slot_list;
+        size_t _count = 0;
+
+        Slot &FindSlot(const char *name, size_t length, uint64_t hash)
+        {
+            size_t mask = _slot_list.size() - 1;
+            for (size_t position = hash & mask; ; position = (position + 1) & mask)
+            {
+                Slot &slot = _slot_list[position];
+                if (!slot.used || (slot.hash == hash && slot.name_length == length &&
+                                   std::memcmp(_name_pool.data() + slot.name_offset, name, length) == 0))
+                {
+                    return slot;
+                }
+            }
+        }
+
+        void Grow()
+        {
+            vector<Slot> old_slot_list(_slot_list.size() * 2, Slot{0, 0, 0, 0, false});
+            old_slot_list.swap(_slot_list);
+            for (const Slot &old_slot:old_slot_list)
+            {
+                if (old_slot.used)
+                {
+                    FindSlot(_name_pool.data() + old_slot.name_offset, old_slot.name_length, old_slot.hash) =
+                            old_slot;
+                }
+            }
+        }
+
+    public:
+        NameTable(const string &name_pool) : _name_pool(name_pool), _slot_list(64, Slot{0, 0, 0, 0, false})
+        { }
+
+        bool Find(const Token &token, size_t &index)
+        {
+            const Slot &slot = FindSlot(token.begin, token.Length(), HashName(token.begin, token.Length()));
+            index = slot.index;
+            return slot.used;
+        }
+
+        // the name has to be in the pool already; false if it is in the table already
+        bool Insert(size_t name_offset, size_t name_length, size_t index)
+        {
+            if (2 * (_count + 1) > _slot_list.size())
+            {
+                Grow();
+            }
+            const char *name = _name_pool.data() + name_offset;
+            uint64_t hash = HashName(name, name_length);
+            Slot &slot = FindSlot(name, name_length, hash);
+            if (slot.used)
+            {
+                return false;
+            }
+            slot = Slot{hash, name_offset, name_length, index, true};
+            _count++;
+            return true;
+        }
+    };
+
+    static bool ParseDouble(const Token &token, double &value)
+    {
+        // strtod needs a terminated string; numbers are short
+        char buffer[64];
+        size_t length = token.Length();
+        if (length == 0 || length >= sizeof(buffer))
+        {
+            return false;
+        }
+        std::memcpy(buffer, token.begin, length);
+        buffer[length] = '\0';
+        char *end;
+        value = std::strtod(buffer, &end);
+        return end == buffer + length;
+    }
+
+    static bool ParseInt(const Token &token, int32_t min_value, int32_t &value)
+    {
+        const char *position = token.begin;
+        bool negative = position < token.end && *position == '-';
+        position += negative ? 1 : 0;
+        if (position == token.end)
+        {
+            return false;
+        }
+        int64_t magnitude = 0;
+        for (; position < token.end; position++)
+        {
+            if (*position < '0' || *position > '9')
+            {
+                return false;
+            }
+            magnitude = magnitude * 10 + (*position - '0');
+            if (magnitude > std::numeric_limits<int32_t>::max())
+            {
+                return false;
+            }
+        }
+        value = (int32_t) (negative ? -magnitude : magnitude);
+        return value >= min_value;
+    }
+
+    // accumulates the sections of an image while parsing
+    class ImageBuilder
+    {
+    public:
+        vector<PlaceRecord> place_list;
+        vector<TransitionRecord> transition_list;
+        vector<ArcRecord> arc_list;
+        vector<double> parameter_list;
+        string name_pool;
+
+        // appends the name to the pool and returns its offset
+        size_t AddName(const Token &token)
+        {
+            size_t offset = name_pool.size();
+            name_pool.append(token.begin, token.Length());
+            return offset;
+        }
+
+        vector<uint64_t> Finish() const
+        {
+            ImageHeader header;
+            std::memset(&header, 0, sizeof(header));
+            std::memcpy(header.magic, ImageMagic, sizeof(ImageMagic));
+            header.byte_order = ByteOrderMark;
+            header.place_count = place_list.size();
+            header.transition_count = transition_list.size();
+            header.arc_count = arc_list.size();
+            header.parameter_count = parameter_list.size();
+            header.name_pool_size = name_pool.size();
+            ImageLayout layout(header);
+            header.image_size = layout.size;
+            vector<uint64_t> buffer(layout.size / 8, 0);
+            char *image = (char *) buffer.data();
+            std::memcpy(image, &header, sizeof(header));
+            std::memcpy(image + layout.place_offset, place_list.data(), place_list.size() * sizeof(PlaceRecord));
+            std::memcpy(image + layout.transition_offset, transition_list.data(),
+                        transition_list.size() * sizeof(TransitionRecord));
+            std::memcpy(image + layout.arc_offset, arc_list.data(), arc_list.size() * sizeof(ArcRecord));
+            std::memcpy(image + layout.parameter_offset, parameter_list.data(),
+                        parameter_list.size() * sizeof(double));
+            std::memcpy(image + layout.name_offset, name_pool.data(), name_pool.size());
+            return buffer;
+        }
+    };
+
+    CompiledModel CompiledModel::Parse(const char *begin, const char *end, const SamplerRegistry &registry)
+    {
+        ImageBuilder builder;
+        NameTable place_table(builder.name_pool);
+        NameTable transition_table(builder.name_pool);
+        NameTable sampler_table(builder.name_pool);
+        vector<std::pair<size_t, size_t>> sampler_list; //(name offset, parameter count) of the named distributions
+        vector<Token> token_list;
+        size_t line = 0;
+        for (const char *line_begin = begin; line_begin < end;)
+        {
+            line++;
+            const char *line_end = static_cast<const char *>(std::memchr(line_begin, '\n', end - line_begin));
+            line_end = line_end != nullptr ? line_end : end;
+            const char *comment = static_cast<const char *>(std::memchr(line_begin, '#', line_end - line_begin));
+            const char *content_end = comment != nullptr ? comment : line_end;
+            token_list.clear();
+            for (const char *position = line_begin; position < content_end;)
+            {
+                if (std::isspace((unsigned char) *position))
+                {
+                    position++;
+                    continue;
+                }
+                const char *token_begin = position;
+                while (position < content_end && !std::isspace((unsigned char) *position))
+                {
+                    position++;
+                }
+                token_list.push_back(Token{token_begin, position});
+            }
+            line_begin = line_end + 1;
+            if (token_list.empty())
+            {
+                continue;
+            }
+
+            const Token &keyword = token_list[0];
+            size_t index;
+            if (keyword.Equals("place"))
+            {
+                PlaceRecord record{0, 0, 0};
+                if (token_list.size() < 2 || token_list.size() > 3 ||
+                    (token_list.size() == 3 && !ParseInt(token_list[2], 0, record.init_mark)) ||
+                    place_table.Find(token_list[1], index))
+                {
+                    throw ModelSyntaxError(line);
+                }
+                record.name_offset = builder.AddName(token_list[1]);
+                record.name_length = (uint32_t) token_list[1].Length();
+                place_table.Insert(record.name_offset, record.name_length, builder.place_list.size());
+                builder.place_list.push_back(record);
+            } else if (keyword.Equals("transition") || keyword.Equals("immediate"))
+            {
+                TransitionRecord record;
+                std::memset(&record, 0, sizeof(record));
+                record.weight = 1.0;
+                if (token_list.size() < 2 || transition_table.Find(token_list[1], index))
+                {
+                    throw ModelSyntaxError(line);
+                }
+                if (keyword.Equals("immediate"))
+                {
+                    record.immediate = 1;
+                    if (token_list.size() > 4 ||
+                        (token_list.size() >= 3 && (!ParseDouble(token_list[2], record.weight) ||
+                                                    !(record.weight > 0.0) || !std::isfinite(record.weight))) ||
+                        (token_list.size() == 4 &&
+                         !ParseInt(token_list[3], std::numeric_limits<int32_t>::min() + 1, record.priority)))
+                    {
+                        throw ModelSyntaxError(line);
+                    }
+                } else
+                {
+                    if (token_list.size() < 3)
+                    {
+                        throw ModelSyntaxError(line);
+                    }
+                    // every distribution is looked up in the registry once
+                    const Token &sampler = token_list[2];
+                    size_t sampler_index;
+                    if (!sampler_table.Find(sampler, sampler_index))
+                    {
+                        size_t parameter_count;
+                        if (!registry.GetParameterCount(string(sampler.begin, sampler.end), parameter_count))
+                        {
+                            throw ModelSyntaxError(line);
+                        }
+                        sampler_index = sampler_list.size();
+                        sampler_list.push_back(std::make_pair(builder.AddName(sampler), parameter_count));
+                        sampler_table.Insert(sampler_list.back().first, sampler.Length(), sampler_index);
+                    }
+                    size_t parameter_count = sampler_list[sampler_index].second;
+                    record.sampler_name_offset = sampler_list[sampler_index].first;
+                    record.sampler_name_length = (uint32_t) sampler.Length();
+                    record.parameter_offset = builder.parameter_list.size();
+                    record.parameter_count = (uint32_t) parameter_count;
+                    if (token_list.size() != 3 + parameter_count && token_list.size() != 4 + parameter_count)
+                    {
+                        throw ModelSyntaxError(line);
+                    }
+                    for (size_t i = 0; i < parameter_count; i++)
+                    {
+                        double parameter;
+                        if (!ParseDouble(token_list[3 + i], parameter))
+                        {
+                            throw ModelSyntaxError(line);
+                        }
+                        builder.parameter_list.push_back(parameter);
+                    }
+                    record.policy = (uint8_t) Transition::ResamplingPolicy::Different;
+                    if (token_list.size() == 4 + parameter_count)
+                    {
+                        const Token &policy = token_list.back();
+                        if (policy.Equals("identical"))
+                        {
+                            record.policy = (uint8_t) Transition::ResamplingPolicy::Identical;
+                        } else if (policy.Equals("resume"))
+                        {
+                            record.policy = (uint8_t) Transition::ResamplingPolicy::Resume;
+                        } else if (!policy.Equals("different"))
+                        {
+                            throw ModelSyntaxError(line);
+                        }
+                    }
+                }
+                record.name_offset = builder.AddName(token_list[1]);
+                record.name_length = (uint32_t) token_list[1].Length();
+                transition_table.Insert(record.name_offset, record.name_length, builder.transition_list.size());
+                builder.transition_list.push_back(record);
+            } else if (keyword.Equals("arc"))
+            {
+                ArcRecord record;
+                std::memset(&record, 0, sizeof(record));
+                record.multiplicity = 1;
+                size_t transition_index, place_index;
+                if (token_list.size() < 4 || token_list.size() > 5 ||
+                    !transition_table.Find(token_list[1], transition_index) ||
+                    !place_table.Find(token_list[2], place_index) ||
+                    (token_list.size() == 5 && !ParseInt(token_list[4], 1, record.multiplicity)))
+                {
+                    throw ModelSyntaxError(line);
+                }
+                const Token &type = token_list[3];
+                if (type.Equals("input"))
+                {
+                    record.type = (uint8_t) Arc::Type::Input;
+                } else if (type.Equals("output"))
+                {
+                    record.type = (uint8_t) Arc::Type::Output;
+                } else if (type.Equals("inhibitor"))
+                {
+                    record.type = (uint8_t) Arc::Type::Inhibitor;
+                } else
+                {
+                    throw ModelSyntaxError(line);
+                }
+                record.transition_index = (uint32_t) transition_index;
+                record.place_index = (uint32_t) place_index;
+                builder.arc_list.push_back(record);
+            } else
+            {
+                throw ModelSyntaxError(line);
+            }
+        }
+        CompiledModel model;
+        model._buffer = builder.Finish();
+        model._size = model._buffer.size() * sizeof(uint64_t);
+        return model;
+    }
+
+    // the whole file, read-only; nullptr for an empty file
+    static std::shared_ptr<void> MapFile(const string &path, size_t &size)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return nullptr;
+        }
+        struct stat file_stat;
+        void *address = MAP_FAILED;
+        if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0)
+        {
+            size = (size_t) file_stat.st_size;
+            address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        } else
+        {
+            size = 0;
+        }
+        close(fd);
+        if (address == MAP_FAILED)
+        {
+            return nullptr;
+        }
+        return std::shared_ptr<void>(address, [size](void *mapped)
+        { munmap(mapped, size); });
+    }
+
+    CompiledModel CompiledModel::ParseFile(const string &path, const SamplerRegistry &registry)
+    {
+        size_t size;
+        std::shared_ptr<void> text = MapFile(path, size);
+        if (!text)
+        {
+            if (access(path.c_str(), R_OK) != 0)
+            {
+                throw ModelIOError();
+            }
+            return Parse(nullptr, nullptr, registry); //empty
+        }
+        const char *begin = static_cast<const char *>(text.get());
+        return Parse(begin, begin + size, registry);
+    }
+
+    void CompiledModel::WriteCache(const string &path, uint64_t source_size, int64_t source_time) const
+    {
+        ImageHeader header;
+        std::memcpy(&header, Image(), sizeof(header));
+        header.source_size = source_size;
+        header.source_time = source_time;
+        Serialization::WriteFileAtomically(path, [this, &header](Serialization::Writer &writer)
+        {
+            writer.WriteBytes(&header, sizeof(header));
+            writer.WriteBytes(Image() + sizeof(header), _size - sizeof(header));
+        });
+    }
+
+    static bool InPool(uint64_t offset, uint64_t length, uint64_t pool_size)
+    { return offset <= pool_size && length <= pool_size - offset; }
+
+    // whether the image is consistent, so that Build can trust its offsets and indices
+    static bool IsValidImage(const char *image, size_t size)
+    {
+        if (size < sizeof(ImageHeader))
+        {
+            return false;
+        }
+        const ImageHeader &header = *reinterpret_cast<const ImageHeader *>(image);
+        if (std::memcmp(header.magic, ImageMagic, sizeof(ImageMagic)) != 0 || header.byte_order != ByteOrderMark ||
+            header.image_size != size || header.place_count > size || header.transition_count > size ||
+            header.arc_count > size || header.parameter_count > size || header.name_pool_size > size)
+        {
+            return false;
+        }
+        ImageLayout layout(header);
+        if (layout.size != size)
+        {
+            return false;
+        }
+        auto place_list = reinterpret_cast<const PlaceRecord *>(image + layout.place_offset);
+        for (uint64_t i = 0; i < header.place_count; i++)
+        {
+            if (!InPool(place_list[i].name_offset, place_list[i].name_length, header.name_pool_size))
+            {
+                return false;
+            }
+        }
+        auto transition_list = reinterpret_cast<const TransitionRecord *>(image + layout.transition_offset);
+        for (uint64_t i = 0; i < header.transition_count; i++)
+        {
+            const TransitionRecord &record = transition_list[i];
+            if (!InPool(record.name_offset, record.name_length, header.name_pool_size) ||
+                (!record.immediate &&
+                 (!InPool(record.sampler_name_offset, record.sampler_name_length, header.name_pool_size) ||
+                  !InPool(record.parameter_offset, record.parameter_count, header.parameter_count) ||
+                  record.policy > Transition::ResamplingPolicy::Resume)))
+            {
+                return false;
+            }
+        }
+        auto arc_list = reinterpret_cast<const ArcRecord *>(image + layout.arc_offset);
+        for (uint64_t i = 0; i < header.arc_count; i++)
+        {
+            if (arc_list[i].transition_index >= header.transition_count ||
+                arc_list[i].place_index >= header.place_count || arc_list[i].type > Arc::Type::Inhibitor)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool CompiledModel::LoadCache(const string &path, CompiledModel &model, uint64_t source_size,
+                                  int64_t source_time)
+    {
+        size_t size;
+        std::shared_ptr<void> mapping = MapFile(path, size);
+        if (!mapping || !IsValidImage(static_cast<const char *>(mapping.get()), size))
+        {
+            return false;
+        }
+        const ImageHeader &header = *static_cast<const ImageHeader *>(mapping.get());
+        if (header.source_size != source_size || header.source_time != source_time)
+        {
+            return false;
+        }
+        model._buffer.clear();
+        model._mapping = mapping;
+        model._size = size;
+        return true;
+    }
+
+    void CompiledModel::Build(PetriNetCreator &creator, const SamplerRegistry &registry) const
+    {
+        const char *image = Image();
+        const ImageHeader &header = *reinterpret_cast<const ImageHeader *>(image);
+        ImageLayout layout(header);
+        auto place_list = reinterpret_cast<const PlaceRecord *>(image + layout.place_offset);
+        auto transition_list = reinterpret_cast<const TransitionRecord *>(image + layout.transition_offset);
+        auto arc_list = reinterpret_cast<const ArcRecord *>(image + layout.arc_offset);
+        auto parameter_pool = reinterpret_cast<const double *>(image + layout.parameter_offset);
+        const char *name_pool = image + layout.name_offset;
+
+        creator.Reserve(header.place_count, header.transition_count, header.arc_count);
+        vector<CreatePlaceCmd> place_cmd_list;
+        place_cmd_list.reserve(header.place_count);
+        for (uint64_t i = 0; i < header.place_count; i++)
+        {
+            const PlaceRecord &record = place_list[i];
+            place_cmd_list.push_back(CreatePlaceCmd{string(name_pool + record.name_offset, record.name_length),
+                                                    record.init_mark});
+        }
+        size_t first_place = creator.AddPlaces(std::move(place_cmd_list));
+        vector<CreateTransitionCmd> transition_cmd_list;
+        transition_cmd_list.reserve(header.transition_count);
+        vector<double> parameter_list;
+        for (uint64_t i = 0; i < header.transition_count; i++)
+        {
+            const TransitionRecord &record = transition_list[i];
+            string name(name_pool + record.name_offset, record.name_length);
+            if (record.immediate)
+            {
+                CreateTransitionCmd cmd{std::move(name), nullptr, Transition::ResamplingPolicy::Different};
+                cmd.immediate = true;
+                cmd.weight = record.weight;
+                cmd.priority = record.priority;
+                transition_cmd_list.push_back(std::move(cmd));
+                continue;
+            }
+            parameter_list.assign(parameter_pool + record.parameter_offset,
+                                  parameter_pool + record.parameter_offset + record.parameter_count);
+            transition_cmd_list.push_back(CreateTransitionCmd{
+                    std::move(name),
+                    registry.CreateSampler(string(name_pool + record.sampler_name_offset, record.sampler_name_length),
+                                           parameter_list),
+                    (Transition::ResamplingPolicy) record.policy});
+        }
+        size_t first_transition = creator.AddTransitions(std::move(transition_cmd_list));
+        vector<CreateArcCmd> arc_cmd_list;
+        arc_cmd_list.reserve(header.arc_count);
+        for (uint64_t i = 0; i < header.arc_count; i++)
+        {
+            const ArcRecord &record = arc_list[i];
+            arc_cmd_list.push_back(CreateArcCmd{first_transition + (size_t) record.transition_index,
+                                                first_place + (size_t) record.place_index, (Arc::Type) record.type,
+                                                record.multiplicity, false});
+        }
+        creator.AddArcs(std::move(arc_cmd_list));
+    }
+
+    size_t CompiledModel::GetPlaceCount() const
+    { return _size > 0 ? reinterpret_cast<const ImageHeader *>(Image())->place_count : 0; }
+
+    size_t CompiledModel::GetTransitionCount() const
+    { return _size > 0 ? reinterpret_cast<const ImageHeader *>(Image())->transition_count : 0; }
+
+    size_t CompiledModel::GetArcCount() const
+    { return _size > 0 ? reinterpret_cast<const ImageHeader *>(Image())->arc_count : 0; }
+
+    void LoadModel(const string &model_path, const string &cache_path, PetriNetCreator &creator,
+                   const SamplerRegistry &registry)
+    {
+        struct stat model_stat;
+        if (stat(model_path.c_str(), &model_stat) != 0)
+        {
+            throw ModelIOError();
+        }
+        uint64_t source_size = (uint64_t) model_stat.st_size;
+        int64_t source_time = (int64_t) model_stat.st_mtim.tv_sec * 1000000000 + model_stat.st_mtim.tv_nsec;
+        CompiledModel model;
+        if (!CompiledModel::LoadCache(cache_path, model, source_size, source_time))
+        {
+            model = CompiledModel::ParseFile(model_path, registry);
+            try
+            {
+                model.WriteCache(cache_path, source_size, source_time);
+            } catch (const Serialization::SerializationError &)
+            {
+                // the cache only saves time, e.g. in a read-only directory it is skipped
+            }
+        }
+        model.Build(creator, registry);
+    }
+}
@@ -0,0 +1,84 @@
+//
+
+#include "PetriNetModel.h"
+
+namespace PetriNetModel
+{
+    const size_t FiringQueue::NotInQueue;
+
+    void FiringQueue::Update(size_t index, double time)
+    {
+        size_t pos = _position[index];
+        _time[index] = time;
+        if (time < 0)
+        {
+            if (pos == NotInQueue)
+            {
+                return;
+            }
+            size_t last_pos = _heap.size() - 1;
+            Swap(pos, last_pos);
+            _heap.pop_back();
+            _position[index] = NotInQueue;
+            if (pos < _heap.size())
+            {
+                SiftUp(pos);
+                SiftDown(pos);
+            }
+            return;
+        }
+        if (pos == NotInQueue)
+        {
+            pos = _heap.size();
+            _heap.push_back(index);
+            _position[index] = pos;
+        }
+        SiftUp(pos);
+        SiftDown(_position[index]);
+    }
+
+    void FiringQueue::Swap(size_t lhs_pos, size_t rhs_pos)
+    {
+        std::swap(_heap[lhs_pos], _heap[rhs_pos]);
+        _position[_heap[lhs_pos]] = lhs_pos;
+        _position[_heap[rhs_pos]] = rhs_pos;
+    }
+
+    void FiringQueue::SiftUp(size_t pos)
+    {
+        while (pos > 0)
+        {
+            size_t parent = (pos - 1) / 2;
+            if (_time[_heap[parent]] <= _time[_heap[pos]])
+            {
+                return;
+            }
+            Swap(pos, parent);
+            pos = parent;
+        }
+    }
+
+    void FiringQueue::SiftDown(size_t pos)
+    {
+        while (true)
+        {
+            size_t smallest = pos;
+            size_t left = 2 * pos + 1;
+            size_t right = left + 1;
+            if (left < _heap.size() && _time[_heap[left]] < _time[_heap[smallest]])
+            {
+                smallest = left;
+            }
+            if (right < _heap.size() && _time[_heap[right]] < _time[_heap[smallest]])
+            {
+                smallest = right;
+            }
+            if (smallest == pos)
+            {
+                return;
+            }
+            Swap(pos, smallest);
+            pos = smallest;
+        }
+    }
+}
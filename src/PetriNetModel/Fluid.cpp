@@ -0,0 +1,91 @@
+//
+
+#include <algorithm>
+#include <cmath>
+#include "PetriNetModel.h"
+
+namespace PetriNetModel
+{
+    bool FluidArc::IsSatisfied() const
+    {
+        double level = _place->_level;
+        switch (_type)
+        {
+            case Type::Threshold:
+                return level > _value || (level == _value && _place->_direction >= 0);
+            case Type::Inhibitor:
+                return level < _value || (level == _value && _place->_direction < 0);
+            case Type::Inflow:
+            case Type::Outflow:
+            default:
+                return true;
+        }
+    }
+
+    void PetriNet::AdvanceFluid(double duration)
+    {
+        for (auto &place:_fluid_place_list)
+        {
+            if (place._rate != 0.0)
+            {
+                place._level = std::min(std::max(place._level + place._rate * duration, 0.0), place._capacity);
+            }
+        }
+    }
+
+    void PetriNet::UpdateFluidRates()
+    {
+        for (auto &place:_fluid_place_list)
+        {
+            double rate = 0.0;
+            for (FluidArc *arc_ptr:place._flow_arcs)
+            {
+                if (arc_ptr->_transition->IsEnabled())
+                {
+                    rate += arc_ptr->_type == FluidArc::Type::Inflow ? arc_ptr->_value : -arc_ptr->_value;
+                }
+            }
+            if ((place._level <= 0.0 && rate < 0.0) || (place._level >= place._capacity && rate > 0.0))
+            {
+                rate = 0.0;
+            }
+            place._rate = rate;
+            place._direction = rate > 0.0 ? 1 : (rate < 0.0 ? -1 : 0);
+        }
+    }
+
+    void PetriNet::FindNextFluidEvent()
+    {
+        _fluid_event_place = nullptr;
+        for (auto &place:_fluid_place_list)
+        {
+            if (place._rate == 0.0)
+            {
+                continue;
+            }
+            // the next level of interest in the direction of the flow
+            double target_level = place._rate > 0.0 ? place._capacity : 0.0;
+            for (FluidArc *arc_ptr:place._guard_arcs)
+            {
+                double threshold = arc_ptr->_value;
+                bool leaving = threshold == place._level &&
+                               (place._rate > 0.0 ? arc_ptr->_type == FluidArc::Type::Inhibitor
+                                                  : arc_ptr->_type == FluidArc::Type::Threshold);
+                bool ahead = place._rate > 0.0 ? (threshold > place._level && threshold < target_level)
+                                               : (threshold < place._level && threshold > target_level);
+                if (leaving || ahead)
+                {
+                    target_level = threshold;
+                }
+            }
+            double event_time = _time + (target_level - place._level) / place._rate;
+            if (event_time < _next_firing_time)
+            {
+                _next_firing_time = event_time;
+                _firing_transition = nullptr;
+                _fluid_event_place = &place;
+                _fluid_event_level = target_level;
+            }
+        }
+    }
+}
@@ -0,0 +1,94 @@
+//
+
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include "PetriNetModel.h"
+
+namespace PetriNetModel
+{
+    // Direct-method step under the biased rates. The likelihood ratio of a trajectory is the product over its
+    // events of (rate / biased rate of the fired transition) * exp(-(total rate - total biased rate) * duration).
+    void PetriNet::PlanBiasedStep(UniformRandomNumberGenerator &generator)
+    {
+        _pending_firing.clear();
+        double total_propensity = 0.0;
+        double biased_total_propensity = 0.0;
+        for (size_t t_index = 0; t_index < _transition_list.size(); t_index++)
+        {
+            _propensity[t_index] = _transition_list[t_index].GetExpRate(*this);
+            _biased_propensity[t_index] = _propensity[t_index] * _bias[t_index];
+            total_propensity += _propensity[t_index];
+            biased_total_propensity += _biased_propensity[t_index];
+        }
+        if (_failure_biasing_probability > 0.0 && biased_total_propensity > 0.0)
+        {
+            size_t failure_count = 0;
+            double repair_propensity = 0.0;
+            for (size_t t_index = 0; t_index < _transition_list.size(); t_index++)
+            {
+                if (_biased_propensity[t_index] <= 0.0)
+                {
+                    continue;
+                }
+                if (_failure_transition[t_index])
+                {
+                    failure_count++;
+                } else
+                {
+                    repair_propensity += _biased_propensity[t_index];
+                }
+            }
+            // Without enabled failures the rates stay as they are; without enabled repairs every jump is a failure,
+            // the failures being equally likely.
+            if (failure_count > 0)
+            {
+                double failure_probability = repair_propensity > 0.0 ? _failure_biasing_probability : 1.0;
+                double sum = 0.0;
+                for (size_t t_index = 0; t_index < _transition_list.size(); t_index++)
+                {
+                    double &propensity = _biased_propensity[t_index];
+                    if (propensity <= 0.0)
+                    {
+                        continue;
+                    }
+                    if (_failure_transition[t_index])
+                    {
+                        propensity = failure_probability * biased_total_propensity / failure_count;
+                    } else
+                    {
+                        propensity =
+                                (1.0 - failure_probability) * biased_total_propensity * propensity / repair_propensity;
+                    }
+                    sum += propensity;
+                }
+                assert(std::abs(sum - biased_total_propensity) <= 1e-9 * biased_total_propensity);
+                (void) sum;
+            }
+        }
+        _rate_difference = total_propensity - biased_total_propensity;
+        if (biased_total_propensity <= 0.0)
+        {
+            _next_firing_time = std::numeric_limits<double>::infinity();
+            return;
+        }
+        _next_firing_time = _time - std::log(1.0 - generator.GetVariate()) / biased_total_propensity;
+
+        double propensity = generator.GetVariate() * biased_total_propensity;
+        size_t selected = 0;
+        for (size_t t_index = 0; t_index < _transition_list.size(); t_index++)
+        {
+            if (_biased_propensity[t_index] > 0.0)
+            {
+                selected = t_index;
+                propensity -= _biased_propensity[t_index];
+                if (propensity < 0.0)
+                {
+                    break;
+                }
+            }
+        }
+        _firing_likelihood_factor = _propensity[selected] / _biased_propensity[selected];
+        _pending_firing.push_back(std::make_pair(selected, 1));
+    }
+}
@@ -0,0 +1,112 @@
+//
+
+#include <cstring>
+#include "PetriNetModel.h"
+
+namespace PetriNetModel
+{
+    const size_t NameIndex::NotFound;
+
+    bool NameIndex::IsName(size_t index, const string &name) const
+    {
+        size_t begin = index == 0 ? 0 : _name_end[index - 1];
+        return _name_end[index] - begin == name.size() &&
+               std::memcmp(_char_list.data() + begin, name.data(), name.size()) == 0;
+    }
+
+    size_t NameIndex::Find(const string &name) const
+    {
+        if (_slot_list.empty())
+        {
+            return NotFound;
+        }
+        size_t hash = std::hash<string>()(name);
+        size_t mask = _slot_list.size() - 1;
+        for (size_t pos = hash & mask;; pos = (pos + 1) & mask)
+        {
+            const Slot &slot = _slot_list[pos];
+            if (slot.index == NotFound)
+            {
+                return NotFound;
+            }
+            if (slot.hash == hash && IsName(slot.index, name))
+            {
+                return slot.index;
+            }
+        }
+    }
+
+    bool NameIndex::Insert(const string &name)
+    {
+        if (2 * (Size() + 1) > _slot_list.size())
+        {
+            Rehash(std::max<size_t>(16, 2 * _slot_list.size()));
+        }
+        size_t hash = std::hash<string>()(name);
+        size_t mask = _slot_list.size() - 1;
+        size_t pos = hash & mask;
+        for (; _slot_list[pos].index != NotFound; pos = (pos + 1) & mask)
+        {
+            if (_slot_list[pos].hash == hash && IsName(_slot_list[pos].index, name))
+            {
+                return false;
+            }
+        }
+        _slot_list[pos] = Slot{hash, Size()};
+        _char_list.insert(_char_list.end(), name.begin(), name.end());
+        _name_end.push_back(_char_list.size());
+        return true;
+    }
+
+    void NameIndex::Reserve(size_t name_count)
+    {
+        _name_end.reserve(name_count);
+        size_t slot_count = 16;
+        while (slot_count < 2 * name_count)
+        {
+            slot_count *= 2;
+        }
+        if (slot_count > _slot_list.size())
+        {
+            Rehash(slot_count);
+        }
+    }
+
+    void NameIndex::Truncate(size_t size)
+    {
+        if (size >= Size())
+        {
+            return;
+        }
+        _char_list.resize(size == 0 ? 0 : _name_end[size - 1]);
+        _name_end.resize(size);
+        for (Slot &slot:_slot_list)
+        {
+            if (slot.index != NotFound && slot.index >= size)
+            {
+                slot.index = NotFound;
+            }
+        }
+        Rehash(_slot_list.size()); //linear probing cannot just empty slots in the middle of a probe sequence
+    }
+
+    void NameIndex::Rehash(size_t slot_count)
+    {
+        vector<Slot> old_slot_list(slot_count, Slot{0, NotFound});
+        old_slot_list.swap(_slot_list);
+        size_t mask = slot_count - 1;
+        for (const Slot &slot:old_slot_list)
+        {
+            if (slot.index == NotFound)
+            {
+                continue;
+            }
+            size_t pos = slot.hash & mask;
+            while (_slot_list[pos].index != NotFound)
+            {
+                pos = (pos + 1) & mask;
+            }
+            _slot_list[pos] = slot;
+        }
+    }
+}
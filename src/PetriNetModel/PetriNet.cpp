@@ -3,44 +3,297 @@
 //
 #include <limits>
 #include <random>
+#include <algorithm>
 #include "PetriNetModel.h"
 
 namespace PetriNetModel
 {
+    // more immediate firings or fluid events than this without time advancing are taken as a timeless trap
+    static const size_t MaxImmediateFiringCount = 1 << 20;
+
     void PetriNet::NextState(UniformRandomNumberGenerator &generator)
     {
-        if (_firing_transition == nullptr)
+        AdvanceState(generator);
+        UpdateStopped();
+    }
+
+    void PetriNet::Reset(UniformRandomNumberGenerator &generator)
+    {
+        _stopping_place_changed = (bool) _stopping_predicate;
+        ResetState(generator);
+        UpdateStopped();
+    }
+
+    void PetriNet::AdvanceState(UniformRandomNumberGenerator &generator)
+    {
+        if (_tau_leaping_epsilon > 0.0 || _importance_sampling)
         {
+            if (_pending_firing.empty())
+            {
+                return;
+            }
+            if (_importance_sampling)
+            {
+                UpdateScore(GetDuration(), _pending_firing.front().first);
+            }
+            for (const auto &firing:_pending_firing)
+            {
+                _stopping_place_changed = _stopping_place_changed || _stopping_trigger[firing.first];
+                if (_firing_log != nullptr)
+                {
+                    _firing_log->push_back(firing);
+                }
+                for (const auto &change:_state_change[firing.first])
+                {
+                    _place_list[change.first].ModifyMark((Mark) (change.second * firing.second));
+                }
+            }
+            if (_importance_sampling)
+            {
+                _likelihood_ratio = GetLikelihoodRatio(_next_firing_time) * _firing_likelihood_factor;
+                _time = _next_firing_time;
+                PlanBiasedStep(generator);
+            } else
+            {
+                _time = _next_firing_time;
+                PlanLeap(generator);
+            }
             return;
         }
-        _firing_transition->Fire();
-        _time = _next_firing_time;
-        for (Transition *trans_ptr:_firing_transition->GetAffectedTransition())
+        if (_firing_transition == nullptr && _fluid_event_place == nullptr)
         {
-            trans_ptr->InputArcChanged(_time, generator.GetVariate());
+            return;
         }
+        AdvanceFluid(GetDuration());
+        UpdateScore(GetDuration(), _fluid_event_place != nullptr ? _transition_list.size() :
+                                   (size_t) (_firing_transition - _transition_list.data()));
+        if (_fluid_event_place != nullptr)
+        {
+            if (GetDuration() > 0.0)
+            {
+                _zero_time_fluid_event_count = 0;
+            } else if (++_zero_time_fluid_event_count > MaxImmediateFiringCount)
+            {
+                throw TimelessTrap();
+            }
+            _fluid_event_place->_level = _fluid_event_level;
+            _time = _next_firing_time;
+            UpdateTransitions(_fluid_event_place->_affected_transition, _fluid_event_place->_affected_conflict_set,
+                              generator);
+        } else
+        {
+            _time = _next_firing_time;
+            _firing_transition->Fire();
+            size_t t_index = _firing_transition - _transition_list.data();
+            _stopping_place_changed = _stopping_place_changed || _stopping_trigger[t_index];
+            if (_firing_log != nullptr)
+            {
+                _firing_log->push_back(std::make_pair(t_index, 1L));
+            }
+            UpdateTransitions(_firing_transition, generator);
+        }
+        UpdateFluidRates();
         FindNextFiringTransition();
     }
 
-    void PetriNet::Reset(UniformRandomNumberGenerator &generator)
+    void PetriNet::ResetState(UniformRandomNumberGenerator &generator)
     {
         _time = 0.0;
         _next_firing_time = 0.0;
         _firing_transition = nullptr;
+        _fluid_event_place = nullptr;
+        _zero_time_fluid_event_count = 0;
+        _likelihood_ratio = 1.0;
+        _rate_difference = 0.0;
+        _score.assign(_parameter_transition_list.size(), 0.0);
+        for (size_t t_index = 0; t_index < _substream_list.size(); t_index++)
+        {
+            uint64_t replication_seed = MixSeed(_substream_seed, _replication_index);
+            _substream_list[t_index].Seed(MixSeed(replication_seed, _name_hash_list[t_index]), _antithetic_replication);
+        }
+        _replication_index++;
+        _antithetic_replication = false;
         for (auto &place:_place_list)
         {
             place.Reset();
         }
+        for (auto &place:_fluid_place_list)
+        {
+            place.Reset();
+        }
+        if (_importance_sampling)
+        {
+            PlanBiasedStep(generator);
+            return;
+        }
+        if (_tau_leaping_epsilon > 0.0)
+        {
+            PlanLeap(generator);
+            return;
+        }
+        for (size_t set_index = 0; set_index < _conflict_set_list.size(); set_index++)
+        {
+            _unresolved_conflict_set.insert(set_index);
+        }
+        FireImmediateTransitions(generator);
+        _changed_transition.clear();
+        _firing_queue.Clear();
+        _transition_rate.assign(_transition_list.size(), 0.0);
+        _total_rate = 0.0;
         for (auto &trans:_transition_list)
         {
+            if (trans.IsImmediate())
+            {
+                continue;
+            }
             trans.Reset();
-            trans.InputArcChanged(_time, generator.GetVariate());
+            UpdateTransition(&trans, generator);
         }
+        UpdateFluidRates();
         FindNextFiringTransition();
     }
 
+    void PetriNet::UpdateTransitions(Transition *fired_transition, UniformRandomNumberGenerator &generator)
+    {
+        UpdateTransitions(fired_transition->GetAffectedTransition(), fired_transition->GetAffectedConflictSet(),
+                          generator);
+    }
+
+    void PetriNet::UpdateTransitions(Span<Transition *> affected_trans, Span<size_t> affected_set,
+                                     UniformRandomNumberGenerator &generator)
+    {
+        if (affected_set.empty())
+        {
+            for (Transition *trans_ptr:affected_trans)
+            {
+                UpdateTransition(trans_ptr, generator);
+            }
+            return;
+        }
+        // timed transitions only see the tangible marking reached after all immediate firings
+        _changed_transition.insert(_changed_transition.end(), affected_trans.begin(), affected_trans.end());
+        _unresolved_conflict_set.insert(affected_set.begin(), affected_set.end());
+        FireImmediateTransitions(generator);
+        std::sort(_changed_transition.begin(), _changed_transition.end());
+        _changed_transition.erase(std::unique(_changed_transition.begin(), _changed_transition.end()),
+                                  _changed_transition.end());
+        for (Transition *trans_ptr:_changed_transition)
+        {
+            UpdateTransition(trans_ptr, generator);
+        }
+        _changed_transition.clear();
+    }
+
+    void PetriNet::UpdateTransition(Transition *trans_ptr, UniformRandomNumberGenerator &generator)
+    {
+        UniformRandomNumberGenerator &trans_generator =
+                _substream_list.empty() ? generator : _substream_list[trans_ptr - _transition_list.data()];
+        if (_markovian)
+        {
+            trans_ptr->ExponentialInputArcChanged(*this, _time, trans_generator);
+            size_t t_index = trans_ptr - _transition_list.data();
+            _firing_queue.Update(t_index, trans_ptr->GetFireTime());
+            double rate = trans_ptr->GetCurrentExpRate();
+            _total_rate += rate - _transition_rate[t_index];
+            _transition_rate[t_index] = rate;
+        } else
+        {
+            trans_ptr->InputArcChanged(*this, _time, trans_generator);
+        }
+    }
+
+    void PetriNet::FireImmediateTransitions(UniformRandomNumberGenerator &generator)
+    {
+        size_t firing_count = 0;
+        while (!_unresolved_conflict_set.empty())
+        {
+            auto set_it = _unresolved_conflict_set.begin();
+            Transition *trans_ptr = SelectImmediateTransition(_conflict_set_list[*set_it], generator);
+            if (trans_ptr == nullptr)
+            {
+                _unresolved_conflict_set.erase(set_it);
+                continue;
+            }
+            if (++firing_count > MaxImmediateFiringCount)
+            {
+                throw TimelessTrap();
+            }
+            trans_ptr->Fire();
+            size_t t_index = trans_ptr - _transition_list.data();
+            _stopping_place_changed = _stopping_place_changed || _stopping_trigger[t_index];
+            if (_firing_log != nullptr)
+            {
+                _firing_log->push_back(std::make_pair(t_index, 1L));
+            }
+            Span<Transition *> affected_trans = trans_ptr->GetAffectedTransition();
+            _changed_transition.insert(_changed_transition.end(), affected_trans.begin(), affected_trans.end());
+            Span<size_t> affected_set = trans_ptr->GetAffectedConflictSet();
+            _unresolved_conflict_set.insert(affected_set.begin(), affected_set.end());
+        }
+    }
+
+    Transition *PetriNet::SelectImmediateTransition(const ConflictSet &conflict_set,
+                                                    UniformRandomNumberGenerator &generator) const
+    {
+        const auto &trans_list = conflict_set.transition_list;
+        if (trans_list.size() == 1)
+        {
+            return trans_list[0]->IsEnabled() ? trans_list[0] : nullptr;
+        }
+        // the alias table is built for the whole set, so reject picks that are not enabled;
+        // this is O(1) as long as most of the set is enabled
+        for (int attempt = 0; attempt < 2; attempt++)
+        {
+            Transition *trans_ptr = trans_list[conflict_set.alias_table.Sample(generator.GetVariate())];
+            if (trans_ptr->IsEnabled())
+            {
+                return trans_ptr;
+            }
+        }
+        double total_weight = 0.0;
+        for (Transition *trans_ptr:trans_list)
+        {
+            if (trans_ptr->IsEnabled())
+            {
+                total_weight += trans_ptr->GetWeight();
+            }
+        }
+        if (total_weight <= 0.0)
+        {
+            return nullptr;
+        }
+        double weight = generator.GetVariate() * total_weight;
+        Transition *selected = nullptr;
+        for (Transition *trans_ptr:trans_list)
+        {
+            if (trans_ptr->IsEnabled())
+            {
+                selected = trans_ptr;
+                weight -= trans_ptr->GetWeight();
+                if (weight < 0.0)
+                {
+                    break;
+                }
+            }
+        }
+        return selected;
+    }
+
     void PetriNet::FindNextFiringTransition()
     {
+        if (_markovian)
+        {
+            if (_firing_queue.Empty())
+            {
+                _next_firing_time = std::numeric_limits<double>::infinity();
+                _firing_transition = nullptr;
+            } else
+            {
+                _next_firing_time = _firing_queue.TopTime();
+                _firing_transition = &_transition_list[_firing_queue.Top()];
+            }
+            return;
+        }
         Transition *firing_transition = nullptr;
         double firing_time = std::numeric_limits<double>::infinity();
         for (auto &transition:_transition_list)
@@ -58,6 +311,196 @@ namespace PetriNetModel
         }
         _next_firing_time = firing_time;
         _firing_transition = firing_transition;
+        FindNextFluidEvent();
+    }
+
+    void PetriNet::RenewMemorylessClocks(UniformRandomNumberGenerator &generator)
+    {
+        if (_importance_sampling)
+        {
+            PlanBiasedStep(generator);
+            return;
+        }
+        if (_tau_leaping_epsilon > 0.0)
+        {
+            PlanLeap(generator);
+            return;
+        }
+        for (size_t t_index = 0; t_index < _transition_list.size(); t_index++)
+        {
+            Transition &trans = _transition_list[t_index];
+            if (trans.IsImmediate())
+            {
+                continue;
+            }
+            trans.RenewExponentialClock(_time, generator);
+            if (_markovian)
+            {
+                _firing_queue.Update(t_index, trans.GetFireTime());
+            }
+        }
+        FindNextFiringTransition();
+    }
+
+    void PetriNet::SetCommonRandomNumbers(uint64_t seed, uint64_t first_replication)
+    {
+        _substream_seed = seed;
+        _replication_index = first_replication;
+        _substream_list.resize(_transition_list.size());
+        _name_hash_list.clear();
+        for (const auto &trans:_transition_list)
+        {
+            _name_hash_list.push_back(std::hash<string>()(*trans._name));
+        }
+    }
+
+    void PetriNet::ReplayMarking(const vector<Mark> &mark_list)
+    {
+        for (size_t p_index = 0; p_index < _place_list.size(); p_index++)
+        {
+            _place_list[p_index]._mark = mark_list[p_index];
+        }
+        _stopping_place_changed = (bool) _stopping_predicate;
+    }
+
+    void PetriNet::ReplayFiring(size_t t_index, long count)
+    {
+        const Transition &trans = _transition_list[t_index];
+        for (const Arc &arc:trans._input_arcs)
+        {
+            arc.GetPlace()->ModifyMark((Mark) (-arc.GetMultiplicity() * count));
+        }
+        for (const Arc &arc:trans._output_arcs)
+        {
+            arc.GetPlace()->ModifyMark((Mark) (arc.GetMultiplicity() * count));
+        }
+        _stopping_place_changed = _stopping_place_changed || _stopping_trigger[t_index];
     }
 
+    void PetriNet::ReplayTime(double time, double next_time)
+    {
+        _time = time;
+        _next_firing_time = next_time;
+        UpdateStopped();
+    }
+
+    void PetriNet::SetFiringTimeFunc(size_t t_index, Transition::FiringTimeFuncType firing_time_func)
+    {
+        Transition &trans = _transition_list[t_index];
+        // the engine was chosen by which transitions are exponential
+        if (trans.IsImmediate() ||
+            (firing_time_func.target<ExpSampler>() == nullptr) != (trans.GetExpSampler() == nullptr))
+        {
+            throw InvalidFiringTimeFunc();
+        }
+        trans.SetSampleFunc(firing_time_func);
+    }
+
+    void PetriNet::RepeatReplication()
+    {
+        _replication_index--;
+        _antithetic_replication = true;
+    }
+
+    vector<size_t> PetriNet::GetAffectedTransitionIndex(size_t t_index) const
+    {
+        vector<size_t> index_list;
+        for (const Transition *trans_ptr:_transition_list[t_index]._affected_transition)
+        {
+            index_list.push_back(trans_ptr - _transition_list.data());
+        }
+        return index_list;
+    }
+
+    vector<size_t> PetriNet::GetConflictSetTransitionIndex(size_t set_index) const
+    {
+        vector<size_t> index_list;
+        for (const Transition *trans_ptr:_conflict_set_list[set_index].transition_list)
+        {
+            index_list.push_back(trans_ptr - _transition_list.data());
+        }
+        return index_list;
+    }
+
+    void PetriNet::SaveState(PetriNetState &state) const
+    {
+        state._mark_list.resize(_place_list.size());
+        for (size_t p_index = 0; p_index < _place_list.size(); p_index++)
+        {
+            state._mark_list[p_index] = _place_list[p_index]._mark;
+        }
+        state._fluid_list.resize(_fluid_place_list.size());
+        for (size_t f_index = 0; f_index < _fluid_place_list.size(); f_index++)
+        {
+            const FluidPlace &place = _fluid_place_list[f_index];
+            state._fluid_list[f_index] = PetriNetState::FluidState{place._level, place._rate, place._direction};
+        }
+        state._clock_list.resize(_transition_list.size());
+        for (size_t t_index = 0; t_index < _transition_list.size(); t_index++)
+        {
+            state._clock_list[t_index] = _transition_list[t_index].GetClock();
+        }
+        if (_markovian)
+        {
+            state._firing_queue = _firing_queue;
+        }
+        state._pending_firing = _pending_firing;
+        state._time = _time;
+        state._next_firing_time = _next_firing_time;
+        state._firing_transition_index =
+                _firing_transition == nullptr ? _transition_list.size() : _firing_transition - _transition_list.data();
+        state._fluid_event_place_index = _fluid_event_place == nullptr ? _fluid_place_list.size() :
+                                         _fluid_event_place - _fluid_place_list.data();
+        state._fluid_event_level = _fluid_event_level;
+        state._zero_time_fluid_event_count = _zero_time_fluid_event_count;
+        state._likelihood_ratio = _likelihood_ratio;
+        state._rate_difference = _rate_difference;
+        state._firing_likelihood_factor = _firing_likelihood_factor;
+        state._score = _score;
+        state._stopped = _stopped;
+    }
+
+    void PetriNet::RestoreState(const PetriNetState &state)
+    {
+        for (size_t p_index = 0; p_index < _place_list.size(); p_index++)
+        {
+            _place_list[p_index]._mark = state._mark_list[p_index];
+        }
+        for (size_t f_index = 0; f_index < _fluid_place_list.size(); f_index++)
+        {
+            FluidPlace &place = _fluid_place_list[f_index];
+            place._level = state._fluid_list[f_index].level;
+            place._rate = state._fluid_list[f_index].rate;
+            place._direction = state._fluid_list[f_index].direction;
+        }
+        for (size_t t_index = 0; t_index < _transition_list.size(); t_index++)
+        {
+            _transition_list[t_index].SetClock(state._clock_list[t_index]);
+        }
+        if (_markovian)
+        {
+            _firing_queue = state._firing_queue;
+            _total_rate = 0.0;
+            for (size_t t_index = 0; t_index < _transition_list.size(); t_index++)
+            {
+                const Transition &transition = _transition_list[t_index];
+                _transition_rate[t_index] = transition.IsImmediate() ? 0.0 : transition.GetCurrentExpRate();
+                _total_rate += _transition_rate[t_index];
+            }
+        }
+        _pending_firing = state._pending_firing;
+        _time = state._time;
+        _next_firing_time = state._next_firing_time;
+        _firing_transition = state._firing_transition_index < _transition_list.size() ?
+                             &_transition_list[state._firing_transition_index] : nullptr;
+        _fluid_event_place = state._fluid_event_place_index < _fluid_place_list.size() ?
+                             &_fluid_place_list[state._fluid_event_place_index] : nullptr;
+        _fluid_event_level = state._fluid_event_level;
+        _zero_time_fluid_event_count = state._zero_time_fluid_event_count;
+        _likelihood_ratio = state._likelihood_ratio;
+        _rate_difference = state._rate_difference;
+        _firing_likelihood_factor = state._firing_likelihood_factor;
+        _score = state._score;
+        _stopped = state._stopped;
+    }
 }
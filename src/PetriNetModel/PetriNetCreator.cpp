@@ -2,6 +2,10 @@
 // Created by wangnan on 16-4-22.
 //
 
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <numeric>
 #include "PetriNetModel.h"
 
 namespace PetriNetModel
@@ -12,16 +16,35 @@ namespace PetriNetModel
         {
             throw ModificationAfterCommit();
         }
-        if (HasName(name, _place_name_map))
+        size_t p_index = _place_cmd.size();
+        if (!_place_name_index.Insert(name))
         {
             throw DuplicateName();
         }
-        size_t p_index = _place_cmd.size();
-        _place_name_map[name] = p_index;
         _place_cmd.push_back(CreatePlaceCmd{name, mark});
         return p_index;
     }
 
+    size_t PetriNetCreator::AddPlaces(vector<CreatePlaceCmd> place_list)
+    {
+        if (_committed)
+        {
+            throw ModificationAfterCommit();
+        }
+        size_t first_index = _place_cmd.size();
+        _place_name_index.Reserve(first_index + place_list.size());
+        for (const auto &cmd:place_list)
+        {
+            if (!_place_name_index.Insert(cmd.name))
+            {
+                _place_name_index.Truncate(first_index); //leave the creator as it was
+                throw DuplicateName();
+            }
+        }
+        AppendCmds(_place_cmd, std::move(place_list));
+        return first_index;
+    }
+
     void PetriNetCreator::AddTransition(const string &name, Transition::FiringTimeFuncType firing_time_func,
                                         Transition::ResamplingPolicy resampling_policy)
     {
@@ -29,12 +52,65 @@ namespace PetriNetModel
         {
             throw ModificationAfterCommit();
         }
-        if (HasName(name, _transition_name_map))
+        if (!_transition_name_index.Insert(name))
+        {
+            throw DuplicateName();
+        }
+        _transition_cmd.push_back(CreateTransitionCmd{name, std::move(firing_time_func), resampling_policy});
+    }
+
+    void PetriNetCreator::AddImmediateTransition(const string &name, double weight, int priority)
+    {
+        if (_committed)
+        {
+            throw ModificationAfterCommit();
+        }
+        CreateTransitionCmd cmd{name, nullptr, Transition::ResamplingPolicy::Different};
+        cmd.immediate = true;
+        cmd.weight = weight;
+        cmd.priority = priority;
+        CheckTransition(cmd);
+        if (!_transition_name_index.Insert(name))
         {
             throw DuplicateName();
         }
-        _transition_name_map[name] = _transition_cmd.size();
-        _transition_cmd.push_back(CreateTransitionCmd{name, firing_time_func, resampling_policy});
+        _transition_cmd.push_back(std::move(cmd));
+    }
+
+    size_t PetriNetCreator::AddTransitions(vector<CreateTransitionCmd> transition_list)
+    {
+        if (_committed)
+        {
+            throw ModificationAfterCommit();
+        }
+        for (const auto &cmd:transition_list)
+        {
+            CheckTransition(cmd);
+        }
+        size_t first_index = _transition_cmd.size();
+        _transition_name_index.Reserve(first_index + transition_list.size());
+        for (const auto &cmd:transition_list)
+        {
+            if (!_transition_name_index.Insert(cmd.name))
+            {
+                _transition_name_index.Truncate(first_index); //leave the creator as it was
+                throw DuplicateName();
+            }
+        }
+        AppendCmds(_transition_cmd, std::move(transition_list));
+        return first_index;
+    }
+
+    void PetriNetCreator::CheckTransition(const CreateTransitionCmd &cmd)
+    {
+        if (cmd.immediate && (!(cmd.weight > 0.0) || !std::isfinite(cmd.weight)))
+        {
+            throw InvalidWeight();
+        }
+        if (cmd.server_policy == Transition::ServerPolicy::MultipleServer && cmd.server_count < 1)
+        {
+            throw InvalidServerCount();
+        }
     }
 
     void PetriNetCreator::Commit()
@@ -50,23 +126,359 @@ namespace PetriNetModel
             throw ModificationAfterCommit();
         }
         _arc_cmd.push_back(CreateArcCmd{
-                FindIndex(transition_name, _transition_name_map),
-                FindIndex(place_name, _place_name_map),
-                type, multiplicity});
+                FindIndex(transition_name, _transition_name_index),
+                FindIndex(place_name, _place_name_index),
+                type, multiplicity, false});
+    }
+
+    void PetriNetCreator::AddArc(size_t transition_index, size_t place_index, Arc::Type type, Mark multiplicity)
+    {
+        if (_committed)
+        {
+            throw ModificationAfterCommit();
+        }
+        if (transition_index >= _transition_cmd.size() || place_index >= _place_cmd.size())
+        {
+            throw NameNotFound();
+        }
+        _arc_cmd.push_back(CreateArcCmd{transition_index, place_index, type, multiplicity, false});
+    }
+
+    void PetriNetCreator::AddArcs(vector<CreateArcCmd> arc_list)
+    {
+        if (_committed)
+        {
+            throw ModificationAfterCommit();
+        }
+        for (const auto &cmd:arc_list)
+        {
+            if (cmd.transition_index >= _transition_cmd.size() || cmd.place_index >= _place_cmd.size())
+            {
+                throw NameNotFound();
+            }
+        }
+        AppendCmds(_arc_cmd, std::move(arc_list));
+    }
+
+    void PetriNetCreator::Reserve(size_t place_count, size_t transition_count, size_t arc_count)
+    {
+        _place_cmd.reserve(place_count);
+        _place_name_index.Reserve(place_count);
+        _transition_cmd.reserve(transition_count);
+        _transition_name_index.Reserve(transition_count);
+        _arc_cmd.reserve(arc_count);
+    }
+
+    size_t PetriNetCreator::AddFluidPlace(const string &name, double level, double capacity)
+    {
+        if (_committed)
+        {
+            throw ModificationAfterCommit();
+        }
+        size_t f_index = _fluid_place_cmd.size();
+        if (_place_name_index.Contains(name) || !_fluid_place_name_index.Insert(name))
+        {
+            throw DuplicateName();
+        }
+        _fluid_place_cmd.push_back(CreateFluidPlaceCmd{name, level, capacity});
+        return f_index;
+    }
+
+    void PetriNetCreator::AddFluidArc(const string &transition_name, const string &fluid_place_name,
+                                      FluidArc::Type type, double value)
+    {
+        if (_committed)
+        {
+            throw ModificationAfterCommit();
+        }
+        _fluid_arc_cmd.push_back(CreateFluidArcCmd{
+                FindIndex(transition_name, _transition_name_index),
+                FindIndex(fluid_place_name, _fluid_place_name_index),
+                type, value});
     }
 
-    void PetriNetCreator::AddPlaceAffectedTransition(std::set<Transition *> &trans_set, Place *place_ptr) const
+    void PetriNetCreator::SetServerPolicy(const string &transition_name, Transition::ServerPolicy server_policy,
+                                          Mark server_count)
     {
-        for (Arc *arc_ptr: place_ptr->_input_arcs)
+        if (_committed)
         {
-            trans_set.insert(arc_ptr->_transition);
+            throw ModificationAfterCommit();
+        }
+        if (server_policy == Transition::ServerPolicy::MultipleServer && server_count < 1)
+        {
+            throw InvalidServerCount();
         }
-        for (Arc *arc_ptr: place_ptr->_inhibitor_arcs)
+        auto &cmd = _transition_cmd[FindIndex(transition_name, _transition_name_index)];
+        cmd.server_policy = server_policy;
+        cmd.server_count = server_count;
+    }
+
+    void PetriNetCreator::SetMarkingDependentRate(const string &transition_name,
+                                                  Transition::MarkingDependentRateFuncType rate_func)
+    {
+        if (_committed)
         {
-            trans_set.insert(arc_ptr->_transition);
+            throw ModificationAfterCommit();
         }
+        _transition_cmd[FindIndex(transition_name, _transition_name_index)].rate_func = rate_func;
     }
 
+    void PetriNetCreator::SetBias(const string &transition_name, double factor)
+    {
+        if (_committed)
+        {
+            throw ModificationAfterCommit();
+        }
+        _transition_cmd[FindIndex(transition_name, _transition_name_index)].bias = factor;
+    }
+
+    void PetriNetCreator::SetFailureBiasing(const vector<string> &failure_transition_names, double failure_probability)
+    {
+        if (_committed)
+        {
+            throw ModificationAfterCommit();
+        }
+        for (const auto &name:failure_transition_names)
+        {
+            _transition_cmd[FindIndex(name, _transition_name_index)].failure = true;
+        }
+        _failure_biasing_probability = failure_probability;
+    }
+
+    size_t PetriNetCreator::AddRateParameter(const string &name, const vector<string> &transition_names)
+    {
+        if (_committed)
+        {
+            throw ModificationAfterCommit();
+        }
+        if (_rate_parameter_name_index.Contains(name))
+        {
+            throw DuplicateName();
+        }
+        CreateRateParameterCmd cmd{name, {}};
+        for (const auto &transition_name:transition_names)
+        {
+            size_t t_index = FindIndex(transition_name, _transition_name_index);
+            const CreateTransitionCmd &transition_cmd = _transition_cmd[t_index];
+            if (transition_cmd.immediate || transition_cmd.firing_time_func.target<ExpSampler>() == nullptr ||
+                transition_cmd.resampling_policy == Transition::ResamplingPolicy::Identical)
+            {
+                throw InvalidRateParameter();
+            }
+            cmd.transition_index_list.push_back(t_index);
+        }
+        size_t parameter_index = _rate_parameter_cmd.size();
+        _rate_parameter_name_index.Insert(name);
+        _rate_parameter_cmd.push_back(cmd);
+        return parameter_index;
+    }
+
+    void PetriNetCreator::SetStoppingPredicate(const vector<string> &place_names,
+                                               const StoppingPredicateType &predicate)
+    {
+        if (_committed)
+        {
+            throw ModificationAfterCommit();
+        }
+        _stopping_place_index_list.clear();
+        for (const auto &name:place_names)
+        {
+            _stopping_place_index_list.push_back(FindIndex(name, _place_name_index));
+        }
+        _stopping_predicate = predicate;
+    }
+
+    void PetriNetCreator::AddReplicatedSubnet(const string &name, const SubnetTemplate &subnet, Mark count)
+    {
+        if (_committed)
+        {
+            throw ModificationAfterCommit();
+        }
+        if (count < 0)
+        {
+            throw InvalidSubnet();
+        }
+        Mark marked_place_count = 0;
+        for (const auto &cmd:subnet._place_cmd)
+        {
+            if (cmd.init_mark < 0 || cmd.init_mark > 1)
+            {
+                throw InvalidSubnet();
+            }
+            marked_place_count += cmd.init_mark;
+        }
+        if (marked_place_count != 1)
+        {
+            throw InvalidSubnet();
+        }
+        // everything is checked before the creator is modified, so a failure leaves it as it was
+        vector<size_t> local_input_count(subnet._transition_rate_list.size(), 0);
+        vector<size_t> local_output_count(subnet._transition_rate_list.size(), 0);
+        vector<size_t> global_place_index(subnet._arc_list.size(), 0);
+        for (size_t arc_index = 0; arc_index < subnet._arc_list.size(); arc_index++)
+        {
+            const auto &arc = subnet._arc_list[arc_index];
+            size_t t_index = FindIndex(std::get<0>(arc), subnet._transition_name_map);
+            if (!HasName(std::get<1>(arc), subnet._place_name_map))
+            {
+                global_place_index[arc_index] = FindIndex(std::get<1>(arc), _place_name_index);
+                continue;
+            }
+            if (std::get<3>(arc) != 1)
+            {
+                throw InvalidSubnet();
+            }
+            switch (std::get<2>(arc))
+            {
+                case Arc::Type::Input:
+                    local_input_count[t_index]++;
+                    break;
+                case Arc::Type::Output:
+                    local_output_count[t_index]++;
+                    break;
+                case Arc::Type::Inhibitor:
+                    throw InvalidSubnet();
+            }
+        }
+        for (size_t t_index = 0; t_index < subnet._transition_rate_list.size(); t_index++)
+        {
+            if (local_input_count[t_index] != 1 || local_output_count[t_index] != 1)
+            {
+                throw InvalidSubnet();
+            }
+        }
+        for (const auto &cmd:subnet._place_cmd)
+        {
+            if (_place_name_index.Contains(ReplicaName(name, cmd.name)))
+            {
+                throw DuplicateName();
+            }
+        }
+        for (const auto &trans:subnet._transition_rate_list)
+        {
+            if (_transition_name_index.Contains(ReplicaName(name, trans.first)))
+            {
+                throw DuplicateName();
+            }
+        }
+
+        size_t first_place = _place_cmd.size();
+        size_t first_transition = _transition_cmd.size();
+        for (const auto &cmd:subnet._place_cmd)
+        {
+            AddPlace(ReplicaName(name, cmd.name), cmd.init_mark * count);
+        }
+        for (const auto &trans:subnet._transition_rate_list)
+        {
+            AddTransition(ReplicaName(name, trans.first), Exp(trans.second));
+            auto &cmd = _transition_cmd.back();
+            cmd.server_policy = Transition::ServerPolicy::InfiniteServer;
+            cmd.explicit_degree_arcs = true;
+        }
+        for (size_t arc_index = 0; arc_index < subnet._arc_list.size(); arc_index++)
+        {
+            const auto &arc = subnet._arc_list[arc_index];
+            auto local_place = subnet._place_name_map.find(std::get<1>(arc));
+            bool local = local_place != subnet._place_name_map.end();
+            Arc::Type type = std::get<2>(arc);
+            _arc_cmd.push_back(CreateArcCmd{
+                    first_transition + FindIndex(std::get<0>(arc), subnet._transition_name_map),
+                    local ? first_place + local_place->second : global_place_index[arc_index],
+                    type, std::get<3>(arc), local && type == Arc::Type::Input});
+        }
+    }
+
+    void PetriNetCreator::BuildConflictSets(PetriNet &petri_net) const
+    {
+        // union immediate transitions of equal priority which share an input place
+        vector<size_t> root(_transition_cmd.size());
+        for (size_t t_index = 0; t_index < root.size(); t_index++)
+        {
+            root[t_index] = t_index;
+        }
+        auto find_root = [&root](size_t t_index)
+        {
+            while (root[t_index] != t_index)
+            {
+                root[t_index] = root[root[t_index]];
+                t_index = root[t_index];
+            }
+            return t_index;
+        };
+        // The input arcs of immediate transitions, grouped by place and priority in arc order. Every arc is joined to
+        // the first consumer of its group, in arc order, so that the roots and hence the set order do not depend on
+        // how the groups were found.
+        vector<size_t> consumer_arc;
+        for (size_t arc_index = 0; arc_index < _arc_cmd.size(); arc_index++)
+        {
+            const auto &cmd = _arc_cmd[arc_index];
+            if (cmd.type == Arc::Type::Input && _transition_cmd[cmd.transition_index].immediate)
+            {
+                consumer_arc.push_back(arc_index);
+            }
+        }
+        auto group_key = [this](size_t arc_index)
+        {
+            const auto &cmd = _arc_cmd[arc_index];
+            return std::make_pair(cmd.place_index, _transition_cmd[cmd.transition_index].priority);
+        };
+        std::stable_sort(consumer_arc.begin(), consumer_arc.end(), [&group_key](size_t lhs, size_t rhs)
+        { return group_key(lhs) < group_key(rhs); });
+        vector<std::pair<size_t, size_t>> join_list; //(arc index, first consumer of its group)
+        for (size_t i = 1, first = 0; i < consumer_arc.size(); i++)
+        {
+            if (group_key(consumer_arc[i]) != group_key(consumer_arc[first]))
+            {
+                first = i;
+                continue;
+            }
+            join_list.emplace_back(consumer_arc[i], _arc_cmd[consumer_arc[first]].transition_index);
+        }
+        std::sort(join_list.begin(), join_list.end());
+        for (const auto &join:join_list)
+        {
+            root[find_root(_arc_cmd[join.first].transition_index)] = find_root(join.second);
+        }
+
+        vector<size_t> set_root_list;
+        for (size_t t_index = 0; t_index < _transition_cmd.size(); t_index++)
+        {
+            if (_transition_cmd[t_index].immediate && find_root(t_index) == t_index)
+            {
+                set_root_list.push_back(t_index);
+            }
+        }
+        std::stable_sort(set_root_list.begin(), set_root_list.end(), [this](size_t lhs, size_t rhs)
+        { return _transition_cmd[lhs].priority > _transition_cmd[rhs].priority; });
+        vector<size_t> conflict_set_index(_transition_cmd.size(), 0);
+        for (size_t set_index = 0; set_index < set_root_list.size(); set_index++)
+        {
+            conflict_set_index[set_root_list[set_index]] = set_index;
+        }
+
+        auto &conflict_set_list = petri_net._conflict_set_list;
+        conflict_set_list.resize(set_root_list.size());
+        vector<vector<double>> weight_list(set_root_list.size());
+        for (size_t t_index = 0; t_index < _transition_cmd.size(); t_index++)
+        {
+            const auto &cmd = _transition_cmd[t_index];
+            if (!cmd.immediate)
+            {
+                continue;
+            }
+            size_t set_index = conflict_set_index[find_root(t_index)];
+            conflict_set_index[t_index] = set_index;
+            auto &transition = petri_net._transition_list[t_index];
+            transition.InitImmediate(cmd.weight, cmd.priority, set_index);
+            conflict_set_list[set_index].priority = cmd.priority;
+            conflict_set_list[set_index].transition_list.push_back(&transition);
+            weight_list[set_index].push_back(cmd.weight);
+        }
+        for (size_t set_index = 0; set_index < conflict_set_list.size(); set_index++)
+        {
+            conflict_set_list[set_index].alias_table = AliasTable(weight_list[set_index]);
+        }
+    }
 
     PetriNet PetriNetCreator::CreatePetriNet() const
     {
@@ -74,41 +486,261 @@ namespace PetriNetModel
         {
             throw CreatePetriNetBeforeCommit();
         }
-        PetriNet petri_net(*this, _place_cmd.size(), _transition_cmd.size(), _arc_cmd.size());
+        // Every array of the net is written in one pass where possible: at a million transitions, a pass over them or
+        // over their commands takes tens of milliseconds, mostly spent faulting memory in.
+        size_t transition_count = _transition_cmd.size();
+        PetriNet petri_net(*this, _place_cmd.size(), transition_count, _arc_cmd.size(),
+                           _fluid_place_cmd.size(), _fluid_arc_cmd.size());
+        Place *place_data = petri_net._place_list.data();
+        Transition *trans_data = petri_net._transition_list.data();
         for (size_t p_index = 0; p_index < _place_cmd.size(); p_index++)
         {
-            auto &place = petri_net._place_list[p_index];
             const auto &cmd = _place_cmd[p_index];
-            place.Init(&cmd.name, cmd.init_mark);
+            petri_net._place_list[p_index].Init(&cmd.name, cmd.init_mark);
         }
-        for (size_t arc_index = 0; arc_index < _arc_cmd.size(); arc_index++)
+        // fluid events are deterministic, so fluid nets always use the general engine
+        petri_net._markovian = _fluid_place_cmd.empty();
+        petri_net._failure_biasing_probability = _failure_biasing_probability;
+        petri_net._importance_sampling = _failure_biasing_probability > 0.0;
+        petri_net._bias.reserve(transition_count);
+        petri_net._failure_transition.reserve(transition_count);
+        bool has_immediate = false;
+        vector<bool> input_counts_degree(transition_count);
+        for (size_t t_index = 0; t_index < transition_count; t_index++)
         {
-            auto &arc = petri_net._arc_list[arc_index];
-            auto &cmd = _arc_cmd[arc_index];
-            Place *place_ptr = &petri_net._place_list[cmd.place_index];
-            Transition *trans_ptr = &petri_net._transition_list[cmd.transition_index];
-            arc.Init(trans_ptr, place_ptr, cmd.type, cmd.multiplicity);
-            trans_ptr->AddArc(&arc, cmd.type);
-            place_ptr->AddArc(&arc, cmd.type);
+            const auto &cmd = _transition_cmd[t_index];
+            petri_net._transition_list.emplace_back();
+            auto &transition = petri_net._transition_list.back();
+            transition.Init(&cmd.name, cmd.firing_time_func, cmd.resampling_policy);
+            transition.InitRate(cmd.server_policy, cmd.server_count, cmd.rate_func);
+            has_immediate = has_immediate || cmd.immediate;
+            input_counts_degree[t_index] = !cmd.explicit_degree_arcs &&
+                                           cmd.server_policy != Transition::ServerPolicy::SingleServer;
+            petri_net._markovian = petri_net._markovian &&
+                                   (cmd.immediate || (cmd.firing_time_func.target<ExpSampler>() != nullptr &&
+                                                      cmd.resampling_policy != Transition::ResamplingPolicy::Identical));
+            petri_net._bias.push_back(cmd.bias);
+            petri_net._failure_transition.push_back(cmd.failure);
+            petri_net._importance_sampling = petri_net._importance_sampling || cmd.bias != 1.0;
         }
-        for (size_t t_index = 0; t_index < _transition_cmd.size(); t_index++)
+
+        // The arcs are laid out by a counting sort on (transition, type), keeping the order they were added in, and so
+        // are the degree arcs and the transitions reading every place (by input and inhibitor arcs). The counts are
+        // shifted by two, so that every bucket starts at begin[bucket + 1] while filling and spans
+        // [begin[bucket], begin[bucket + 1]) afterwards.
+        const size_t type_count = 3;
+        auto is_degree_arc = [&input_counts_degree](const CreateArcCmd &cmd)
+        {
+            return cmd.counts_degree || (cmd.type == Arc::Type::Input && input_counts_degree[cmd.transition_index]);
+        };
+        vector<size_t> arc_begin(type_count * transition_count + 2, 0);
+        vector<size_t> degree_begin(transition_count + 2, 0);
+        vector<size_t> reader_begin(_place_cmd.size() + 2, 0);
+        vector<size_t> writer_count(_place_cmd.size(), 0); //input and output arcs of every place
+        for (const auto &cmd:_arc_cmd)
+        {
+            arc_begin[type_count * cmd.transition_index + cmd.type + 2]++;
+            if (is_degree_arc(cmd))
+            {
+                degree_begin[cmd.transition_index + 2]++;
+            }
+            if (cmd.type != Arc::Type::Output)
+            {
+                reader_begin[cmd.place_index + 2]++;
+            }
+            if (cmd.type != Arc::Type::Inhibitor)
+            {
+                writer_count[cmd.place_index]++;
+            }
+        }
+        for (auto *begin:{&arc_begin, &degree_begin, &reader_begin})
+        {
+            std::partial_sum(begin->begin(), begin->end(), begin->begin());
+        }
+        petri_net._degree_arc_list.resize(degree_begin.back());
+        vector<size_t> reader_list(reader_begin.back());
+        for (const auto &cmd:_arc_cmd)
+        {
+            Arc &arc = petri_net._arc_list[arc_begin[type_count * cmd.transition_index + cmd.type + 1]++];
+            arc.Init(trans_data + cmd.transition_index, place_data + cmd.place_index, cmd.type, cmd.multiplicity);
+            if (is_degree_arc(cmd))
+            {
+                petri_net._degree_arc_list[degree_begin[cmd.transition_index + 1]++] = &arc;
+            }
+            if (cmd.type != Arc::Type::Output)
+            {
+                reader_list[reader_begin[cmd.place_index + 1]++] = cmd.transition_index;
+            }
+        }
+
+        for (size_t f_index = 0; f_index < _fluid_place_cmd.size(); f_index++)
+        {
+            const auto &cmd = _fluid_place_cmd[f_index];
+            petri_net._fluid_place_list[f_index].Init(&cmd.name, cmd.init_level, cmd.capacity);
+        }
+        for (size_t arc_index = 0; arc_index < _fluid_arc_cmd.size(); arc_index++)
+        {
+            auto &arc = petri_net._fluid_arc_list[arc_index];
+            const auto &cmd = _fluid_arc_cmd[arc_index];
+            FluidPlace *place_ptr = &petri_net._fluid_place_list[cmd.fluid_place_index];
+            Transition *trans_ptr = trans_data + cmd.transition_index;
+            arc.Init(trans_ptr, place_ptr, cmd.type, cmd.value);
+            if (cmd.type == FluidArc::Type::Inflow || cmd.type == FluidArc::Type::Outflow)
+            {
+                place_ptr->_flow_arcs.push_back(&arc);
+            } else
+            {
+                place_ptr->_guard_arcs.push_back(&arc);
+                trans_ptr->AddFluidGuardArc(&arc);
+            }
+        }
+        if (has_immediate)
+        {
+            BuildConflictSets(petri_net);
+        }
+
+        // The affected lists are sorted by index, i.e. by address, and deduplicated. They are appended to flat arrays
+        // reserved for the lists before deduplication, so the spans into them stay valid and every transition is
+        // finished in one pass.
+        const size_t no_set = std::numeric_limits<size_t>::max();
+        vector<size_t> conflict_set_index; //no_set for timed transitions, empty without immediate transitions
+        if (has_immediate)
+        {
+            conflict_set_index.assign(transition_count, no_set);
+            for (size_t set_index = 0; set_index < petri_net._conflict_set_list.size(); set_index++)
+            {
+                for (Transition *trans_ptr:petri_net._conflict_set_list[set_index].transition_list)
+                {
+                    conflict_set_index[trans_ptr - trans_data] = set_index;
+                }
+            }
+        }
+        size_t affected_bound = transition_count + _fluid_arc_cmd.size();
+        for (size_t p_index = 0; p_index < _place_cmd.size(); p_index++)
+        {
+            affected_bound += writer_count[p_index] * (reader_begin[p_index + 1] - reader_begin[p_index]);
+        }
+        auto &affected_trans_list = petri_net._affected_transition_list;
+        auto &affected_set_list = petri_net._affected_conflict_set_list;
+        affected_trans_list.reserve(affected_bound);
+        affected_set_list.reserve(has_immediate ? affected_bound : 0);
+        vector<size_t> affected_index;
+        vector<std::pair<size_t, size_t>> reader_range;
+        auto collect = [&](Span<Transition *> &affected_trans, Span<size_t> &affected_set)
+        {
+            std::sort(affected_index.begin(), affected_index.end());
+            affected_index.erase(std::unique(affected_index.begin(), affected_index.end()), affected_index.end());
+            size_t trans_begin = affected_trans_list.size();
+            size_t set_begin = affected_set_list.size();
+            for (size_t t_index:affected_index)
+            {
+                size_t set_index = conflict_set_index.empty() ? no_set : conflict_set_index[t_index];
+                if (set_index == no_set)
+                {
+                    affected_trans_list.push_back(trans_data + t_index);
+                } else
+                {
+                    affected_set_list.push_back(set_index);
+                }
+            }
+            std::sort(affected_set_list.begin() + set_begin, affected_set_list.end());
+            affected_set_list.erase(std::unique(affected_set_list.begin() + set_begin, affected_set_list.end()),
+                                    affected_set_list.end());
+            affected_trans = Span<Transition *>(affected_trans_list.data() + trans_begin,
+                                                affected_trans_list.data() + affected_trans_list.size());
+            affected_set = Span<size_t>(affected_set_list.data() + set_begin,
+                                        affected_set_list.data() + affected_set_list.size());
+        };
+        for (auto &place:petri_net._fluid_place_list)
+        {
+            affected_index.clear();
+            for (FluidArc *arc_ptr:place._guard_arcs)
+            {
+                affected_index.push_back(arc_ptr->_transition - trans_data);
+            }
+            collect(place._affected_transition, place._affected_conflict_set);
+        }
+        Arc *arc_data = petri_net._arc_list.data();
+        Arc **degree_arc_data = petri_net._degree_arc_list.data();
+        for (size_t t_index = 0; t_index < transition_count; t_index++)
         {
             auto &transition = petri_net._transition_list[t_index];
-            const auto &cmd = _transition_cmd[t_index];
-            std::set<Transition *> affected_trans_set;
-            for (Arc *arc_ptr:transition._input_arcs)
+            const size_t *begin = &arc_begin[type_count * t_index];
+            transition._input_arcs = Span<Arc>(arc_data + begin[Arc::Type::Input],
+                                               arc_data + begin[Arc::Type::Input + 1]);
+            transition._output_arcs = Span<Arc>(arc_data + begin[Arc::Type::Output],
+                                                arc_data + begin[Arc::Type::Output + 1]);
+            transition._inhibitor_arcs = Span<Arc>(arc_data + begin[Arc::Type::Inhibitor],
+                                                   arc_data + begin[Arc::Type::Inhibitor + 1]);
+            transition._degree_arcs = Span<Arc *>(degree_arc_data + degree_begin[t_index],
+                                                  degree_arc_data + degree_begin[t_index + 1]);
+            // The readers of the places of the input and output arcs, once per place. Their ranges are all looked up
+            // before any of them is read, so that the cache misses overlap.
+            reader_range.clear();
+            for (size_t arc_index = begin[Arc::Type::Input]; arc_index < begin[Arc::Type::Output + 1]; arc_index++)
             {
-                AddPlaceAffectedTransition(affected_trans_set, arc_ptr->_place);
+                const Place *place_ptr = arc_data[arc_index]._place;
+                bool seen = false;
+                for (size_t prev_index = begin[Arc::Type::Input]; prev_index < arc_index && !seen; prev_index++)
+                {
+                    seen = arc_data[prev_index]._place == place_ptr;
+                }
+                if (!seen)
+                {
+                    size_t p_index = place_ptr - place_data;
+                    reader_range.emplace_back(reader_begin[p_index], reader_begin[p_index + 1]);
+                }
             }
-            for (Arc *arc_ptr:transition._output_arcs)
+            affected_index.clear();
+            affected_index.push_back(t_index); //a fired transition has to be sampled again
+            for (const auto &range:reader_range)
             {
-                AddPlaceAffectedTransition(affected_trans_set, arc_ptr->_place);
+                affected_index.insert(affected_index.end(), reader_list.begin() + range.first,
+                                      reader_list.begin() + range.second);
+            }
+            collect(transition._affected_transition, transition._affected_conflict_set);
+        }
+
+        petri_net._firing_queue.Resize(transition_count);
+        petri_net._transition_rate.assign(transition_count, 0.0);
+        if (petri_net._importance_sampling)
+        {
+            if (!petri_net._markovian || !petri_net._conflict_set_list.empty())
+            {
+                throw ImportanceSamplingNotSupported();
+            }
+            petri_net.InitDirectMethod();
+        }
+        if (!_rate_parameter_cmd.empty())
+        {
+            petri_net._transition_parameter_list.assign(transition_count, {});
+        }
+        for (size_t p_index = 0; p_index < _rate_parameter_cmd.size(); p_index++)
+        {
+            const auto &transition_index_list = _rate_parameter_cmd[p_index].transition_index_list;
+            petri_net._parameter_transition_list.push_back(transition_index_list);
+            for (size_t t_index:transition_index_list)
+            {
+                petri_net._transition_parameter_list[t_index].push_back(p_index);
+            }
+        }
+        petri_net._score.assign(_rate_parameter_cmd.size(), 0.0);
+        petri_net._stopping_predicate = _stopping_predicate;
+        petri_net._stopping_trigger.assign(transition_count, false);
+        if (!_stopping_place_index_list.empty())
+        {
+            vector<bool> stopping_place(_place_cmd.size(), false);
+            for (size_t p_index:_stopping_place_index_list)
+            {
+                stopping_place[p_index] = true;
+            }
+            for (const auto &cmd:_arc_cmd)
+            {
+                if (cmd.type != Arc::Type::Inhibitor && stopping_place[cmd.place_index])
+                {
+                    petri_net._stopping_trigger[cmd.transition_index] = true;
+                }
             }
-            transition.Init(&cmd.name,
-                            cmd.firing_time_func,
-                            cmd.resampling_policy,
-                            vector<Transition *>(affected_trans_set.begin(), affected_trans_set.end())
-            );
         }
         return petri_net;
     }
@@ -116,25 +748,27 @@ namespace PetriNetModel
 
     bool PetriNetCreator::HasName(const string &name, const unordered_map<string, size_t> &map) const
     {
-        try
-        {
-            map.at(name);
-            return true;
-        } catch (std::exception e)
-        {
-            return false;
-        }
+        return map.find(name) != map.end();
     }
 
     size_t PetriNetCreator::FindIndex(const string &name, const std::unordered_map<std::string, size_t> &map) const
     {
-        try
+        auto it = map.find(name);
+        if (it == map.end())
         {
-            return map.at(name);
-        } catch (std::exception e)
+            throw NameNotFound();
+        }
+        return it->second;
+    }
+
+    size_t PetriNetCreator::FindIndex(const string &name, const NameIndex &name_index) const
+    {
+        size_t index = name_index.Find(name);
+        if (index == NameIndex::NotFound)
         {
             throw NameNotFound();
         }
+        return index;
     }
 
 }
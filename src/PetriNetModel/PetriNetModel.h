@@ -5,20 +5,22 @@
 #ifndef SPNP_PETRI_NET_MODEL_H
 #define SPNP_PETRI_NET_MODEL_H
 
+#include<algorithm>
 #include<string>
 #include<vector>
 #include<memory>
 #include <set>
+#include <limits>
+#include <cmath>
 #include<unordered_map>
 #include<sstream>
 #include<functional>
+#include<tuple>
+#include<iterator>
 #include "Statistics.h"
 
-//TODO: fluid support
-//TODO: imm transition
 //TODO: marking dependent properties of arc: multiplicity
-//TODO: marking dependent properties of transition: guard, firing time, weight for imm
-//TODO: sensitivity analysis
+//TODO: marking dependent properties of transition: guard, weight for imm
 
 namespace PetriNetModel
 {
@@ -39,8 +41,42 @@ namespace PetriNetModel
 
     class Place;
 
+    class FluidPlace;
+
+    class PetriNet;
+
     typedef int Mark;
 
+    // A range of elements owned by someone else, e.g. the part of one of the PetriNet's flat arrays that belongs to a
+    // transition. Valid as long as the owner is not resized.
+    template<typename T>
+    class Span
+    {
+    private:
+        T *_begin = nullptr;
+        T *_end = nullptr;
+    public:
+        Span() = default;
+
+        Span(T *begin, T *end) : _begin(begin), _end(end)
+        { }
+
+        T *begin() const
+        { return _begin; }
+
+        T *end() const
+        { return _end; }
+
+        size_t size() const
+        { return _end - _begin; }
+
+        bool empty() const
+        { return _begin == _end; }
+
+        T &operator[](size_t i) const
+        { return _begin[i]; }
+    };
+
 
     class Arc
     {
@@ -82,13 +118,12 @@ namespace PetriNetModel
     {
         friend class PetriNetCreator;
 
+        friend class PetriNet;
+
     private:
         const string *_name;
         Mark _mark;
         Mark _init_mark;
-        vector<Arc *> _input_arcs;
-        vector<Arc *> _output_arcs;
-        vector<Arc *> _inhibitor_arcs;
     public:
         void Init(const string *name, Mark mark)
         {
@@ -96,22 +131,6 @@ namespace PetriNetModel
             _init_mark = mark;
         }
 
-        void AddArc(Arc *arc_ptr, Arc::Type type)
-        {
-            switch (type)
-            {
-                case Arc::Type::Input:
-                    _input_arcs.push_back(arc_ptr);
-                    break;
-                case Arc::Type::Output:
-                    _output_arcs.push_back(arc_ptr);
-                    break;
-                case Arc::Type::Inhibitor:
-                    _inhibitor_arcs.push_back(arc_ptr);
-                    break;
-            }
-        }
-
         void Reset()
         {
             _mark = _init_mark;
@@ -125,10 +144,94 @@ namespace PetriNetModel
 
     };
 
+    // Connects a timed transition to a fluid place. Flow arcs move fluid continuously while the transition is
+    // enabled; guard arcs enable the transition only while the fluid level is at least (Threshold) or below
+    // (Inhibitor) the given value. The level is compared as approached from the direction of the flow, so a
+    // threshold is left as soon as the level starts moving away from it.
+    class FluidArc
+    {
+        friend class PetriNetCreator;
+
+        friend class PetriNet;
+
+    public:
+        enum Type
+        {
+            Inflow,
+            Outflow,
+            Threshold,
+            Inhibitor,
+        };
+    private:
+        Transition *_transition;
+        FluidPlace *_place;
+        Type _type;
+        double _value;
+    public:
+        void Init(Transition *trans, FluidPlace *place, Type type, double value)
+        {
+            _transition = trans;
+            _place = place;
+            _type = type;
+            _value = value;
+        }
+
+        bool IsSatisfied() const;
+    };
+
+    // A place holding a continuous level in [0, capacity]. Its level changes linearly between events, at the rate
+    // given by the flow arcs of the enabled transitions.
+    class FluidPlace
+    {
+        friend class PetriNetCreator;
+
+        friend class PetriNet;
+
+        friend class FluidArc;
+
+    private:
+        const string *_name;
+        double _init_level;
+        double _capacity;
+        double _level;
+        double _rate = 0.0;
+        int _direction = 0;
+        vector<FluidArc *> _flow_arcs;
+        vector<FluidArc *> _guard_arcs;
+        Span<Transition *> _affected_transition;
+        Span<size_t> _affected_conflict_set;
+    public:
+        void Init(const string *name, double level, double capacity)
+        {
+            _name = name;
+            _init_level = level;
+            _capacity = capacity;
+        }
+
+        void Reset()
+        {
+            _level = _init_level;
+            _rate = 0.0;
+            _direction = 0;
+        }
+
+        double GetLevel() const
+        { return _level; }
+
+        double GetRate() const
+        { return _rate; }
+
+        // the level after `duration` at the current rate, kept within the bounds against rounding
+        double LevelAfter(double duration) const
+        { return std::min(std::max(_level + _rate * duration, 0.0), _capacity); }
+    };
+
     class Transition
     {
         friend class PetriNetCreator;
 
+        friend class PetriNet;
+
     public:
         enum ResamplingPolicy
         {
@@ -136,7 +239,18 @@ namespace PetriNetModel
             Identical,
             Resume
         };
+        // How many tokens of the enabling marking are served in parallel. The firing time is divided by the number
+        // of busy servers, i.e. the enabling degree (bounded by the server count for MultipleServer).
+        enum ServerPolicy
+        {
+            SingleServer,
+            InfiniteServer,
+            MultipleServer,
+        };
         typedef std::function<double(double uniform_rand_num)> FiringTimeFuncType;
+        // Speed factor of the firing time as a function of the marking. It may only read the input and inhibitor
+        // places of the transition, since it is re-evaluated only when those change.
+        typedef std::function<double(const PetriNet &)> MarkingDependentRateFuncType;
     private:
         enum State
         {
@@ -145,20 +259,43 @@ namespace PetriNetModel
             Disable_EnabledSinceFire,
             Disable_NeverEnabledSinceFire,
         };
+    public:
+        // everything about a transition that changes during a simulation run
+        struct Clock
+        {
+            State state;
+            double firing_time;
+            double last_sample_value;
+            double left_time;
+            double rate_scale;
+        };
     private:
         const string *_name;
-        vector<Arc *> _input_arcs;
-        vector<Arc *> _output_arcs;
-        vector<Arc *> _inhibitor_arcs;
+        Span<Arc> _input_arcs;
+        Span<Arc> _output_arcs;
+        Span<Arc> _inhibitor_arcs;
+        Span<Arc *> _degree_arcs; //input arcs whose marking counts the enabled servers
+        Span<Transition *> _affected_transition; //timed transitions only
+        Span<size_t> _affected_conflict_set; //conflict sets of the affected immediate transitions
+        vector<FluidArc *> _fluid_guard_arcs;
         FiringTimeFuncType _sample_func;
         State _state = State::JustFired;
         double _firing_time = -1;
         double _last_sample_value = -1;
-        double _left_time = -1;
+        double _left_time = -1; //remaining work, i.e. not divided by the rate scale
+        double _rate_scale = 1.0;
         ResamplingPolicy _policy;
-        vector<Transition *> _affected_transition;
+        ServerPolicy _server_policy = ServerPolicy::SingleServer;
+        Mark _server_count = 1;
+        MarkingDependentRateFuncType _rate_func;
+        bool _immediate = false;
+        double _weight = 1.0;
+        int _priority = 0;
+        size_t _conflict_set_index = 0;
     private:
-        bool IsEnabled() const;
+        Mark EnablingDegree() const;
+
+        double RateScale(const PetriNet &petri_net) const;
 
     public:
         Transition()
@@ -171,26 +308,96 @@ namespace PetriNetModel
         }
 
 
-        void Init(const string *name, FiringTimeFuncType sample_func, ResamplingPolicy policy,
-                  vector<Transition *> &&affected_trans)
+        void Init(const string *name, FiringTimeFuncType sample_func, ResamplingPolicy policy)
         {
             _name = name;
-            _sample_func = sample_func;
+            _sample_func = std::move(sample_func);
             _policy = policy;
-            _affected_transition = affected_trans;
         }
 
-        void AddArc(Arc *arc_ptr, Arc::Type type);
+        void SetSampleFunc(FiringTimeFuncType sample_func)
+        { _sample_func = sample_func; }
+
+        void InitImmediate(double weight, int priority, size_t conflict_set_index)
+        {
+            _immediate = true;
+            _weight = weight;
+            _priority = priority;
+            _conflict_set_index = conflict_set_index;
+        }
+
+        void InitRate(ServerPolicy server_policy, Mark server_count, MarkingDependentRateFuncType rate_func)
+        {
+            _server_policy = server_policy;
+            _server_count = server_count;
+            _rate_func = std::move(rate_func);
+        }
+
+        void AddFluidGuardArc(FluidArc *arc_ptr)
+        { _fluid_guard_arcs.push_back(arc_ptr); }
 
         double GetFireTime() const
         { return _firing_time; }
 
-        void InputArcChanged(double current_time, double uniform_rand_num);
+        void InputArcChanged(const PetriNet &petri_net, double current_time, UniformRandomNumberGenerator &generator);
+
+        // Clock update of the next-reaction engine. Only valid for exponential firing times: the remaining work of a
+        // clock is kept while the transition is disabled (which is equivalent to resampling by memorylessness), so a
+        // new random number is drawn only after firing.
+        void ExponentialInputArcChanged(const PetriNet &petri_net, double current_time,
+                                        UniformRandomNumberGenerator &generator);
+
+        // Draws a new remaining time for an exponential clock; by memorylessness the trajectory keeps its law.
+        void RenewExponentialClock(double current_time, UniformRandomNumberGenerator &generator);
+
+        const ExpSampler *GetExpSampler() const
+        { return _sample_func.target<ExpSampler>(); }
+
+        // current rate of an exponential transition, 0 if disabled
+        double GetExpRate(const PetriNet &petri_net) const
+        { return IsEnabled() ? GetExpSampler()->lambda * RateScale(petri_net) : 0.0; }
+
+        // the rate scale as of the last clock update, 0 if disabled
+        double GetCurrentRateScale() const
+        { return _state == State::Enable ? _rate_scale : 0.0; }
+
+        // the rate as of the last clock update of the next-reaction engine
+        double GetCurrentExpRate() const
+        { return GetExpSampler()->lambda * GetCurrentRateScale(); }
 
-        vector<Transition *> &GetAffectedTransition()
+        ResamplingPolicy GetResamplingPolicy() const
+        { return _policy; }
+
+        Span<Transition *> GetAffectedTransition() const
         { return _affected_transition; }
 
+        Span<size_t> GetAffectedConflictSet() const
+        { return _affected_conflict_set; }
+
+        bool IsImmediate() const
+        { return _immediate; }
+
+        double GetWeight() const
+        { return _weight; }
+
+        int GetPriority() const
+        { return _priority; }
+
+        bool IsEnabled() const;
+
         void Fire();
+
+        Clock GetClock() const
+        { return Clock{_state, _firing_time, _last_sample_value, _left_time, _rate_scale}; }
+
+        void SetClock(const Clock &clock)
+        {
+            _state = clock.state;
+            _firing_time = clock.firing_time;
+            _last_sample_value = clock.last_sample_value;
+            _left_time = clock.left_time;
+            _rate_scale = clock.rate_scale;
+        }
     };
 
 
@@ -204,6 +411,28 @@ namespace PetriNetModel
         string name;
         Transition::FiringTimeFuncType firing_time_func;
         Transition::ResamplingPolicy resampling_policy;
+        Transition::ServerPolicy server_policy = Transition::ServerPolicy::SingleServer;
+        Mark server_count = 1;
+        Transition::MarkingDependentRateFuncType rate_func = nullptr;
+        bool explicit_degree_arcs = false;
+        bool immediate = false;
+        double weight = 1.0;
+        int priority = 0;
+        double bias = 1.0;
+        bool failure = false;
+    };
+    struct CreateFluidPlaceCmd
+    {
+        string name;
+        double init_level;
+        double capacity;
+    };
+    struct CreateFluidArcCmd
+    {
+        size_t transition_index;
+        size_t fluid_place_index;
+        FluidArc::Type type;
+        double value;
     };
     struct CreateArcCmd
     {
@@ -211,12 +440,36 @@ namespace PetriNetModel
         size_t place_index;
         Arc::Type type;
         Mark multiplicity;
+        bool counts_degree;
+    };
+
+    struct CreateRateParameterCmd
+    {
+        string name;
+        vector<size_t> transition_index_list;
     };
 
+    typedef std::function<bool(const PetriNet &)> StoppingPredicateType;
+
     class ModificationAfterCommit : public std::exception
     {
     };
 
+    // rate parameters can only move the rates of exponential timed transitions without the Identical policy
+    class InvalidRateParameter : public std::exception
+    {
+    };
+
+    // weights of immediate transitions have to be positive and finite
+    class InvalidWeight : public std::exception
+    {
+    };
+
+    // a MultipleServer transition needs at least one server
+    class InvalidServerCount : public std::exception
+    {
+    };
+
     class CreatePetriNetBeforeCommit : public std::exception
     {
     };
@@ -229,7 +482,127 @@ namespace PetriNetModel
     {
     };
 
-    class PetriNet;
+    // Indexed binary heap of the transitions' firing times
+    class FiringQueue
+    {
+    private:
+        static const size_t NotInQueue = std::numeric_limits<size_t>::max();
+        vector<size_t> _heap;
+        vector<size_t> _position;
+        vector<double> _time;
+    public:
+        void Resize(size_t size)
+        {
+            _heap.clear();
+            _position.assign(size, NotInQueue);
+            _time.assign(size, -1);
+        }
+
+        void Clear()
+        { Resize(_position.size()); }
+
+        // a negative time removes the element
+        void Update(size_t index, double time);
+
+        bool Empty() const
+        { return _heap.empty(); }
+
+        size_t Top() const
+        { return _heap.front(); }
+
+        double TopTime() const
+        { return _time[_heap.front()]; }
+
+    private:
+        void Swap(size_t lhs_pos, size_t rhs_pos);
+
+        void SiftUp(size_t pos);
+
+        void SiftDown(size_t pos);
+    };
+
+    class TauLeapingNotSupported : public std::exception
+    {
+    };
+
+    class InvalidSubnet : public std::exception
+    {
+    };
+
+    // immediate transitions or fluid events keep occurring without time advancing
+    class TimelessTrap : public std::exception
+    {
+    };
+
+    // importance sampling needs a Markovian net without immediate transitions
+    class ImportanceSamplingNotSupported : public std::exception
+    {
+    };
+
+    // a firing time function can only be replaced on a timed transition, and by one that is exponential exactly
+    // when the original one is
+    class InvalidFiringTimeFunc : public std::exception
+    {
+    };
+
+    // Maps names to dense indices, 0 for the first name inserted and so on. The names are interned in one character
+    // array and found by open addressing, so inserting allocates only when an array grows and nothing throws.
+    class NameIndex
+    {
+    public:
+        static const size_t NotFound = std::numeric_limits<size_t>::max();
+    private:
+        struct Slot
+        {
+            size_t hash;
+            size_t index; //NotFound if empty
+        };
+        vector<char> _char_list;
+        vector<size_t> _name_end; //of every name in _char_list
+        vector<Slot> _slot_list; //a power of two in size, at most half full
+
+        bool IsName(size_t index, const string &name) const;
+
+        void Rehash(size_t slot_count);
+
+    public:
+        size_t Size() const
+        { return _name_end.size(); }
+
+        size_t Find(const string &name) const;
+
+        bool Contains(const string &name) const
+        { return Find(name) != NotFound; }
+
+        // gives the name the index Size(); false, and nothing inserted, if the name is taken
+        bool Insert(const string &name);
+
+        void Reserve(size_t name_count);
+
+        // removes the names with an index of at least `size`, e.g. to undo a failed bulk add
+        void Truncate(size_t size);
+    };
+
+    // A subnet that is instantiated many times with identical behaviour. Every copy must be a state machine:
+    // exactly one of its local places is marked (with one token), and every transition moves that token from one
+    // local place to another. Arcs may also refer to places of the enclosing net, which are shared by all copies.
+    class SubnetTemplate
+    {
+        friend class PetriNetCreator;
+
+    private:
+        vector<CreatePlaceCmd> _place_cmd;
+        vector<std::pair<string, double>> _transition_rate_list;
+        vector<std::tuple<string, string, Arc::Type, Mark>> _arc_list;
+        unordered_map<string, size_t> _place_name_map;
+        unordered_map<string, size_t> _transition_name_map;
+    public:
+        void AddPlace(const string &name, Mark mark);
+
+        void AddTransition(const string &name, double rate);
+
+        void AddArc(const string &transition_name, const string &place_name, Arc::Type type, Mark multiplicity = 1);
+    };
 
     class PetriNetCreator
     {
@@ -237,15 +610,41 @@ namespace PetriNetModel
         vector<CreatePlaceCmd> _place_cmd;
         vector<CreateTransitionCmd> _transition_cmd;
         vector<CreateArcCmd> _arc_cmd;
+        vector<CreateFluidPlaceCmd> _fluid_place_cmd;
+        vector<CreateFluidArcCmd> _fluid_arc_cmd;
+        vector<CreateRateParameterCmd> _rate_parameter_cmd;
         bool _committed = false;
-        unordered_map<string, size_t> _transition_name_map;
-        unordered_map<string, size_t> _place_name_map;
+        double _failure_biasing_probability = 0.0; //0 if balanced failure biasing is off
+        StoppingPredicateType _stopping_predicate;
+        vector<size_t> _stopping_place_index_list;
+        NameIndex _transition_name_index;
+        NameIndex _place_name_index;
+        NameIndex _fluid_place_name_index;
+        NameIndex _rate_parameter_name_index;
     private:
         bool HasName(const string &name, const unordered_map<string, size_t> &map) const;
 
         size_t FindIndex(const string &name, const std::unordered_map<std::string, size_t> &map) const;
 
-        void AddPlaceAffectedTransition(std::set<Transition *> &trans_set, Place *place_ptr) const;
+        size_t FindIndex(const string &name, const NameIndex &name_index) const;
+
+        // throws InvalidWeight or InvalidServerCount
+        static void CheckTransition(const CreateTransitionCmd &cmd);
+
+        // the first batch is taken over without copying
+        template<typename Cmd>
+        static void AppendCmds(vector<Cmd> &cmd_list, vector<Cmd> &&new_cmd_list)
+        {
+            if (cmd_list.empty())
+            {
+                cmd_list = std::move(new_cmd_list);
+                return;
+            }
+            cmd_list.insert(cmd_list.end(), std::make_move_iterator(new_cmd_list.begin()),
+                            std::make_move_iterator(new_cmd_list.end()));
+        }
+
+        void BuildConflictSets(PetriNet &petri_net) const;
 
 
     public:
@@ -255,37 +654,232 @@ namespace PetriNetModel
 
         size_t AddPlace(const string &name, Mark mark);
 
+        // Adds the places in order and returns the index of the first. Throws DuplicateName without adding any of
+        // them if a name is taken.
+        size_t AddPlaces(vector<CreatePlaceCmd> place_list);
+
         void AddTransition(const string &name, Transition::FiringTimeFuncType firing_time_func,
                            Transition::ResamplingPolicy resampling_policy = Transition::ResamplingPolicy::Different);
 
+        // Immediate transitions fire in zero time as soon as they are enabled, before any timed transition. Among the
+        // enabled immediate transitions the ones with the highest priority fire first; conflicts between them are
+        // resolved randomly in proportion to their weights, which have to be positive and finite.
+        void AddImmediateTransition(const string &name, double weight = 1.0, int priority = 0);
+
+        // Adds the transitions, timed or immediate, in order and returns the index of the first. Throws DuplicateName,
+        // InvalidWeight or InvalidServerCount without adding any of them.
+        size_t AddTransitions(vector<CreateTransitionCmd> transition_list);
+
         void AddArc(const string &transition_name, const string &place_name, Arc::Type type, Mark multiplicity = 1);
 
+        // by the indices AddPlace and the order of the transitions give, for loaders that resolved the names already
+        void AddArc(size_t transition_index, size_t place_index, Arc::Type type, Mark multiplicity = 1);
+
+        // Adds the arcs by index, e.g. {t_index, p_index, Arc::Type::Input, 1}. Throws NameNotFound without adding
+        // any of them if an index is out of range.
+        void AddArcs(vector<CreateArcCmd> arc_list);
+
+        // preallocates for a model of known size
+        void Reserve(size_t place_count, size_t transition_count, size_t arc_count);
+
+        size_t AddFluidPlace(const string &name, double level,
+                             double capacity = std::numeric_limits<double>::infinity());
+
+        // `value` is the flow rate for Inflow/Outflow arcs and the level for Threshold/Inhibitor arcs
+        void AddFluidArc(const string &transition_name, const string &fluid_place_name, FluidArc::Type type,
+                         double value);
+
+        // throws InvalidServerCount for MultipleServer with fewer than one server
+        void SetServerPolicy(const string &transition_name, Transition::ServerPolicy server_policy,
+                             Mark server_count = 1);
+
+        void SetMarkingDependentRate(const string &transition_name,
+                                     Transition::MarkingDependentRateFuncType rate_func);
+
+        // Importance sampling: the transition fires `factor` times faster during simulation, and the likelihood
+        // ratio of every trajectory is tracked so that rewards stay unbiased.
+        void SetBias(const string &transition_name, double factor);
+
+        // Balanced failure biasing: whenever a repair (any transition not listed) is enabled, the next event is a
+        // failure with `failure_probability`, and the enabled failures are equally likely. The total rate of every
+        // marking is kept, so only the jump chain is biased. Applied on top of SetBias factors.
+        void SetFailureBiasing(const vector<string> &failure_transition_names, double failure_probability);
+
+        // A replication stops as soon as the predicate holds, e.g. at a system failure for time-to-failure metrics.
+        // It may only read the given places: it is re-evaluated only after a firing that changes one of them.
+        void SetStoppingPredicate(const vector<string> &place_names, const StoppingPredicateType &predicate);
+
+        // Adds `count` exchangeable copies of `subnet` as a counting abstraction: every local place becomes one place
+        // named "<name>.<local name>" holding the number of copies in that local state, and every local transition
+        // becomes one transition whose rate is multiplied by the number of copies enabling it.
+        void AddReplicatedSubnet(const string &name, const SubnetTemplate &subnet, Mark count);
+
+        static string ReplicaName(const string &subnet_name, const string &local_name)
+        { return subnet_name + "." + local_name; }
+
+        // Registers the rate of the given exponential transitions as a differentiable parameter: simulations then
+        // track the score, i.e. the derivative of the log-likelihood of the trajectory when all these rates grow by
+        // the same amount, so derivatives of rewards come out of the same run (see Estimating::CumulativeDerivative).
+        size_t AddRateParameter(const string &name, const vector<string> &transition_names);
+
+        size_t GetRateParameterIndex(const string &name) const
+        { return FindIndex(name, _rate_parameter_name_index); }
+
         void Commit();
 
         size_t GetPlaceIndex(const string &name) const
-        { return FindIndex(name, _place_name_map); }
+        { return FindIndex(name, _place_name_index); }
+
+        size_t GetFluidPlaceIndex(const string &name) const
+        { return FindIndex(name, _fluid_place_name_index); }
+
+        size_t GetTransitionIndex(const string &name) const
+        { return FindIndex(name, _transition_name_index); }
+
+        const vector<CreatePlaceCmd> &GetPlaceCmdList() const
+        { return _place_cmd; }
+
+        const vector<CreateTransitionCmd> &GetTransitionCmdList() const
+        { return _transition_cmd; }
+
+        const vector<CreateArcCmd> &GetArcCmdList() const
+        { return _arc_cmd; }
+
+        const vector<CreateFluidPlaceCmd> &GetFluidPlaceCmdList() const
+        { return _fluid_place_cmd; }
+
+        const vector<CreateRateParameterCmd> &GetRateParameterCmdList() const
+        { return _rate_parameter_cmd; }
+
+        // whether the arc counts the busy servers of its transition
+        bool IsDegreeArc(const CreateArcCmd &cmd) const
+        {
+            const auto &trans_cmd = _transition_cmd[cmd.transition_index];
+            return cmd.counts_degree ||
+                   (cmd.type == Arc::Type::Input && !trans_cmd.explicit_degree_arcs &&
+                    trans_cmd.server_policy != Transition::ServerPolicy::SingleServer);
+        }
 
         PetriNet CreatePetriNet() const;
 
     };
 
+    // A snapshot of the dynamic state of a PetriNet: marking, fluid levels, transition clocks and the engine's
+    // bookkeeping. Restoring one into a net created by the same creator resumes the trajectory exactly. Reusing a
+    // snapshot object for nets of the same size does not allocate.
+    class PetriNetState
+    {
+        friend class PetriNet;
+
+    private:
+        struct FluidState
+        {
+            double level;
+            double rate;
+            int direction;
+        };
+        vector<Mark> _mark_list;
+        vector<FluidState> _fluid_list;
+        vector<Transition::Clock> _clock_list;
+        FiringQueue _firing_queue;
+        vector<std::pair<size_t, long>> _pending_firing;
+        double _time = 0.0;
+        double _next_firing_time = 0.0;
+        size_t _firing_transition_index = 0; //the transition count if none
+        size_t _fluid_event_place_index = 0; //the fluid place count if none
+        double _fluid_event_level = 0.0;
+        size_t _zero_time_fluid_event_count = 0;
+        double _likelihood_ratio = 1.0;
+        double _rate_difference = 0.0;
+        double _firing_likelihood_factor = 1.0;
+        vector<double> _score;
+        bool _stopped = false;
+    public:
+        double GetTime() const
+        { return _time; }
+    };
+
     class PetriNet
     {
         friend class PetriNetCreator;
 
     private:
+        // immediate transitions of one priority that (transitively) share input places
+        struct ConflictSet
+        {
+            int priority;
+            vector<Transition *> transition_list;
+            AliasTable alias_table;
+        };
+
         const PetriNetCreator &_creator;
         vector<Place> _place_list;
         vector<Transition> _transition_list;
-        vector<Arc> _arc_list;
+        // The adjacency of the net in flat arrays, which the transitions and fluid places hold spans of, so creating a
+        // net allocates the same few arrays whatever its size.
+        vector<Arc> _arc_list; //by transition, and its input, output and inhibitor arcs in that order
+        vector<Arc *> _degree_arc_list;
+        vector<Transition *> _affected_transition_list; //of the fluid places, then of the transitions
+        vector<size_t> _affected_conflict_set_list;
+        vector<FluidPlace> _fluid_place_list;
+        vector<FluidArc> _fluid_arc_list;
+        FluidPlace *_fluid_event_place = nullptr; //the place reaching _fluid_event_level at _next_firing_time
+        double _fluid_event_level = 0.0;
+        size_t _zero_time_fluid_event_count = 0;
+        vector<ConflictSet> _conflict_set_list; //sorted by descending priority
+        std::set<size_t> _unresolved_conflict_set; //the conflict sets that may have an enabled transition
+        vector<Transition *> _changed_transition;
+        bool _markovian = false; //use the next-reaction engine
+        FiringQueue _firing_queue;
+        vector<double> _transition_rate; //kept by the next-reaction engine
+        double _total_rate = 0.0;
+
+        double _tau_leaping_epsilon = 0.0; //0 for exact simulation
+        vector<vector<std::pair<size_t, Mark>>> _state_change; //(place index, mark change) of every transition
+        vector<double> _propensity;
+        vector<bool> _critical_transition;
+        vector<long> _leap_marking;
+        vector<double> _leap_mean_change; //scratch space of LeapSize
+        vector<double> _leap_change_variance;
+        vector<std::pair<size_t, long>> _pending_firing; //(transition index, firing count) of the next step
+
+        bool _importance_sampling = false;
+        vector<double> _bias;
+        vector<bool> _failure_transition;
+        double _failure_biasing_probability = 0.0;
+        vector<double> _biased_propensity;
+        double _likelihood_ratio = 1.0; //at _time
+        double _rate_difference = 0.0; //original minus biased total rate of the current marking
+        double _firing_likelihood_factor = 1.0; //original over biased rate of the next firing
+
+        vector<SplitMixUniformRandomNumberGenerator> _substream_list; //empty without common random numbers
+        vector<uint64_t> _name_hash_list;
+        uint64_t _substream_seed = 0;
+        uint64_t _replication_index = 0; //of the next Reset
+        bool _antithetic_replication = false;
+
+        vector<vector<size_t>> _parameter_transition_list; //transition indices of every rate parameter
+        vector<vector<size_t>> _transition_parameter_list; //rate parameters of every transition
+        vector<double> _score; //at _time
+        double _horizon = std::numeric_limits<double>::infinity();
+
+        StoppingPredicateType _stopping_predicate;
+        vector<bool> _stopping_trigger; //per transition, whether its firing changes a place the predicate reads
+        bool _stopping_place_changed = false;
+        bool _stopped = false;
+
+        vector<std::pair<size_t, long>> *_firing_log = nullptr; //every firing as (transition index, count)
 
         double _time = 0.0;
         double _next_firing_time = 0.0;
         Transition *_firing_transition = nullptr;
 
-        PetriNet(const PetriNetCreator &creator, size_t place_count, size_t transition_count, size_t arc_count) :
-                _creator(creator), _place_list(place_count), _transition_list(transition_count), _arc_list(arc_count)
-        { }
+        // the transitions are only reserved, the creator constructs them in place
+        PetriNet(const PetriNetCreator &creator, size_t place_count, size_t transition_count, size_t arc_count,
+                 size_t fluid_place_count, size_t fluid_arc_count) :
+                _creator(creator), _place_list(place_count), _arc_list(arc_count),
+                _fluid_place_list(fluid_place_count), _fluid_arc_list(fluid_arc_count)
+        { _transition_list.reserve(transition_count); }
 
     public:
 
@@ -297,6 +891,30 @@ namespace PetriNetModel
 
         void NextState(UniformRandomNumberGenerator &generator);
 
+        bool HasStoppingPredicate() const
+        { return (bool) _stopping_predicate; }
+
+        // Appends every firing, immediate ones and leaps included, to the log as (transition index, count), e.g.
+        // for trace recording. nullptr switches logging off.
+        void SetFiringLog(vector<std::pair<size_t, long>> *firing_log)
+        { _firing_log = firing_log; }
+
+        bool HasFluidPlaces() const
+        { return !_fluid_place_list.empty(); }
+
+        // Trace replay: the marking and the time are driven from outside, without any clock bookkeeping, so that
+        // rewards can be evaluated on recorded trajectories.
+        void ReplayMarking(const vector<Mark> &mark_list);
+
+        void ReplayFiring(size_t t_index, long count);
+
+        // the current marking lasts from `time` to `next_time`
+        void ReplayTime(double time, double next_time);
+
+        // whether the stopping predicate of the creator holds in the current marking
+        bool IsStopped() const
+        { return _stopped; }
+
         double GetTime() const
         { return _time; }
 
@@ -306,6 +924,78 @@ namespace PetriNetModel
         double GetNextFiringTime() const
         { return _next_firing_time; }
 
+        // all timed transitions are exponential, so the next-reaction engine is used
+        bool IsMarkovian() const
+        { return _markovian; }
+
+        // Total rate of the current marking, kept up to date by the next-reaction engine at no extra cost. Only
+        // valid for Markovian nets simulated exactly without importance sampling.
+        double GetTotalRate() const
+        { return std::max(_total_rate, 0.0); }
+
+        // Approximate simulation for large populations: every step fires a Poisson number of each transition, with
+        // the step size chosen so that no rate changes by more than about epsilon (Cao, Gillespie and Petzold).
+        // Transitions that could exhaust their input places and transitions with inhibitor arcs fire exactly, and
+        // plain next-event steps are taken when leaping does not pay off. Requires a Markovian net without
+        // immediate transitions and rate parameters. An epsilon of 0 switches back to exact simulation.
+        void SetTauLeaping(double epsilon);
+
+        void SaveState(PetriNetState &state) const;
+
+        // the state must have been saved from a net of the same creator
+        void RestoreState(const PetriNetState &state);
+
+        // Common random numbers: every timed transition draws its firing times from its own stream, seeded from the
+        // seed, the replication index and the transition name, so model variants that share transition names see
+        // the same randomness. Every Reset starts the next replication, the first one being first_replication.
+        // Tau-leaping, importance sampling and immediate transitions keep using the generator passed in.
+        void SetCommonRandomNumbers(uint64_t seed, uint64_t first_replication = 0);
+
+        // the next Reset repeats the last replication with antithetic streams
+        void RepeatReplication();
+
+        // Replaces the firing time function of a timed transition, e.g. to move a compiled net to another point of
+        // a parameter sweep. Takes effect from the next Reset.
+        void SetFiringTimeFunc(size_t t_index, Transition::FiringTimeFuncType firing_time_func);
+
+        // Rewards are observed up to the horizon, so the current sojourn ends at min(GetNextFiringTime(), horizon)
+        // for the scores and fluid levels below, and at GetTime() once stopped. The simulators set it to their end
+        // time.
+        void SetHorizon(double horizon)
+        { _horizon = horizon; }
+
+        size_t GetRateParameterCount() const
+        { return _parameter_transition_list.size(); }
+
+        // the score of a rate parameter at the end of the current sojourn, for transient rewards
+        double GetScore(size_t parameter_index) const;
+
+        // the score of a rate parameter averaged over the current sojourn, for cumulative rewards
+        double GetMeanScore(size_t parameter_index) const;
+
+        // Redraws the clocks of exponential transitions (except Identical ones), e.g. so that trajectories restored
+        // from one state diverge right away. The other clocks are kept.
+        void RenewMemorylessClocks(UniformRandomNumberGenerator &generator);
+
+        bool IsTauLeaping() const
+        { return _tau_leaping_epsilon > 0.0; }
+
+        // whether the creator biased any transition
+        bool IsImportanceSampling() const
+        { return _importance_sampling; }
+
+        // The likelihood ratio of the trajectory up to `time` in [GetTime(), GetNextFiringTime()]; rewards observed
+        // at `time` are multiplied by it. Always 1 without importance sampling.
+        double GetLikelihoodRatio(double time) const
+        { return _likelihood_ratio * std::exp(-_rate_difference * (time - _time)); }
+
+        // the likelihood ratio averaged over [GetTime(), time], for cumulative rewards
+        double GetMeanLikelihoodRatio(double time) const
+        {
+            double exponent = _rate_difference * (time - _time);
+            return exponent == 0.0 ? _likelihood_ratio : _likelihood_ratio * -std::expm1(-exponent) / exponent;
+        }
+
         Mark GetPlaceMark(size_t p_index) const
         { return _place_list[p_index].GetMark(); }
 
@@ -315,8 +1005,100 @@ namespace PetriNetModel
             return GetPlaceMark(p_index);
         }
 
+        // The level at the horizon if the current sojourn reaches it, as in the last state of a replication, and at
+        // GetTime() otherwise or once stopped; for transient rewards. Levels change linearly within a sojourn.
+        double GetFluidLevel(size_t f_index) const
+        {
+            bool at_horizon = !_stopped && _next_firing_time >= _horizon && _horizon > _time;
+            return _fluid_place_list[f_index].LevelAfter(at_horizon ? ObservedDuration() : 0.0);
+        }
+
+        double GetFluidLevel(const string &f_name) const
+        { return GetFluidLevel(_creator.GetFluidPlaceIndex(f_name)); }
+
+        // the level averaged over the current sojourn up to the horizon, for cumulative rewards
+        double GetMeanFluidLevel(size_t f_index) const
+        {
+            const FluidPlace &place = _fluid_place_list[f_index];
+            return (place.GetLevel() + place.LevelAfter(ObservedDuration())) / 2.0;
+        }
+
+        // the timed transitions sampled again after t_index fires, by index
+        vector<size_t> GetAffectedTransitionIndex(size_t t_index) const;
+
+        // the conflict sets of the immediate transitions affected by t_index
+        vector<size_t> GetAffectedConflictSet(size_t t_index) const
+        {
+            Span<size_t> affected_set = _transition_list[t_index].GetAffectedConflictSet();
+            return vector<size_t>(affected_set.begin(), affected_set.end());
+        }
+
+        size_t GetConflictSetCount() const
+        { return _conflict_set_list.size(); }
+
+        // the immediate transitions of a conflict set, by index; the sets are sorted by descending priority
+        vector<size_t> GetConflictSetTransitionIndex(size_t set_index) const;
+
     private:
+        // the part of the current sojourn that rewards observe: none once stopped, and 0 if it is unbounded
+        double ObservedDuration() const
+        {
+            if (_stopped)
+            {
+                return 0.0;
+            }
+            double duration = std::min(_next_firing_time, _horizon) - _time;
+            return duration > 0.0 && duration < std::numeric_limits<double>::infinity() ? duration : 0.0;
+        }
+
         void FindNextFiringTransition();
+
+        void UpdateTransitions(Transition *fired_transition, UniformRandomNumberGenerator &generator);
+
+        void UpdateTransitions(Span<Transition *> affected_trans, Span<size_t> affected_set,
+                               UniformRandomNumberGenerator &generator);
+
+        void AdvanceFluid(double duration);
+
+        void UpdateFluidRates();
+
+        void FindNextFluidEvent();
+
+        void UpdateTransition(Transition *trans_ptr, UniformRandomNumberGenerator &generator);
+
+        void FireImmediateTransitions(UniformRandomNumberGenerator &generator);
+
+        Transition *SelectImmediateTransition(const ConflictSet &conflict_set,
+                                              UniformRandomNumberGenerator &generator) const;
+
+        void InitDirectMethod();
+
+        void PlanLeap(UniformRandomNumberGenerator &generator);
+
+        void PlanBiasedStep(UniformRandomNumberGenerator &generator);
+
+        void ResetState(UniformRandomNumberGenerator &generator);
+
+        void AdvanceState(UniformRandomNumberGenerator &generator);
+
+        // re-evaluates the stopping predicate if one of its places changed
+        void UpdateStopped()
+        {
+            if (_stopping_place_changed)
+            {
+                _stopped = _stopping_predicate(*this);
+                _stopping_place_changed = false;
+            }
+        }
+
+        double ScoreDrift(size_t parameter_index) const;
+
+        void UpdateScore(double duration, size_t fired_index);
+
+        double LeapSize();
+
+        size_t SelectByPropensity(double total_propensity, bool critical_only,
+                                  UniformRandomNumberGenerator &generator) const;
     };
 }
 #endif //SPNP_PETRI_NET_MODEL_H
@@ -0,0 +1,73 @@
+//
+
+#include <cmath>
+#include <algorithm>
+#include "PetriNetModel.h"
+
+namespace PetriNetModel
+{
+    // Likelihood-ratio (score function) sensitivities. When the rates lambda_t of the transitions of a parameter
+    // all grow by d theta, the log-likelihood of a trajectory grows by d theta times the score
+    //     sum over firings of these transitions of 1 / lambda_t - integral of sum over them of rate scale_t ds,
+    // so d E[f] / d theta = E[f * score]. The score is piecewise linear in time: it jumps at firings and drifts down
+    // with the total rate scale of the enabled transitions of the parameter in between.
+    double PetriNet::ScoreDrift(size_t parameter_index) const
+    {
+        double drift = 0.0;
+        for (size_t t_index:_parameter_transition_list[parameter_index])
+        {
+            const Transition &trans = _transition_list[t_index];
+            if (_importance_sampling)
+            {
+                drift += _propensity[t_index] / trans.GetExpSampler()->lambda;
+            } else
+            {
+                drift += trans.GetCurrentRateScale();
+            }
+        }
+        return drift;
+    }
+
+    void PetriNet::UpdateScore(double duration, size_t fired_index)
+    {
+        for (size_t p_index = 0; p_index < _score.size(); p_index++)
+        {
+            if (duration > 0.0)
+            {
+                _score[p_index] -= ScoreDrift(p_index) * duration;
+            }
+        }
+        if (fired_index < _transition_parameter_list.size())
+        {
+            for (size_t p_index:_transition_parameter_list[fired_index])
+            {
+                _score[p_index] += 1.0 / _transition_list[fired_index].GetExpSampler()->lambda;
+            }
+        }
+    }
+
+    double PetriNet::GetScore(size_t parameter_index) const
+    {
+        double duration = ObservedDuration(); //0 once stopped, since the trajectory ends at the stop
+        if (duration == 0.0)
+        {
+            return _score[parameter_index];
+        }
+        return _score[parameter_index] - ScoreDrift(parameter_index) * duration;
+    }
+
+    // Averaged with the likelihood ratio exp(-r s) of importance sampling as weight, so that multiplied by
+    // GetMeanLikelihoodRatio it gives the average of their product.
+    double PetriNet::GetMeanScore(size_t parameter_index) const
+    {
+        double duration = ObservedDuration();
+        if (duration == 0.0)
+        {
+            return _score[parameter_index];
+        }
+        double exponent = _rate_difference * duration;
+        double mean_offset = std::abs(exponent) < 1e-8 ? duration / 2.0 :
+                             duration * (1.0 / exponent - 1.0 / std::expm1(exponent));
+        return _score[parameter_index] - ScoreDrift(parameter_index) * mean_offset;
+    }
+}
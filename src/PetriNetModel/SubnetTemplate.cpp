@@ -0,0 +1,31 @@
+//
+
+#include "PetriNetModel.h"
+
+namespace PetriNetModel
+{
+    void SubnetTemplate::AddPlace(const string &name, Mark mark)
+    {
+        if (_place_name_map.count(name) > 0)
+        {
+            throw DuplicateName();
+        }
+        _place_name_map[name] = _place_cmd.size();
+        _place_cmd.push_back(CreatePlaceCmd{name, mark});
+    }
+
+    void SubnetTemplate::AddTransition(const string &name, double rate)
+    {
+        if (!_transition_name_map.emplace(name, _transition_rate_list.size()).second)
+        {
+            throw DuplicateName();
+        }
+        _transition_rate_list.push_back(std::make_pair(name, rate));
+    }
+
+    void SubnetTemplate::AddArc(const string &transition_name, const string &place_name, Arc::Type type,
+                                Mark multiplicity)
+    {
+        _arc_list.push_back(std::make_tuple(transition_name, place_name, type, multiplicity));
+    }
+}
@@ -0,0 +1,205 @@
+//
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "PetriNetModel.h"
+
+namespace PetriNetModel
+{
+    // transitions which can fire fewer times than this before exhausting an input place are fired exactly
+    static const long CriticalFiringCount = 10;
+
+    // leaping is only worth it if a step covers at least this many expected events
+    static const double MinLeapEventCount = 10.0;
+
+    void PetriNet::SetTauLeaping(double epsilon)
+    {
+        if (epsilon > 0.0 && (!_markovian || !_conflict_set_list.empty() || _importance_sampling ||
+                              !_parameter_transition_list.empty()))
+        {
+            throw TauLeapingNotSupported();
+        }
+        _tau_leaping_epsilon = epsilon;
+        InitDirectMethod();
+    }
+
+    void PetriNet::InitDirectMethod()
+    {
+        _state_change.assign(_transition_list.size(), {});
+        for (size_t t_index = 0; t_index < _transition_list.size(); t_index++)
+        {
+            std::unordered_map<size_t, Mark> change;
+            for (const Arc &arc:_transition_list[t_index]._input_arcs)
+            {
+                change[arc.GetPlace() - _place_list.data()] -= arc.GetMultiplicity();
+            }
+            for (const Arc &arc:_transition_list[t_index]._output_arcs)
+            {
+                change[arc.GetPlace() - _place_list.data()] += arc.GetMultiplicity();
+            }
+            for (const auto &place_change:change)
+            {
+                if (place_change.second != 0)
+                {
+                    _state_change[t_index].push_back(place_change);
+                }
+            }
+        }
+        _propensity.assign(_transition_list.size(), 0.0);
+        _biased_propensity.assign(_transition_list.size(), 0.0);
+        _critical_transition.assign(_transition_list.size(), false);
+        _leap_marking.assign(_place_list.size(), 0);
+        _leap_mean_change.assign(_place_list.size(), 0.0);
+        _leap_change_variance.assign(_place_list.size(), 0.0);
+    }
+
+    void PetriNet::PlanLeap(UniformRandomNumberGenerator &generator)
+    {
+        _pending_firing.clear();
+        double total_propensity = 0.0;
+        double critical_propensity = 0.0;
+        vector<bool> &critical = _critical_transition;
+        for (size_t t_index = 0; t_index < _transition_list.size(); t_index++)
+        {
+            const Transition &trans = _transition_list[t_index];
+            _propensity[t_index] = trans.GetExpRate(*this);
+            total_propensity += _propensity[t_index];
+            critical[t_index] = false;
+            if (_propensity[t_index] <= 0.0)
+            {
+                continue;
+            }
+            long firing_bound = std::numeric_limits<long>::max();
+            for (const Arc &arc:trans._input_arcs)
+            {
+                firing_bound = std::min(firing_bound, (long) (arc.GetPlace()->GetMark() / arc.GetMultiplicity()));
+            }
+            critical[t_index] = firing_bound < CriticalFiringCount || !trans._inhibitor_arcs.empty();
+            if (critical[t_index])
+            {
+                critical_propensity += _propensity[t_index];
+            }
+        }
+        if (total_propensity <= 0.0)
+        {
+            _next_firing_time = std::numeric_limits<double>::infinity();
+            return;
+        }
+
+        double leap_size = LeapSize();
+        if (!std::isfinite(leap_size) || leap_size * total_propensity < MinLeapEventCount)
+        {
+            // plain next-event step, also when the non-critical transitions change nothing
+            _next_firing_time = _time - std::log(1.0 - generator.GetVariate()) / total_propensity;
+            _pending_firing.push_back(
+                    std::make_pair(SelectByPropensity(total_propensity, false, generator), 1));
+            return;
+        }
+
+        double critical_time = std::numeric_limits<double>::infinity();
+        if (critical_propensity > 0.0)
+        {
+            critical_time = -std::log(1.0 - generator.GetVariate()) / critical_propensity;
+        }
+        while (true)
+        {
+            double tau = std::min(leap_size, critical_time);
+            _pending_firing.clear();
+            if (critical_time <= leap_size)
+            {
+                _pending_firing.push_back(
+                        std::make_pair(SelectByPropensity(critical_propensity, true, generator), 1));
+            }
+            for (size_t t_index = 0; t_index < _transition_list.size(); t_index++)
+            {
+                if (_propensity[t_index] > 0.0 && !critical[t_index])
+                {
+                    long count = PoissonVariate(_propensity[t_index] * tau, generator);
+                    if (count > 0)
+                    {
+                        _pending_firing.push_back(std::make_pair(t_index, count));
+                    }
+                }
+            }
+            // the step is rejected and halved if it would leave a negative marking
+            vector<long> &marking = _leap_marking;
+            for (size_t p_index = 0; p_index < _place_list.size(); p_index++)
+            {
+                marking[p_index] = _place_list[p_index].GetMark();
+            }
+            bool negative = false;
+            for (const auto &firing:_pending_firing)
+            {
+                for (const auto &change:_state_change[firing.first])
+                {
+                    marking[change.first] += change.second * firing.second;
+                    negative = negative || marking[change.first] < 0;
+                }
+            }
+            if (!negative)
+            {
+                _next_firing_time = _time + tau;
+                return;
+            }
+            leap_size /= 2.0;
+        }
+    }
+
+    double PetriNet::LeapSize()
+    {
+        const vector<bool> &critical = _critical_transition;
+        vector<double> &mean_change = _leap_mean_change;
+        vector<double> &change_variance = _leap_change_variance;
+        std::fill(mean_change.begin(), mean_change.end(), 0.0);
+        std::fill(change_variance.begin(), change_variance.end(), 0.0);
+        for (size_t t_index = 0; t_index < _transition_list.size(); t_index++)
+        {
+            if (_propensity[t_index] <= 0.0 || critical[t_index])
+            {
+                continue;
+            }
+            for (const auto &change:_state_change[t_index])
+            {
+                mean_change[change.first] += change.second * _propensity[t_index];
+                change_variance[change.first] += (double) change.second * change.second * _propensity[t_index];
+            }
+        }
+        // Every place that the leap changes is bounded, not only the reactants: a place filled from empty by a
+        // transition without inputs would otherwise allow an unbounded leap.
+        double leap_size = std::numeric_limits<double>::infinity();
+        for (size_t p_index = 0; p_index < _place_list.size(); p_index++)
+        {
+            double bound = std::max(_tau_leaping_epsilon * _place_list[p_index].GetMark(), 1.0);
+            if (mean_change[p_index] != 0.0)
+            {
+                leap_size = std::min(leap_size, bound / std::abs(mean_change[p_index]));
+            }
+            if (change_variance[p_index] > 0.0)
+            {
+                leap_size = std::min(leap_size, bound * bound / change_variance[p_index]);
+            }
+        }
+        return leap_size;
+    }
+
+    size_t PetriNet::SelectByPropensity(double total_propensity, bool critical_only,
+                                        UniformRandomNumberGenerator &generator) const
+    {
+        double propensity = generator.GetVariate() * total_propensity;
+        size_t selected = 0;
+        for (size_t t_index = 0; t_index < _transition_list.size(); t_index++)
+        {
+            if ((!critical_only || _critical_transition[t_index]) && _propensity[t_index] > 0.0)
+            {
+                selected = t_index;
+                propensity -= _propensity[t_index];
+                if (propensity < 0.0)
+                {
+                    break;
+                }
+            }
+        }
+        return selected;
+    }
+}
@@ -2,20 +2,26 @@
 // Created by wangnan on 16-4-22.
 //
 
+#include <algorithm>
+#include <limits>
 #include "PetriNetModel.h"
 
 namespace PetriNetModel
 {
-    void Transition::InputArcChanged(double current_time, double uniform_rand_num)
+    void Transition::InputArcChanged(const PetriNet &petri_net, double current_time,
+                                     UniformRandomNumberGenerator &generator)
     {
-        double enabled = IsEnabled();
+        double rate_scale = IsEnabled() ? RateScale(petri_net) : 0.0;
+        bool enabled = rate_scale > 0.0;
         switch (_state)
         {
             case State::JustFired:
+            case State::Disable_NeverEnabledSinceFire:
                 if (enabled)
                 {
-                    _last_sample_value = _sample_func(uniform_rand_num);
-                    _firing_time = current_time + _last_sample_value;
+                    _rate_scale = rate_scale;
+                    _last_sample_value = _sample_func(generator.GetVariate());
+                    _firing_time = current_time + _last_sample_value / _rate_scale;
                     _state = State::Enable;
                 } else
                 {
@@ -26,10 +32,15 @@ namespace PetriNetModel
             case State::Enable:
                 if (enabled)
                 {
-                    return;
+                    // the clock keeps running, only at a different speed
+                    if (rate_scale != _rate_scale)
+                    {
+                        _firing_time = current_time + (_firing_time - current_time) * _rate_scale / rate_scale;
+                        _rate_scale = rate_scale;
+                    }
                 } else
                 {
-                    _left_time = _firing_time - current_time;
+                    _left_time = (_firing_time - current_time) * _rate_scale;
                     _firing_time = -1;
                     _state = State::Disable_EnabledSinceFire;
                 }
@@ -37,64 +48,85 @@ namespace PetriNetModel
             case State::Disable_EnabledSinceFire:
                 if (enabled)
                 {
+                    _rate_scale = rate_scale;
                     switch (_policy)
                     {
                         case ResamplingPolicy::Identical:
-                            _firing_time = current_time + _last_sample_value;
+                            _firing_time = current_time + _last_sample_value / _rate_scale;
                             break;
                         case ResamplingPolicy::Resume:
-                            _firing_time = current_time + _left_time;
+                            _firing_time = current_time + _left_time / _rate_scale;
                             break;
                         case ResamplingPolicy::Different:
                         default:
-                            _firing_time = current_time + _sample_func(uniform_rand_num);
+                            _last_sample_value = _sample_func(generator.GetVariate());
+                            _firing_time = current_time + _last_sample_value / _rate_scale;
                             break;
                     }
                     _state = State::Enable;
-                } else
-                {
-                    return;
                 }
-            case State::Disable_NeverEnabledSinceFire:
-                if (enabled)
-                {
-                    _last_sample_value = _sample_func(uniform_rand_num);
-                    _firing_time = current_time + _last_sample_value;
-                    _state = State::Enable;
-                } else
+                break;
+        }
+    }
+
+    void Transition::ExponentialInputArcChanged(const PetriNet &petri_net, double current_time,
+                                                UniformRandomNumberGenerator &generator)
+    {
+        if (_state == State::JustFired)
+        {
+            _left_time = _sample_func(generator.GetVariate());
+            _firing_time = -1;
+            _state = State::Disable_EnabledSinceFire;
+        }
+        double rate_scale = IsEnabled() ? RateScale(petri_net) : 0.0;
+        if (rate_scale > 0.0)
+        {
+            if (_state == State::Enable)
+            {
+                if (rate_scale != _rate_scale)
                 {
-                    return;
+                    _firing_time = current_time + (_firing_time - current_time) * _rate_scale / rate_scale;
+                    _rate_scale = rate_scale;
                 }
+            } else
+            {
+                _rate_scale = rate_scale;
+                _firing_time = current_time + _left_time / _rate_scale;
+                _state = State::Enable;
+            }
+        } else if (_state == State::Enable)
+        {
+            _left_time = (_firing_time - current_time) * _rate_scale;
+            _firing_time = -1;
+            _state = State::Disable_EnabledSinceFire;
         }
     }
 
-    void Transition::AddArc(Arc *arc_ptr, Arc::Type type)
+    void Transition::RenewExponentialClock(double current_time, UniformRandomNumberGenerator &generator)
     {
-        switch (type)
+        if (GetExpSampler() == nullptr || _policy == ResamplingPolicy::Identical)
         {
-            case Arc::Type::Input:
-                _input_arcs.push_back(arc_ptr);
-                break;
-            case Arc::Type::Output:
-                _output_arcs.push_back(arc_ptr);
-                break;
-            case Arc::Type::Inhibitor:
-                _inhibitor_arcs.push_back(arc_ptr);
-                break;
+            return;
+        }
+        if (_state == State::Enable)
+        {
+            _last_sample_value = _sample_func(generator.GetVariate());
+            _firing_time = current_time + _last_sample_value / _rate_scale;
+        } else if (_state == State::Disable_EnabledSinceFire)
+        {
+            _left_time = _sample_func(generator.GetVariate());
         }
     }
 
     void Transition::Fire()
     {
-        for (Arc *arc_ptr:_input_arcs)
+        for (const Arc &arc:_input_arcs)
         {
-            Place *place = arc_ptr->GetPlace();
-            place->ModifyMark(-arc_ptr->GetMultiplicity());
+            arc.GetPlace()->ModifyMark(-arc.GetMultiplicity());
         }
-        for (Arc *arc_ptr:_output_arcs)
+        for (const Arc &arc:_output_arcs)
         {
-            Place *place = arc_ptr->GetPlace();
-            place->ModifyMark(arc_ptr->GetMultiplicity());
+            arc.GetPlace()->ModifyMark(arc.GetMultiplicity());
         }
         _state = State::JustFired;
     }
@@ -102,22 +134,58 @@ namespace PetriNetModel
 
     bool Transition::IsEnabled() const
     {
-        for (Arc *arc_ptr:_input_arcs)
+        for (const Arc &arc:_input_arcs)
         {
-            Mark place_mark = arc_ptr->GetPlace()->GetMark();
-            if (arc_ptr->GetMultiplicity() > place_mark)
+            Mark place_mark = arc.GetPlace()->GetMark();
+            if (arc.GetMultiplicity() > place_mark)
             {
                 return false;
             }
         }
-        for (Arc *arc_ptr:_inhibitor_arcs)
+        for (const Arc &arc:_inhibitor_arcs)
         {
-            Mark place_mark = arc_ptr->GetPlace()->GetMark();
-            if (arc_ptr->GetMultiplicity() <= place_mark)
+            Mark place_mark = arc.GetPlace()->GetMark();
+            if (arc.GetMultiplicity() <= place_mark)
+            {
+                return false;
+            }
+        }
+        for (FluidArc *arc_ptr:_fluid_guard_arcs)
+        {
+            if (!arc_ptr->IsSatisfied())
             {
                 return false;
             }
         }
         return true;
     }
-}
\ No newline at end of file
+
+    Mark Transition::EnablingDegree() const
+    {
+        Mark degree = std::numeric_limits<Mark>::max();
+        for (Arc *arc_ptr:_degree_arcs)
+        {
+            degree = std::min(degree, arc_ptr->GetPlace()->GetMark() / arc_ptr->GetMultiplicity());
+        }
+        return degree;
+    }
+
+    double Transition::RateScale(const PetriNet &petri_net) const
+    {
+        double rate_scale = _rate_func ? _rate_func(petri_net) : 1.0;
+        if (_degree_arcs.empty())
+        {
+            return rate_scale;
+        }
+        switch (_server_policy)
+        {
+            case ServerPolicy::MultipleServer:
+                return rate_scale * std::min(EnablingDegree(), _server_count);
+            case ServerPolicy::InfiniteServer:
+                return rate_scale * EnablingDegree();
+            case ServerPolicy::SingleServer:
+            default:
+                return rate_scale;
+        }
+    }
+}
@@ -0,0 +1,285 @@
+//
+
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "ProcessSimulating.h"
+
+namespace Simulating
+{
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared slots need address-free atomics");
+
+    // Word 0 is the stop flag; every worker then has a slot of a sequence number, its iteration count and four
+    // moments per random variable (cumulative ones first). The sequence number is odd while the worker writes.
+    struct ProcessMultiSimulator::SharedSegment
+    {
+        std::atomic<uint64_t> *word_list;
+        size_t word_count;
+        size_t variable_count;
+
+        SharedSegment(size_t worker_count, size_t variable_count) : variable_count(variable_count)
+        {
+            word_count = 1 + worker_count * SlotSize();
+            void *address = mmap(nullptr, word_count * sizeof(std::atomic<uint64_t>), PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+            if (address == MAP_FAILED)
+            {
+                throw WorkerProcessError();
+            }
+            word_list = static_cast<std::atomic<uint64_t> *>(address);
+            for (size_t i = 0; i < word_count; i++)
+            {
+                new(word_list + i) std::atomic<uint64_t>(0);
+            }
+        }
+
+        ~SharedSegment()
+        {
+            munmap(word_list, word_count * sizeof(std::atomic<uint64_t>));
+        }
+
+        size_t SlotSize() const
+        { return 2 + 4 * variable_count; }
+
+        std::atomic<uint64_t> &StopFlag()
+        { return word_list[0]; }
+
+        std::atomic<uint64_t> *Slot(size_t worker_index)
+        { return word_list + 1 + worker_index * SlotSize(); }
+
+        static uint64_t ToBits(double value)
+        {
+            uint64_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            return bits;
+        }
+
+        static double FromBits(uint64_t bits)
+        {
+            double value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+
+        void Publish(size_t worker_index, uint64_t iteration_count, const vector<SamplingResult> &result_list)
+        {
+            std::atomic<uint64_t> *slot = Slot(worker_index);
+            uint64_t sequence = slot[0].load(std::memory_order_relaxed);
+            slot[0].store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot[1].store(iteration_count, std::memory_order_relaxed);
+            for (size_t v = 0; v < result_list.size(); v++)
+            {
+                const SamplingResult &result = result_list[v];
+                slot[2 + 4 * v].store(ToBits(result.Average()), std::memory_order_relaxed);
+                slot[3 + 4 * v].store(ToBits(result.VarianceSum()), std::memory_order_relaxed);
+                slot[4 + 4 * v].store(ToBits(result.TotalWeight()), std::memory_order_relaxed);
+                slot[5 + 4 * v].store(ToBits(result.SquaredWeightSum()), std::memory_order_relaxed);
+            }
+            slot[0].store(sequence + 2, std::memory_order_release);
+        }
+
+        // Retries while the worker writes. False if no consistent copy could be read, e.g. because the worker died
+        // mid-write and left its slot torn for good; the result list is then garbage.
+        bool Read(size_t worker_index, vector<SamplingResult> &result_list)
+        {
+            std::atomic<uint64_t> *slot = Slot(worker_index);
+            result_list.resize(variable_count);
+            for (int attempt = 0; ; attempt++)
+            {
+                uint64_t sequence = slot[0].load(std::memory_order_acquire);
+                for (size_t v = 0; v < variable_count; v++)
+                {
+                    result_list[v] = SamplingResult::FromMoments(
+                            FromBits(slot[2 + 4 * v].load(std::memory_order_relaxed)),
+                            FromBits(slot[3 + 4 * v].load(std::memory_order_relaxed)),
+                            FromBits(slot[4 + 4 * v].load(std::memory_order_relaxed)),
+                            FromBits(slot[5 + 4 * v].load(std::memory_order_relaxed)));
+                }
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (sequence % 2 == 0 && slot[0].load(std::memory_order_relaxed) == sequence)
+                {
+                    return true;
+                }
+                if (attempt == 1000)
+                {
+                    return false;
+                }
+                std::this_thread::yield();
+            }
+        }
+    };
+
+    ProcessMultiSimulator::ProcessMultiSimulator(const PetriNetCreator &creator, size_t worker_count,
+                                                 double end_time) :
+            _worker_count(worker_count), _cumulative_estimator(worker_count), _transient_estimator(worker_count),
+            _creator(creator), _end_time(end_time)
+    { }
+
+    ProcessMultiSimulator::~ProcessMultiSimulator()
+    {
+        Stop();
+        for (size_t i = 0; i < _pid_list.size(); i++)
+        {
+            int status;
+            if (_pid_list[i] != 0 && waitpid(_pid_list[i], &status, 0) == _pid_list[i])
+            {
+                Reap(i, status);
+            }
+        }
+    }
+
+    void ProcessMultiSimulator::RunAsync(uint32_t iteration_count)
+    {
+        Wait();
+        size_t variable_count = _cumulative_estimator.GetRandomVariableList().size() +
+                                _transient_estimator.GetRandomVariableList().size();
+        _segment.reset(new SharedSegment(_worker_count, variable_count));
+        _pid_list.assign(_worker_count, 0);
+        _last_result_list.assign(_worker_count, {});
+        _failed_worker_count = 0;
+        unsigned long seed = _seeded ? _seed :
+                             (unsigned long) std::chrono::system_clock::now().time_since_epoch().count();
+        uint32_t iteration_per_worker = iteration_count / (uint32_t) _worker_count;
+        for (size_t i = 0; i < _worker_count; i++)
+        {
+            pid_t pid = fork();
+            if (pid < 0)
+            {
+                Stop();
+                Wait();
+                throw WorkerProcessError();
+            }
+            if (pid == 0)
+            {
+                RunWorker(i, iteration_per_worker, seed + i);
+            }
+            _pid_list[i] = pid;
+        }
+    }
+
+    void ProcessMultiSimulator::RunWorker(size_t worker_index, uint32_t iteration_count, unsigned long seed)
+    {
+        int exit_code = 0;
+        try
+        {
+            PetriNetSimulator simulator(_creator, _cumulative_estimator, _transient_estimator, _end_time,
+                                        worker_index);
+            simulator.SetTauLeaping(_tau_leaping_epsilon);
+            simulator.SetAntithetic(_antithetic);
+            simulator.SetConditionalSojourn(_conditional_sojourn);
+            if (_common_random_numbers)
+            {
+                simulator.SetCommonRandomNumbers(_substream_seed, (uint64_t) worker_index * iteration_count);
+            }
+            DefaultUniformRandomNumberGenerator generator(seed);
+            vector<SamplingResult> result_list;
+            uint32_t completed = 0;
+            while (completed < iteration_count && _segment->StopFlag().load(std::memory_order_relaxed) == 0)
+            {
+                uint32_t chunk = std::min(_publish_interval, iteration_count - completed);
+                simulator.Run((int) chunk, generator);
+                completed += chunk;
+                result_list.clear();
+                for (MeanEstimator *estimator:{&_cumulative_estimator, &_transient_estimator})
+                {
+                    estimator->ClearResult();
+                    estimator->SubmitResult(worker_index);
+                    for (const auto &rand_var:estimator->GetRandomVariableList())
+                    {
+                        result_list.push_back(rand_var.GetSamplingResult());
+                    }
+                }
+                _segment->Publish(worker_index, completed, result_list);
+            }
+        } catch (...)
+        {
+            exit_code = 1;
+        }
+        // skip the exit handlers of the parent's copy
+        _exit(exit_code);
+    }
+
+    void ProcessMultiSimulator::Reap(size_t worker_index, int status)
+    {
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            _failed_worker_count++;
+        }
+        _pid_list[worker_index] = 0;
+    }
+
+    void ProcessMultiSimulator::Stop()
+    {
+        if (_segment)
+        {
+            _segment->StopFlag().store(1, std::memory_order_relaxed);
+        }
+    }
+
+    void ProcessMultiSimulator::Wait()
+    {
+        for (size_t i = 0; i < _pid_list.size(); i++)
+        {
+            int status;
+            if (_pid_list[i] != 0 && waitpid(_pid_list[i], &status, 0) == _pid_list[i])
+            {
+                Reap(i, status);
+            }
+        }
+        UpdateResult();
+    }
+
+    bool ProcessMultiSimulator::IsRunning()
+    {
+        bool running = false;
+        for (size_t i = 0; i < _pid_list.size(); i++)
+        {
+            if (_pid_list[i] == 0)
+            {
+                continue;
+            }
+            int status;
+            if (waitpid(_pid_list[i], &status, WNOHANG) == _pid_list[i])
+            {
+                Reap(i, status);
+            } else
+            {
+                running = true;
+            }
+        }
+        return running;
+    }
+
+    void ProcessMultiSimulator::UpdateResult()
+    {
+        _cumulative_estimator.ClearResult();
+        _transient_estimator.ClearResult();
+        if (!_segment)
+        {
+            return;
+        }
+        size_t cumulative_count = _cumulative_estimator.GetRandomVariableList().size();
+        vector<SamplingResult> result_list;
+        for (size_t i = 0; i < _worker_count; i++)
+        {
+            // a torn slot falls back to the last consistent publication of the worker
+            if (_segment->Read(i, result_list))
+            {
+                _last_result_list[i].swap(result_list);
+            }
+            const auto &last_result_list = _last_result_list[i];
+            for (size_t v = 0; v < last_result_list.size(); v++)
+            {
+                if (v < cumulative_count)
+                {
+                    _cumulative_estimator.CombineResult(v, last_result_list[v]);
+                } else
+                {
+                    _transient_estimator.CombineResult(v - cumulative_count, last_result_list[v]);
+                }
+            }
+        }
+    }
+}
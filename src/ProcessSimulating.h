@@ -0,0 +1,120 @@
+//
+
+#ifndef SPNP_PROCESSSIMULATING_H
+#define SPNP_PROCESSSIMULATING_H
+
+#include <sys/types.h>
+#include "Simulating.h"
+
+namespace Simulating
+{
+    // the shared segment could not be mapped or a worker not be forked
+    class WorkerProcessError : public std::exception
+    {
+    };
+
+    // Forks one worker process per source, which shares the net of the parent copy-on-write and publishes the
+    // results of its source to a slot of a shared memory segment every publish_interval iterations. The slots are
+    // seqlocks with a single writer, so publishing never waits for the controller. A worker that crashes, e.g. in a
+    // firing time or reward function, only loses the iterations since its last publication, and the run goes on
+    // without it. Histograms of the replication values stay in the workers. POSIX only.
+    class ProcessMultiSimulator : public SimulatorBackend
+    {
+    private:
+        struct SharedSegment;
+
+        size_t _worker_count;
+        MeanEstimator _cumulative_estimator;
+        MeanEstimator _transient_estimator;
+        const PetriNetCreator &_creator;
+        double _end_time;
+        double _tau_leaping_epsilon = 0.0;
+        bool _antithetic = false;
+        bool _conditional_sojourn = false;
+        bool _common_random_numbers = false;
+        uint64_t _substream_seed = 0;
+        bool _seeded = false;
+        unsigned long _seed = 0;
+        uint32_t _publish_interval = 64;
+        std::unique_ptr<SharedSegment> _segment;
+        vector<pid_t> _pid_list; //0 once the worker is reaped
+        vector<vector<SamplingResult>> _last_result_list; //the last consistent publication of every worker
+        size_t _failed_worker_count = 0;
+    public:
+        ProcessMultiSimulator(const PetriNetCreator &creator, size_t worker_count, double end_time);
+
+        ProcessMultiSimulator(const ProcessMultiSimulator &) = delete;
+
+        // stops and reaps the workers
+        virtual ~ProcessMultiSimulator() override;
+
+        void Run(uint32_t iteration_count)
+        {
+            RunAsync(iteration_count);
+            Wait();
+        }
+
+        virtual void RunAsync(uint32_t iteration_count) override;
+
+        void SetTauLeaping(double epsilon)
+        { _tau_leaping_epsilon = epsilon; }
+
+        void SetAntithetic(bool antithetic)
+        { _antithetic = antithetic; }
+
+        void SetConditionalSojourn(bool conditional_sojourn)
+        { _conditional_sojourn = conditional_sojourn; }
+
+        // as in PetriNetMultiSimulator
+        void SetCommonRandomNumbers(uint64_t seed)
+        {
+            _common_random_numbers = true;
+            _substream_seed = seed;
+        }
+
+        // worker i draws its random numbers from seed + i, like the threads of PetriNetMultiSimulator
+        void SetSeed(unsigned long seed)
+        {
+            _seeded = true;
+            _seed = seed;
+        }
+
+        void SetPublishInterval(uint32_t iteration_count)
+        { _publish_interval = std::max<uint32_t>(iteration_count, 1); }
+
+        // workers stop at their next publication
+        virtual void Stop() override;
+
+        virtual void Wait() override;
+
+        virtual bool IsRunning() override;
+
+        virtual void UpdateResult() override;
+
+        virtual MeanEstimator &GetCumulativeEstimator() override
+        { return _cumulative_estimator; }
+
+        virtual MeanEstimator &GetTransientEstimator() override
+        { return _transient_estimator; }
+
+        // the generators live in the workers, so the state of a run cannot be saved
+        virtual void SaveCheckpoint(const string &path) override
+        { throw CheckpointNotSupported(); }
+
+        virtual void ResumeAsync(const string &path) override
+        { throw CheckpointNotSupported(); }
+
+        // workers that ended abnormally, among the reaped ones
+        size_t GetFailedWorkerCount() const
+        { return _failed_worker_count; }
+
+    private:
+        // in the worker process; never returns
+        void RunWorker(size_t worker_index, uint32_t iteration_count, unsigned long seed);
+
+        // records whether a reaped worker failed
+        void Reap(size_t worker_index, int status);
+    };
+}
+
+#endif //SPNP_PROCESSSIMULATING_H
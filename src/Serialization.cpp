@@ -0,0 +1,106 @@
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include "Serialization.h"
+
+namespace Serialization
+{
+    void Writer::WriteUint64(uint64_t value)
+    {
+        char bytes[8];
+        for (int i = 0; i < 8; i++)
+        {
+            bytes[i] = (char) (value >> (8 * i));
+        }
+        _stream.write(bytes, sizeof(bytes));
+    }
+
+    void Writer::WriteDouble(double value)
+    {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        WriteUint64(bits);
+    }
+
+    void Writer::WriteString(const string &value)
+    {
+        WriteUint64(value.size());
+        _stream.write(value.data(), value.size());
+    }
+
+    void Writer::WriteBytes(const void *data, size_t size)
+    {
+        _stream.write(static_cast<const char *>(data), size);
+    }
+
+    uint64_t Reader::ReadUint64()
+    {
+        unsigned char bytes[8];
+        if (!_stream.read((char *) bytes, sizeof(bytes)))
+        {
+            throw SerializationError();
+        }
+        uint64_t value = 0;
+        for (int i = 0; i < 8; i++)
+        {
+            value |= (uint64_t) bytes[i] << (8 * i);
+        }
+        return value;
+    }
+
+    double Reader::ReadDouble()
+    {
+        uint64_t bits = ReadUint64();
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    string Reader::ReadString()
+    {
+        uint64_t size = ReadUint64();
+        // read in chunks, so that a corrupt size fails at the end of the data instead of allocating it
+        string value;
+        char chunk[4096];
+        while (value.size() < size)
+        {
+            size_t count = (size_t) std::min<uint64_t>(sizeof(chunk), size - value.size());
+            if (!_stream.read(chunk, count))
+            {
+                throw SerializationError();
+            }
+            value.append(chunk, count);
+        }
+        return value;
+    }
+
+    void Reader::ExpectString(const string &expected)
+    {
+        if (ReadString() != expected)
+        {
+            throw SerializationError();
+        }
+    }
+
+    void WriteFileAtomically(const string &path, const std::function<void(Writer &)> &write)
+    {
+        string temporary_path = path + ".tmp";
+        {
+            std::ofstream stream(temporary_path, std::ios::binary | std::ios::trunc);
+            Writer writer(stream);
+            write(writer);
+            stream.flush();
+            if (!stream)
+            {
+                throw SerializationError();
+            }
+        }
+        if (std::rename(temporary_path.c_str(), path.c_str()) != 0)
+        {
+            throw SerializationError();
+        }
+    }
+}
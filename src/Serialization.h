@@ -0,0 +1,63 @@
+//
+
+#ifndef SPNP_SERIALIZATION_H
+#define SPNP_SERIALIZATION_H
+
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <string>
+
+namespace Serialization
+{
+    using std::string;
+
+    // the data is truncated or corrupt, or the file could not be written
+    class SerializationError : public std::exception
+    {
+    };
+
+    // Fixed-width little-endian encoding, so that files move between machines.
+    class Writer
+    {
+    private:
+        std::ostream &_stream;
+    public:
+        Writer(std::ostream &stream) : _stream(stream)
+        { }
+
+        void WriteUint64(uint64_t value);
+
+        void WriteDouble(double value);
+
+        void WriteString(const string &value);
+
+        // as is, for data that is laid out for the file already
+        void WriteBytes(const void *data, size_t size);
+    };
+
+    class Reader
+    {
+    private:
+        std::istream &_stream;
+    public:
+        Reader(std::istream &stream) : _stream(stream)
+        { }
+
+        uint64_t ReadUint64();
+
+        double ReadDouble();
+
+        string ReadString();
+
+        // throws unless the next string is `expected`, for magic numbers and names
+        void ExpectString(const string &expected);
+    };
+
+    // Writes the file next to `path` and renames it over `path`, so that a crash leaves either the old or the new
+    // file behind, never a partial one.
+    void WriteFileAtomically(const string &path, const std::function<void(Writer &)> &write);
+}
+
+#endif //SPNP_SERIALIZATION_H
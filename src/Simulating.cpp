@@ -2,31 +2,467 @@
 
 #include "Simulating.h"
 #include <iostream>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
 
 namespace Simulating
 {
+    void SimulateReplication(PetriNet &petri_net, MeanEstimator &cumulative_estimator,
+                             MeanEstimator &transient_estimator, size_t source_index, double end_time,
+                             UniformRandomNumberGenerator &generator, Trace::TraceWriter *trace_writer)
+    {
+        petri_net.SetHorizon(end_time);
+        petri_net.Reset(generator);
+        if (trace_writer != nullptr)
+        {
+            trace_writer->BeginReplication(petri_net);
+        } else
+        {
+            petri_net.SetFiringLog(nullptr); //left attached if the last traced replication threw
+        }
+        while (!petri_net.IsStopped() && petri_net.GetNextFiringTime() < end_time)
+        {
+            cumulative_estimator.InputSample(source_index, petri_net, petri_net.GetDuration(),
+                                             petri_net.GetMeanLikelihoodRatio(petri_net.GetNextFiringTime()));
+            petri_net.NextState(generator);
+            if (trace_writer != nullptr)
+            {
+                trace_writer->RecordEvent(petri_net);
+            }
+        }
+        double stop_time = petri_net.IsStopped() ? petri_net.GetTime() : end_time;
+        if (trace_writer != nullptr)
+        {
+            trace_writer->EndReplication(petri_net, stop_time);
+        }
+        cumulative_estimator.InputSample(source_index, petri_net, stop_time - petri_net.GetTime(),
+                                         petri_net.GetMeanLikelihoodRatio(stop_time));
+        transient_estimator.InputSample(source_index, petri_net, 1.0, petri_net.GetLikelihoodRatio(stop_time));
+    }
+
+    void SimulateConditionalReplication(PetriNet &petri_net, MeanEstimator &cumulative_estimator,
+                                        MeanEstimator &transient_estimator, size_t source_index, double end_time,
+                                        UniformRandomNumberGenerator &generator)
+    {
+        petri_net.SetHorizon(end_time);
+        petri_net.Reset(generator);
+        while (true)
+        {
+            double left_time = end_time - petri_net.GetTime();
+            double total_rate = petri_net.GetTotalRate();
+            double expected_sojourn = total_rate > 0.0 ? -std::expm1(-total_rate * left_time) / total_rate : left_time;
+            cumulative_estimator.InputSample(source_index, petri_net, expected_sojourn);
+            if (petri_net.GetNextFiringTime() >= end_time)
+            {
+                break;
+            }
+            petri_net.NextState(generator);
+        }
+        transient_estimator.InputSample(source_index, petri_net, 1.0);
+    }
+
+    void PetriNetSimulator::SetConditionalSojourn(bool conditional_sojourn)
+    {
+        if (conditional_sojourn &&
+            (!_petri_net.IsMarkovian() || _petri_net.IsTauLeaping() || _petri_net.IsImportanceSampling() ||
+             _petri_net.GetRateParameterCount() > 0 || _petri_net.HasStoppingPredicate()))
+        {
+            throw ConditionalSojournNotSupported();
+        }
+        _conditional_sojourn = conditional_sojourn;
+    }
+
     void PetriNetSimulator::Run(int iteration_num, UniformRandomNumberGenerator &generator)
     {
+        AntitheticUniformRandomNumberGenerator antithetic_generator(generator);
+        SetSnapshotRunning(true);
         for (int i = 0; i < iteration_num; i++)
         {
             if (_stop)
             {
                 break;
             }
-            _petri_net.Reset(generator);
+            if (_antithetic)
+            {
+                // the pair is one sample, so the estimated variance reflects the negative correlation
+                antithetic_generator.StartReplication();
+                RunReplication(antithetic_generator);
+                antithetic_generator.StartTwin();
+                _petri_net.RepeatReplication();
+                RunReplication(antithetic_generator);
+                _cumulative_estimator.SubmitMean(_source_index, 2.0 * _end_time);
+                _transient_estimator.SubmitMean(_source_index, 2.0);
+            } else
+            {
+                generator.StartReplication();
+                RunReplication(generator);
+                if (_conditional_sojourn)
+                {
+                    _cumulative_estimator.SubmitMean(_source_index, _end_time);
+                } else
+                {
+                    _cumulative_estimator.SubmitMean(_source_index);
+                }
+                _transient_estimator.SubmitMean(_source_index);
+            }
+            EndIteration();
+        }
+        SetSnapshotRunning(false);
+        _running = false;
+    }
+
+    void PetriNetSimulator::Snapshot(const std::function<void()> &snapshot)
+    {
+        std::unique_lock<std::mutex> lock(_snapshot_channel->mutex);
+        if (!_snapshot_channel->running)
+        {
+            snapshot();
+            return;
+        }
+        _snapshot_channel->request = &snapshot;
+        _snapshot_channel->condition.wait(lock, [this]
+        { return _snapshot_channel->request == nullptr; });
+    }
+
+    void PetriNetSimulator::SetSnapshotRunning(bool running)
+    {
+        std::lock_guard<std::mutex> lock(_snapshot_channel->mutex);
+        if (_snapshot_channel->request != nullptr)
+        {
+            (*_snapshot_channel->request)();
+            _snapshot_channel->request = nullptr;
+            _snapshot_channel->condition.notify_all();
+        }
+        _snapshot_channel->running = running;
+    }
+
+    void PetriNetSimulator::EndIteration()
+    {
+        std::lock_guard<std::mutex> lock(_snapshot_channel->mutex);
+        _iteration_count++;
+        if (_snapshot_channel->request != nullptr)
+        {
+            (*_snapshot_channel->request)();
+            _snapshot_channel->request = nullptr;
+            _snapshot_channel->condition.notify_all();
+        }
+    }
+
+    void PetriNetSimulator::RunReplication(UniformRandomNumberGenerator &generator)
+    {
+        if (_conditional_sojourn)
+        {
+            SimulateConditionalReplication(_petri_net, _cumulative_estimator, _transient_estimator, _source_index,
+                                           _end_time, generator);
+            return;
+        }
+        SimulateReplication(_petri_net, _cumulative_estimator, _transient_estimator, _source_index, _end_time,
+                            generator, _trace_writer);
+    }
+
+    RqmcSimulator::RqmcSimulator(const PetriNetCreator &creator, size_t worker_count, double end_time,
+                                 uint64_t point_count, size_t dimension) :
+            _creator(creator), _worker_count(worker_count), _end_time(end_time),
+            _lattice(point_count, dimension), _cumulative_estimator(worker_count),
+            _transient_estimator(worker_count), _next_randomization(0)
+    { }
 
-            while (_petri_net.GetNextFiringTime() < _end_time)
+    void RqmcSimulator::Run(uint32_t randomization_count, unsigned long seed)
+    {
+        _next_randomization = 0;
+        vector<thread> thread_list;
+        for (size_t i = 0; i < _worker_count; i++)
+        {
+            thread_list.push_back(thread(&RqmcSimulator::RunWorker, this, i, randomization_count, seed + i));
+        }
+        for (auto &worker_thread:thread_list)
+        {
+            worker_thread.join();
+        }
+        _cumulative_estimator.ClearResult();
+        _transient_estimator.ClearResult();
+        for (size_t i = 0; i < _worker_count; i++)
+        {
+            _cumulative_estimator.SubmitResult(i);
+            _transient_estimator.SubmitResult(i);
+        }
+    }
+
+    void RqmcSimulator::RunWorker(size_t source_index, uint32_t randomization_count, unsigned long seed)
+    {
+        PetriNet petri_net = _creator.CreatePetriNet();
+        DefaultUniformRandomNumberGenerator shift_generator(seed);
+        LatticeUniformRandomNumberGenerator lattice = _lattice;
+        uint64_t point_count = lattice.GetPointCount();
+        while (_next_randomization++ < randomization_count)
+        {
+            lattice.Randomize(shift_generator);
+            for (uint64_t point = 0; point < point_count; point++)
             {
-                _cumulative_estimator.InputSample(_source_index, _petri_net, _petri_net.GetDuration());
-                _petri_net.NextState(generator);
+                lattice.StartReplication();
+                SimulateReplication(petri_net, _cumulative_estimator, _transient_estimator, source_index, _end_time,
+                                    lattice);
             }
-            _cumulative_estimator.InputSample(_source_index, _petri_net, _end_time - _petri_net.GetTime());
-            _transient_estimator.InputSample(_source_index, _petri_net, 1.0);
+            // one sample per randomization
+            _cumulative_estimator.SubmitMean(source_index, point_count * _end_time);
+            _transient_estimator.SubmitMean(source_index, (double) point_count);
+        }
+    }
 
-            _cumulative_estimator.SubmitMean(_source_index);
-            _transient_estimator.SubmitMean(_source_index);
+    size_t SweepSimulator::AddParameter(const vector<string> &transition_names, const FiringTimeFactory &factory)
+    {
+        for (const auto &name:transition_names)
+        {
+            _binding_list.push_back(Binding{_parameter_count, _creator.GetTransitionIndex(name), factory});
+        }
+        return _parameter_count++;
+    }
+
+    size_t SweepSimulator::AddDesignPoint(const vector<double> &parameter_values)
+    {
+        if (parameter_values.size() != _parameter_count)
+        {
+            throw InvalidDesignPoint();
+        }
+        _design_point_list.push_back(parameter_values);
+        return _design_point_list.size() - 1;
+    }
+
+    void SweepSimulator::Run(uint32_t replication_count, unsigned long seed)
+    {
+        Prepare(seed);
+        RunBatch(vector<uint64_t>(_design_point_list.size(), replication_count));
+    }
+
+    bool SweepSimulator::RunAdaptive(const SweepDecision &decision, uint32_t initial_count, uint32_t batch_count,
+                                     uint64_t max_replication_count, unsigned long seed)
+    {
+        size_t point_count = _design_point_list.size();
+        Prepare(seed);
+        RunBatch(vector<uint64_t>(point_count, initial_count));
+        while (true)
+        {
+            vector<double> weight_list = DecisionWeights(decision);
+            if (weight_list.empty())
+            {
+                return true;
+            }
+            uint64_t total_count = 0;
+            for (uint64_t count:_replication_count_list)
+            {
+                total_count += count;
+            }
+            if (total_count >= max_replication_count)
+            {
+                return false;
+            }
+            uint64_t step_count = std::min((uint64_t) batch_count, max_replication_count - total_count);
+            double weight_sum = 0.0;
+            for (double weight:weight_list)
+            {
+                weight_sum += weight;
+            }
+            if (weight_sum <= 0.0)
+            {
+                weight_list.assign(point_count, 1.0);
+                weight_sum = point_count;
+            }
+            // steer towards the target proportions of the grown total, without taking back what has been run
+            vector<double> deficit_list(point_count);
+            double deficit_sum = 0.0;
+            for (size_t i = 0; i < point_count; i++)
+            {
+                double target = (total_count + step_count) * weight_list[i] / weight_sum;
+                deficit_list[i] = std::max(target - _replication_count_list[i], 0.0);
+                deficit_sum += deficit_list[i];
+            }
+            vector<uint64_t> count_list(point_count, 0);
+            uint64_t allocated_count = 0;
+            for (size_t i = 0; i < point_count; i++)
+            {
+                count_list[i] = (uint64_t) (step_count * deficit_list[i] / deficit_sum);
+                allocated_count += count_list[i];
+            }
+            count_list[std::max_element(deficit_list.begin(), deficit_list.end()) - deficit_list.begin()] +=
+                    step_count - allocated_count;
+            RunBatch(count_list);
+        }
+    }
+
+    vector<double> SweepSimulator::DecisionWeights(const SweepDecision &decision)
+    {
+        size_t point_count = _design_point_list.size();
+        vector<double> mean_list(point_count), variance_list(point_count), mean_variance_list(point_count);
+        for (size_t i = 0; i < point_count; i++)
+        {
+            const SamplingResult &result = GetDecisionResult(decision, i);
+            mean_list[i] = result.Average();
+            variance_list[i] = result.Variance();
+            mean_variance_list[i] = result.AverageVariance();
+        }
+        double indifference = decision.GetIndifference();
+        double alpha = 1.0 - decision.GetConfidenceCoefficient();
+        vector<double> weight_list(point_count, 0.0);
+        bool decided = true;
+        if (decision.GetType() == SweepDecision::Threshold)
+        {
+            double z = std::abs(Statistics::StdNormQuantile(alpha / point_count));
+            for (size_t i = 0; i < point_count; i++)
+            {
+                double distance = std::abs(mean_list[i] - decision.GetThreshold());
+                double error = z * std::sqrt(mean_variance_list[i]);
+                if (distance > error || error < indifference)
+                {
+                    continue;
+                }
+                decided = false;
+                double gap = std::max(std::max(distance, indifference), 1e-12 * (1.0 + std::abs(mean_list[i])));
+                weight_list[i] = variance_list[i] / (gap * gap);
+            }
+            return decided ? vector<double>() : weight_list;
+        }
+        double sign = decision.GetType() == SweepDecision::Maximum ? 1.0 : -1.0;
+        size_t best = 0;
+        for (size_t i = 1; i < point_count; i++)
+        {
+            if (sign * mean_list[i] > sign * mean_list[best])
+            {
+                best = i;
+            }
+        }
+        _selected_point = best;
+        if (point_count < 2)
+        {
+            return vector<double>();
+        }
+        double z = std::abs(Statistics::StdNormQuantile(alpha / (point_count - 1)));
+        double best_weight_sum = 0.0;
+        for (size_t i = 0; i < point_count; i++)
+        {
+            if (i == best)
+            {
+                continue;
+            }
+            double difference = sign * (mean_list[best] - mean_list[i]);
+            if (difference + indifference <= z * std::sqrt(mean_variance_list[best] + mean_variance_list[i]))
+            {
+                decided = false;
+            }
+            // OCBA: N_i proportional to (sigma_i / gap_i)^2, N_best = sigma_best * sqrt(sum of N_i^2 / sigma_i^2)
+            double gap = std::max(std::max(difference, indifference), 1e-12 * (1.0 + std::abs(mean_list[best])));
+            weight_list[i] = variance_list[i] / (gap * gap);
+            if (variance_list[i] > 0.0)
+            {
+                best_weight_sum += weight_list[i] * weight_list[i] / variance_list[i];
+            }
+        }
+        weight_list[best] = std::sqrt(variance_list[best] * best_weight_sum);
+        return decided ? vector<double>() : weight_list;
+    }
+
+    void SweepSimulator::Prepare(unsigned long seed)
+    {
+        _cumulative_estimator_list.clear();
+        _transient_estimator_list.clear();
+        _point_func_list.clear();
+        for (const auto &parameter_values:_design_point_list)
+        {
+            _cumulative_estimator_list.emplace_back(new MeanEstimator(_worker_count));
+            _transient_estimator_list.emplace_back(new MeanEstimator(_worker_count));
+            for (const auto &random_variable:_cumulative_variable_list)
+            {
+                _cumulative_estimator_list.back()->AddRandomVariable(random_variable);
+            }
+            for (const auto &random_variable:_transient_variable_list)
+            {
+                _transient_estimator_list.back()->AddRandomVariable(random_variable);
+            }
+            // built once, the workers only copy them into their nets
+            _point_func_list.push_back({});
+            for (const auto &binding:_binding_list)
+            {
+                _point_func_list.back().push_back(binding.factory(parameter_values[binding.parameter_index]));
+            }
+        }
+        _replication_count_list.assign(_design_point_list.size(), 0);
+        _worker_list.clear();
+        for (size_t i = 0; i < _worker_count; i++)
+        {
+            _worker_list.push_back(Worker{_creator.CreatePetriNet(), DefaultUniformRandomNumberGenerator(seed + i),
+                                          _design_point_list.size()});
+        }
+    }
+
+    void SweepSimulator::RunBatch(const vector<uint64_t> &count_list)
+    {
+        // blocks are handed out point by point, so points finish roughly in order
+        _block_list.clear();
+        for (size_t point_index = 0; point_index < count_list.size(); point_index++)
+        {
+            uint64_t first_replication = _replication_count_list[point_index];
+            uint64_t last_replication = first_replication + count_list[point_index];
+            for (uint64_t replication = first_replication; replication < last_replication;
+                 replication += ReplicationBlockSize)
+            {
+                uint64_t block_size = std::min((uint64_t) ReplicationBlockSize, last_replication - replication);
+                _block_list.push_back(ReplicationBlock{point_index, replication, block_size});
+            }
+            _replication_count_list[point_index] = last_replication;
+        }
+        _next_block = 0;
+        vector<thread> thread_list;
+        for (size_t i = 0; i < _worker_count; i++)
+        {
+            thread_list.push_back(thread(&SweepSimulator::RunWorker, this, i));
+        }
+        for (auto &worker_thread:thread_list)
+        {
+            worker_thread.join();
+        }
+        for (size_t point_index = 0; point_index < _design_point_list.size(); point_index++)
+        {
+            _cumulative_estimator_list[point_index]->ClearResult();
+            _transient_estimator_list[point_index]->ClearResult();
+            for (size_t i = 0; i < _worker_count; i++)
+            {
+                _cumulative_estimator_list[point_index]->SubmitResult(i);
+                _transient_estimator_list[point_index]->SubmitResult(i);
+            }
+        }
+    }
+
+    void SweepSimulator::RunWorker(size_t source_index)
+    {
+        Worker &worker = _worker_list[source_index];
+        size_t block_index;
+        while ((block_index = _next_block++) < _block_list.size())
+        {
+            const ReplicationBlock &block = _block_list[block_index];
+            if (block.point_index != worker.point_index)
+            {
+                worker.point_index = block.point_index;
+                for (size_t b_index = 0; b_index < _binding_list.size(); b_index++)
+                {
+                    worker.petri_net.SetFiringTimeFunc(_binding_list[b_index].transition_index,
+                                                       _point_func_list[block.point_index][b_index]);
+                }
+            }
+            if (_common_random_numbers)
+            {
+                worker.petri_net.SetCommonRandomNumbers(_substream_seed, block.first_replication);
+            }
+            MeanEstimator &cumulative_estimator = *_cumulative_estimator_list[block.point_index];
+            MeanEstimator &transient_estimator = *_transient_estimator_list[block.point_index];
+            for (uint64_t replication = 0; replication < block.replication_count; replication++)
+            {
+                worker.generator.StartReplication();
+                SimulateReplication(worker.petri_net, cumulative_estimator, transient_estimator, source_index,
+                                    _end_time, worker.generator);
+                cumulative_estimator.SubmitMean(source_index);
+                transient_estimator.SubmitMean(source_index);
+            }
         }
-        _running = false;
     }
 
     void PetriNetSimulator::SubmitResult()
@@ -36,20 +472,149 @@ namespace Simulating
     }
 
     void PetriNetMultiSimulator::RunAsync(uint32_t interation_count)
+    {
+        CreateWorkers(interation_count / (uint32_t) _simulator_count);
+        StartWorkers();
+    }
+
+    void PetriNetMultiSimulator::CreateWorkers(uint32_t iteration_per_worker)
     {
         _simulator_list.clear();
         _generator_list.clear();
-        uint32_t iteration_per_worker = interation_count / (uint32_t) _simulator_count;
+        _trace_writer_list.clear();
+        _iteration_per_worker = iteration_per_worker;
         for (uint32_t i = 0; i < _simulator_count; i++)
         {
             _simulator_list.push_back(
                     PetriNetSimulator(_creator, _cumulative_estimator, _transient_estimator, _end_time, i));
-            _generator_list.push_back(DefaultUniformRandomNumberGenerator());
+            _simulator_list.back().SetTauLeaping(_tau_leaping_epsilon);
+            _simulator_list.back().SetAntithetic(_antithetic);
+            _simulator_list.back().SetConditionalSojourn(_conditional_sojourn);
+            if (!_trace_prefix.empty())
+            {
+                _trace_writer_list.emplace_back(new Trace::TraceWriter(TracePath(_trace_prefix, i), _creator));
+                _simulator_list.back().SetTraceWriter(_trace_writer_list.back().get());
+            }
+            if (_common_random_numbers)
+            {
+                _simulator_list.back().SetCommonRandomNumbers(_substream_seed, (uint64_t) i * iteration_per_worker);
+            }
+            _generator_list.push_back(_seeded ? DefaultUniformRandomNumberGenerator(_seed + i) :
+                                      DefaultUniformRandomNumberGenerator());
         }
+    }
+
+    void PetriNetMultiSimulator::StartWorkers()
+    {
         for (uint32_t i = 0; i < _simulator_count; i++)
         {
-            _simulator_list[i].RunAsync(iteration_per_worker, _generator_list[i]);
+            uint64_t completed = _simulator_list[i].GetIterationCount();
+            _simulator_list[i].RunAsync((int) (_iteration_per_worker - std::min<uint64_t>(completed,
+                                                                                           _iteration_per_worker)),
+                                        _generator_list[i]);
+        }
+    }
+
+    // the accumulated replications of one source of the estimator
+    static string SaveEstimatorSource(MeanEstimator &estimator, size_t source_index)
+    {
+        std::ostringstream stream;
+        Serialization::Writer writer(stream);
+        estimator.SaveSource(source_index, writer);
+        return stream.str();
+    }
+
+    static void LoadEstimatorSource(MeanEstimator &estimator, size_t source_index, const string &state)
+    {
+        std::istringstream stream(state);
+        Serialization::Reader reader(stream);
+        estimator.LoadSource(source_index, reader);
+    }
+
+    static const char *CheckpointMagic = "SPNP checkpoint";
+    static const uint64_t CheckpointVersion = 1;
+
+    void PetriNetMultiSimulator::SaveCheckpoint(const string &path)
+    {
+        std::lock_guard<std::mutex> lock(_checkpoint_mutex);
+        struct WorkerCheckpoint
+        {
+            uint64_t iteration_count;
+            string generator_state;
+            string cumulative_state;
+            string transient_state;
+        };
+        vector<WorkerCheckpoint> checkpoint_list(_simulator_list.size());
+        for (size_t i = 0; i < _simulator_list.size(); i++)
+        {
+            WorkerCheckpoint &checkpoint = checkpoint_list[i];
+            _simulator_list[i].Snapshot([this, i, &checkpoint]
+                                        {
+                                            checkpoint.iteration_count = _simulator_list[i].GetIterationCount();
+                                            checkpoint.generator_state = _generator_list[i].GetState();
+                                            checkpoint.cumulative_state =
+                                                    SaveEstimatorSource(_cumulative_estimator, i);
+                                            checkpoint.transient_state =
+                                                    SaveEstimatorSource(_transient_estimator, i);
+                                        });
         }
+        Serialization::WriteFileAtomically(path, [&](Serialization::Writer &writer)
+        {
+            writer.WriteString(CheckpointMagic);
+            writer.WriteUint64(CheckpointVersion);
+            writer.WriteUint64(_creator.GetPlaceCmdList().size());
+            writer.WriteUint64(_creator.GetTransitionCmdList().size());
+            writer.WriteDouble(_end_time);
+            writer.WriteUint64(_iteration_per_worker);
+            writer.WriteUint64(checkpoint_list.size());
+            for (const auto &checkpoint:checkpoint_list)
+            {
+                writer.WriteUint64(checkpoint.iteration_count);
+                writer.WriteString(checkpoint.generator_state);
+                writer.WriteString(checkpoint.cumulative_state);
+                writer.WriteString(checkpoint.transient_state);
+            }
+        });
+    }
+
+    void PetriNetMultiSimulator::ResumeAsync(const string &path)
+    {
+        std::ifstream stream(path, std::ios::binary);
+        if (!stream)
+        {
+            throw Serialization::SerializationError();
+        }
+        Serialization::Reader reader(stream);
+        reader.ExpectString(CheckpointMagic);
+        if (reader.ReadUint64() != CheckpointVersion ||
+            reader.ReadUint64() != _creator.GetPlaceCmdList().size() ||
+            reader.ReadUint64() != _creator.GetTransitionCmdList().size() ||
+            reader.ReadDouble() != _end_time)
+        {
+            throw Serialization::SerializationError();
+        }
+        CreateWorkers((uint32_t) reader.ReadUint64());
+        if (reader.ReadUint64() != _simulator_count)
+        {
+            throw Serialization::SerializationError();
+        }
+        for (size_t i = 0; i < _simulator_count; i++)
+        {
+            uint64_t iteration_count = reader.ReadUint64();
+            _simulator_list[i].SetIterationCount(iteration_count);
+            if (_common_random_numbers)
+            {
+                _simulator_list[i].SetCommonRandomNumbers(_substream_seed,
+                                                          (uint64_t) i * _iteration_per_worker + iteration_count);
+            }
+            if (!_generator_list[i].SetState(reader.ReadString()))
+            {
+                throw Serialization::SerializationError();
+            }
+            LoadEstimatorSource(_cumulative_estimator, i, reader.ReadString());
+            LoadEstimatorSource(_transient_estimator, i, reader.ReadString());
+        }
+        StartWorkers();
     }
 
     bool SimulatorController::IsPrecisionSatisfied() const
@@ -93,20 +658,26 @@ namespace Simulating
     {
         std::this_thread::sleep_for(std::chrono::milliseconds((uint64_t) (seconds * 1000)));
         _simulator.UpdateResult();
+        bool finished = true;
         if (IsPrecisionSatisfied())
         {
             _simulator.Stop();
             _simulator.Wait();
-            return true;
-        }
-        if (_simulator.IsRunning())
+        } else if (_simulator.IsRunning())
         {
-            return false;
+            finished = false;
         } else
         {
             _simulator.Wait();
-            return true;
         }
+        auto now = std::chrono::steady_clock::now();
+        if (!_checkpoint_path.empty() &&
+            (finished || std::chrono::duration<double>(now - _last_checkpoint_time).count() >= _checkpoint_interval))
+        {
+            _simulator.SaveCheckpoint(_checkpoint_path);
+            _last_checkpoint_time = now;
+        }
+        return finished;
     }
 }
 
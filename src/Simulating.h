@@ -7,7 +7,11 @@
 
 #include "PetriNetModel/PetriNetModel.h"
 #include "Estimating.h"
+#include "Trace.h"
 #include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 
 namespace Simulating
 {
@@ -15,9 +19,43 @@ namespace Simulating
     using namespace Estimating;
     using std::thread;
 
+    // conditional sojourn times need the exact Markovian engine
+    class ConditionalSojournNotSupported : public std::exception
+    {
+    };
+
+    // a design point needs exactly one value per sweep parameter
+    class InvalidDesignPoint : public std::exception
+    {
+    };
+
+    // Resets the net and feeds one replication over [0, end_time] to the estimators, without submitting it. If the
+    // stopping predicate of the net holds first, the replication ends right there: cumulative rewards then cover
+    // [0, hitting time] and transient ones see the marking at the hitting time. The trajectory is recorded to the
+    // trace writer, if any.
+    void SimulateReplication(PetriNet &petri_net, MeanEstimator &cumulative_estimator,
+                             MeanEstimator &transient_estimator, size_t source_index, double end_time,
+                             UniformRandomNumberGenerator &generator, Trace::TraceWriter *trace_writer = nullptr);
+
+    // Like SimulateReplication, but every marking entered at time t before end_time contributes its cumulative
+    // rewards with the expected sojourn E[min(S, end_time - t)] = (1 - exp(-a (end_time - t))) / a given the
+    // total rate a, instead of the sampled one. The inputs have to be normalized by end_time.
+    void SimulateConditionalReplication(PetriNet &petri_net, MeanEstimator &cumulative_estimator,
+                                        MeanEstimator &transient_estimator, size_t source_index, double end_time,
+                                        UniformRandomNumberGenerator &generator);
+
     class PetriNetSimulator
     {
     private:
+        // hands a function to the worker thread, which runs it between two iterations
+        struct SnapshotChannel
+        {
+            std::mutex mutex;
+            std::condition_variable condition;
+            const std::function<void()> *request = nullptr;
+            bool running = false;
+        };
+
         PetriNet _petri_net;
         MeanEstimator &_cumulative_estimator;
         MeanEstimator &_transient_estimator;
@@ -26,6 +64,11 @@ namespace Simulating
         thread _worker_thread;
         bool _stop = false;
         bool _running = false;
+        bool _antithetic = false;
+        bool _conditional_sojourn = false;
+        Trace::TraceWriter *_trace_writer = nullptr;
+        std::unique_ptr<SnapshotChannel> _snapshot_channel;
+        uint64_t _iteration_count = 0; //completed, over all runs
     public:
         PetriNetSimulator(const PetriNetCreator &creator,
                           MeanEstimator &cumulative_estimator,
@@ -33,16 +76,51 @@ namespace Simulating
                           double end_time,
                           size_t source_index)
                 : _petri_net(creator.CreatePetriNet()), _cumulative_estimator(cumulative_estimator),
-                  _transient_estimator(transient_estimator), _end_time(end_time), _source_index(source_index)
+                  _transient_estimator(transient_estimator), _end_time(end_time), _source_index(source_index),
+                  _snapshot_channel(new SnapshotChannel())
         { }
 
         void Run(int iteration_num, UniformRandomNumberGenerator &generator);
 
+        void SetTauLeaping(double epsilon)
+        { _petri_net.SetTauLeaping(epsilon); }
+
+        // every replication is followed by its antithetic twin, and the pair counts as one iteration
+        void SetAntithetic(bool antithetic)
+        { _antithetic = antithetic; }
+
+        // see PetriNet::SetCommonRandomNumbers
+        void SetCommonRandomNumbers(uint64_t seed, uint64_t first_replication = 0)
+        { _petri_net.SetCommonRandomNumbers(seed, first_replication); }
+
+        // Conditional Monte Carlo for Markovian nets: cumulative rewards use expected instead of sampled sojourn
+        // times, see SimulateConditionalReplication. Not available with tau-leaping, importance sampling, rate
+        // parameters or a stopping predicate.
+        void SetConditionalSojourn(bool conditional_sojourn);
+
+        // Records every replication to the writer, which has to outlive the runs. Replications with conditional
+        // sojourn times are not recorded, and a replay submits the two runs of an antithetic pair separately.
+        void SetTraceWriter(Trace::TraceWriter *trace_writer)
+        { _trace_writer = trace_writer; }
+
+        // Runs snapshot at the next boundary between iterations, right away if no run is in progress, and waits for
+        // it. The snapshot thus sees the estimator source, the generator and the iteration count of one boundary,
+        // while the worker only pauses for the snapshot itself.
+        void Snapshot(const std::function<void()> &snapshot);
+
+        // for snapshots, and to resume from one
+        uint64_t GetIterationCount() const
+        { return _iteration_count; }
+
+        void SetIterationCount(uint64_t iteration_count)
+        { _iteration_count = iteration_count; }
+
         // we require that _end_time < infinity
         void RunAsync(int iteration_num, UniformRandomNumberGenerator &generator)
         {
             _stop = false;
             _running = true;
+            SetSnapshotRunning(true);
             _worker_thread = thread(worker, this, iteration_num, std::ref(generator));
         }
 
@@ -62,10 +140,49 @@ namespace Simulating
         bool IsRunning()
         { return _running; }
 
+    private:
+        void RunReplication(UniformRandomNumberGenerator &generator);
+
+        void SetSnapshotRunning(bool running);
+
+        // counts a completed iteration and serves a pending snapshot
+        void EndIteration();
+
+    };
+
+    // Runs replications on several workers and merges their results; what SimulatorController drives.
+    class SimulatorBackend
+    {
+    public:
+        virtual ~SimulatorBackend()
+        { }
+
+        virtual void RunAsync(uint32_t iteration_count) = 0;
+
+        virtual void Stop() = 0;
 
+        virtual void Wait() = 0;
+
+        virtual bool IsRunning() = 0;
+
+        // merges the results the workers have so far into the estimators
+        virtual void UpdateResult() = 0;
+
+        virtual MeanEstimator &GetCumulativeEstimator() = 0;
+
+        virtual MeanEstimator &GetTransientEstimator() = 0;
+
+        virtual void SaveCheckpoint(const string &path) = 0;
+
+        virtual void ResumeAsync(const string &path) = 0;
+    };
+
+    // the backend cannot save the state of its workers
+    class CheckpointNotSupported : public std::exception
+    {
     };
 
-    class PetriNetMultiSimulator
+    class PetriNetMultiSimulator : public SimulatorBackend
     {
         size_t _simulator_count;
         MeanEstimator _cumulative_estimator;
@@ -74,6 +191,17 @@ namespace Simulating
         vector<DefaultUniformRandomNumberGenerator> _generator_list;
         const PetriNetCreator &_creator;
         double _end_time;
+        double _tau_leaping_epsilon = 0.0;
+        bool _antithetic = false;
+        bool _conditional_sojourn = false;
+        bool _common_random_numbers = false;
+        uint64_t _substream_seed = 0;
+        string _trace_prefix;
+        vector<std::unique_ptr<Trace::TraceWriter>> _trace_writer_list;
+        bool _seeded = false;
+        unsigned long _seed = 0;
+        uint32_t _iteration_per_worker = 0;
+        std::mutex _checkpoint_mutex;
     public:
         PetriNetMultiSimulator(const PetriNetCreator &creator,
                                size_t simulator_count,
@@ -91,9 +219,57 @@ namespace Simulating
             Wait();
         }
 
-        void RunAsync(uint32_t interation_count);
+        virtual void RunAsync(uint32_t interation_count) override;
 
-        void Stop()
+        // worker i draws its random numbers from seed + i; by default the generators are seeded from the clock
+        void SetSeed(unsigned long seed)
+        {
+            _seeded = true;
+            _seed = seed;
+        }
+
+        // Writes the accumulated replications, the generator positions and the iteration counts of all workers,
+        // taken at a boundary between iterations of each worker, atomically to `path`. May be called while
+        // running.
+        virtual void SaveCheckpoint(const string &path) override;
+
+        // Continues the run saved in the checkpoint, with this simulator configured like the one that saved it, so
+        // that the final result equals that of the uninterrupted run. Throws SerializationError if the checkpoint
+        // is corrupt or does not fit the net, the workers, the horizon or the random variables. Trace files are
+        // started anew.
+        virtual void ResumeAsync(const string &path) override;
+
+        void Resume(const string &path)
+        {
+            ResumeAsync(path);
+            Wait();
+        }
+
+        void SetTauLeaping(double epsilon)
+        { _tau_leaping_epsilon = epsilon; }
+
+        void SetAntithetic(bool antithetic)
+        { _antithetic = antithetic; }
+
+        void SetConditionalSojourn(bool conditional_sojourn)
+        { _conditional_sojourn = conditional_sojourn; }
+
+        // worker i records its replications to the trace file prefix + "." + i, to be replayed as source i
+        void SetTracePrefix(const string &prefix)
+        { _trace_prefix = prefix; }
+
+        static string TracePath(const string &prefix, size_t worker_index)
+        { return prefix + "." + std::to_string(worker_index); }
+
+        // Worker i simulates the replications from i * (iteration count / worker count) on, so runs of model
+        // variants with the same seed and iteration count use common random numbers.
+        void SetCommonRandomNumbers(uint64_t seed)
+        {
+            _common_random_numbers = true;
+            _substream_seed = seed;
+        }
+
+        virtual void Stop() override
         {
             for (size_t i = 0; i < _simulator_count; i++)
             {
@@ -101,16 +277,20 @@ namespace Simulating
             }
         }
 
-        void Wait()
+        virtual void Wait() override
         {
             for (size_t i = 0; i < _simulator_count; i++)
             {
                 _simulator_list[i].Wait();
             }
+            for (auto &trace_writer:_trace_writer_list)
+            {
+                trace_writer->Flush();
+            }
             UpdateResult();
         }
 
-        bool IsRunning()
+        virtual bool IsRunning() override
         {
             for (size_t i = 0; i < _simulator_count; i++)
             {
@@ -122,13 +302,13 @@ namespace Simulating
             return false;
         }
 
-        MeanEstimator &GetCumulativeEstimator()
+        virtual MeanEstimator &GetCumulativeEstimator() override
         { return _cumulative_estimator; }
 
-        MeanEstimator &GetTransientEstimator()
+        virtual MeanEstimator &GetTransientEstimator() override
         { return _transient_estimator; }
 
-        void UpdateResult()
+        virtual void UpdateResult() override
         {
             _cumulative_estimator.ClearResult();
             _transient_estimator.ClearResult();
@@ -138,9 +318,212 @@ namespace Simulating
             }
         }
 
+    private:
+        void CreateWorkers(uint32_t iteration_per_worker);
+
+        void StartWorkers();
 
     };
 
+    // Randomized quasi-Monte Carlo: every randomization runs the point_count replications of one randomly shifted
+    // lattice, and contributes its average as one sample, so the confidence intervals come from the spread between
+    // randomizations. Pays off for short horizons where the first `dimension` random numbers of a replication
+    // determine most of it.
+    class RqmcSimulator
+    {
+    private:
+        const PetriNetCreator &_creator;
+        size_t _worker_count;
+        double _end_time;
+        LatticeUniformRandomNumberGenerator _lattice;
+        MeanEstimator _cumulative_estimator;
+        MeanEstimator _transient_estimator;
+        std::atomic<uint32_t> _next_randomization;
+    public:
+        RqmcSimulator(const PetriNetCreator &creator, size_t worker_count, double end_time, uint64_t point_count,
+                      size_t dimension);
+
+        RqmcSimulator(const RqmcSimulator &) = delete;
+
+        // worker i draws its shifts from seed + i
+        void Run(uint32_t randomization_count, unsigned long seed);
+
+        MeanEstimator &GetCumulativeEstimator()
+        { return _cumulative_estimator; }
+
+        MeanEstimator &GetTransientEstimator()
+        { return _transient_estimator; }
+
+    private:
+        void RunWorker(size_t source_index, uint32_t randomization_count, unsigned long seed);
+    };
+
+    // The question an adaptive sweep answers about one reward variable: which design point has the smallest or the
+    // largest mean, or on which side of the threshold the mean of every design point lies. Means closer than the
+    // indifference to each other or to the threshold need not be told apart.
+    class SweepDecision
+    {
+    public:
+        enum Type
+        {
+            Minimum,
+            Maximum,
+            Threshold,
+        };
+    private:
+        Type _type;
+        bool _transient;
+        size_t _variable_index;
+        double _threshold;
+        double _confidence_coefficient;
+        double _indifference;
+    public:
+        SweepDecision(Type type, bool transient, size_t variable_index, double threshold = 0.0,
+                      double confidence_coefficient = 0.95, double indifference = 0.0) :
+                _type(type), _transient(transient), _variable_index(variable_index), _threshold(threshold),
+                _confidence_coefficient(confidence_coefficient), _indifference(indifference)
+        { }
+
+        Type GetType() const
+        { return _type; }
+
+        bool IsTransient() const
+        { return _transient; }
+
+        size_t GetVariableIndex() const
+        { return _variable_index; }
+
+        double GetThreshold() const
+        { return _threshold; }
+
+        double GetConfidenceCoefficient() const
+        { return _confidence_coefficient; }
+
+        double GetIndifference() const
+        { return _indifference; }
+    };
+
+    // Parameter sweep: one topology simulated at many design points. Every worker compiles the net once and moves
+    // it from point to point by swapping the firing time functions built from the point's parameter values, and
+    // the workers take blocks of replications of any point from a common queue, so no worker idles while another
+    // finishes a point. With common random numbers, replication i of every point uses the same streams.
+    class SweepSimulator
+    {
+    public:
+        // the firing time function of a transition for a value of its parameter, e.g. Statistics::Exp
+        typedef std::function<Transition::FiringTimeFuncType(double value)> FiringTimeFactory;
+    private:
+        struct Binding
+        {
+            size_t parameter_index;
+            size_t transition_index;
+            FiringTimeFactory factory;
+        };
+
+        struct Worker
+        {
+            PetriNet petri_net;
+            DefaultUniformRandomNumberGenerator generator;
+            size_t point_index; //whose firing time functions the net has
+        };
+
+        struct ReplicationBlock
+        {
+            size_t point_index;
+            uint64_t first_replication;
+            uint64_t replication_count;
+        };
+
+        static const uint64_t ReplicationBlockSize = 64;
+
+        const PetriNetCreator &_creator;
+        size_t _worker_count;
+        double _end_time;
+        size_t _parameter_count = 0;
+        vector<Binding> _binding_list;
+        vector<vector<double>> _design_point_list;
+        vector<RandomVariable> _cumulative_variable_list;
+        vector<RandomVariable> _transient_variable_list;
+        vector<std::unique_ptr<MeanEstimator>> _cumulative_estimator_list; //per design point
+        vector<std::unique_ptr<MeanEstimator>> _transient_estimator_list;
+        vector<vector<Transition::FiringTimeFuncType>> _point_func_list; //per design point, per binding
+        vector<uint64_t> _replication_count_list; //per design point
+        vector<Worker> _worker_list;
+        vector<ReplicationBlock> _block_list;
+        std::atomic<size_t> _next_block;
+        bool _common_random_numbers = false;
+        uint64_t _substream_seed = 0;
+        size_t _selected_point = 0;
+    public:
+        SweepSimulator(const PetriNetCreator &creator, size_t worker_count, double end_time) :
+                _creator(creator), _worker_count(worker_count), _end_time(end_time), _next_block(0)
+        { }
+
+        SweepSimulator(const SweepSimulator &) = delete;
+
+        // the firing times of the given timed transitions become factory(value of the parameter)
+        size_t AddParameter(const vector<string> &transition_names, const FiringTimeFactory &factory);
+
+        size_t AddDesignPoint(const vector<double> &parameter_values);
+
+        void AddCumulativeVariable(const RandomVariable &random_variable)
+        { _cumulative_variable_list.push_back(random_variable); }
+
+        void AddTransientVariable(const RandomVariable &random_variable)
+        { _transient_variable_list.push_back(random_variable); }
+
+        void SetCommonRandomNumbers(uint64_t seed)
+        {
+            _common_random_numbers = true;
+            _substream_seed = seed;
+        }
+
+        // replication_count replications of every design point, worker i draws from seed + i
+        void Run(uint32_t replication_count, unsigned long seed);
+
+        // Sequential allocation: every design point first gets initial_count replications, then batches of
+        // batch_count replications go to the points that limit the decision, until it is reached with the
+        // requested confidence (Bonferroni over the points) or max_replication_count replications have been run
+        // in total. Selections are allocated by OCBA (Chen et al.), thresholds in proportion to the variance over
+        // the squared distance to the threshold of every undecided point. Returns whether the decision was reached.
+        bool RunAdaptive(const SweepDecision &decision, uint32_t initial_count, uint32_t batch_count,
+                         uint64_t max_replication_count, unsigned long seed);
+
+        // the best design point found by the last adaptive selection
+        size_t GetSelectedPoint() const
+        { return _selected_point; }
+
+        size_t GetDesignPointCount() const
+        { return _design_point_list.size(); }
+
+        uint64_t GetReplicationCount(size_t point_index) const
+        { return _replication_count_list[point_index]; }
+
+        MeanEstimator &GetCumulativeEstimator(size_t point_index)
+        { return *_cumulative_estimator_list[point_index]; }
+
+        MeanEstimator &GetTransientEstimator(size_t point_index)
+        { return *_transient_estimator_list[point_index]; }
+
+    private:
+        void Prepare(unsigned long seed);
+
+        // runs count_list[i] more replications of every design point i and refreshes the results
+        void RunBatch(const vector<uint64_t> &count_list);
+
+        void RunWorker(size_t source_index);
+
+        const SamplingResult &GetDecisionResult(const SweepDecision &decision, size_t point_index)
+        {
+            MeanEstimator &estimator = decision.IsTransient() ? GetTransientEstimator(point_index) :
+                                       GetCumulativeEstimator(point_index);
+            return estimator.GetRandomVariableList()[decision.GetVariableIndex()].GetSamplingResult();
+        }
+
+        // the allocation weight of every design point, all 0 once the decision is reached
+        vector<double> DecisionWeights(const SweepDecision &decision);
+    };
+
     class TargetPrecision
     {
     public:
@@ -183,19 +566,37 @@ namespace Simulating
     //TODO: Add signal catch
     class SimulatorController
     {
-        PetriNetMultiSimulator &_simulator;
+        SimulatorBackend &_simulator;
         TargetPrecision _precision;
+        string _checkpoint_path;
+        double _checkpoint_interval = 0.0;
+        std::chrono::steady_clock::time_point _last_checkpoint_time;
     public:
-        SimulatorController(PetriNetMultiSimulator &simulator,
+        SimulatorController(SimulatorBackend &simulator,
                             TargetPrecision precision = TargetPrecision(TargetPrecision::Inf, 0.0))
                 : _simulator(simulator), _precision(precision)
         { }
 
         void Start(uint32_t max_interation_count)
         {
+            _last_checkpoint_time = std::chrono::steady_clock::now();
             _simulator.RunAsync(max_interation_count);
         }
 
+        // continues a run from its checkpoint instead of starting it
+        void Resume(const string &checkpoint_path)
+        {
+            _last_checkpoint_time = std::chrono::steady_clock::now();
+            _simulator.ResumeAsync(checkpoint_path);
+        }
+
+        // WaitFor saves a checkpoint whenever interval_seconds have passed since the last one, and when the run ends
+        void SetCheckpoint(const string &path, double interval_seconds)
+        {
+            _checkpoint_path = path;
+            _checkpoint_interval = interval_seconds;
+        }
+
         bool WaitFor(double seconds);
 
         string ResultToString() const;
@@ -0,0 +1,124 @@
+//
+
+#include <algorithm>
+#include "Splitting.h"
+
+namespace Splitting
+{
+    RestartSimulator::RestartSimulator(const PetriNetCreator &creator, size_t worker_count, double end_time,
+                                       const ImportanceFuncType &importance_func,
+                                       const vector<double> &threshold_list,
+                                       const vector<size_t> &splitting_factor_list) :
+            _creator(creator), _worker_count(worker_count), _end_time(end_time), _importance_func(importance_func),
+            _threshold_list(threshold_list), _splitting_factor_list(splitting_factor_list),
+            _cumulative_estimator(worker_count), _transient_estimator(worker_count), _next_root(0)
+    {
+        if (threshold_list.size() != splitting_factor_list.size())
+        {
+            throw InvalidSplitting();
+        }
+        _level_weight_list.push_back(1.0);
+        for (size_t level = 0; level < threshold_list.size(); level++)
+        {
+            if ((level > 0 && threshold_list[level] <= threshold_list[level - 1]) || splitting_factor_list[level] < 1)
+            {
+                throw InvalidSplitting();
+            }
+            _level_weight_list.push_back(_level_weight_list.back() / splitting_factor_list[level]);
+        }
+    }
+
+    void RestartSimulator::Run(uint32_t root_count, unsigned long seed)
+    {
+        _next_root = 0;
+        vector<std::thread> thread_list;
+        for (size_t i = 0; i < _worker_count; i++)
+        {
+            thread_list.push_back(std::thread(&RestartSimulator::RunWorker, this, i, root_count, seed + i));
+        }
+        for (auto &worker_thread:thread_list)
+        {
+            worker_thread.join();
+        }
+        _cumulative_estimator.ClearResult();
+        _transient_estimator.ClearResult();
+        for (size_t i = 0; i < _worker_count; i++)
+        {
+            _cumulative_estimator.SubmitResult(i);
+            _transient_estimator.SubmitResult(i);
+        }
+    }
+
+    size_t RestartSimulator::Level(const PetriNet &petri_net) const
+    {
+        return std::upper_bound(_threshold_list.begin(), _threshold_list.end(), _importance_func(petri_net)) -
+               _threshold_list.begin();
+    }
+
+    void RestartSimulator::RunWorker(size_t source_index, uint32_t root_count, unsigned long seed)
+    {
+        Worker worker{_creator.CreatePetriNet(), DefaultUniformRandomNumberGenerator(seed), {}};
+        worker.petri_net.SetHorizon(_end_time);
+        // roots are handed out one by one since the size of their trees varies a lot
+        while (_next_root++ < root_count)
+        {
+            size_t pending_count = 0;
+            worker.petri_net.Reset(worker.generator);
+            RunBranch(source_index, worker, 0, 0, pending_count);
+            while (pending_count > 0)
+            {
+                pending_count--;
+                const Branch &branch = worker.branch_pool[pending_count];
+                worker.petri_net.RestoreState(branch.state);
+                worker.petri_net.RenewMemorylessClocks(worker.generator);
+                RunBranch(source_index, worker, branch.birth_level, branch.birth_level, pending_count);
+            }
+            _cumulative_estimator.SubmitMean(source_index, _end_time);
+            _transient_estimator.SubmitMean(source_index, 1.0);
+        }
+    }
+
+    void RestartSimulator::RunBranch(size_t source_index, Worker &worker, size_t birth_level, size_t split_level,
+                                     size_t &pending_count)
+    {
+        PetriNet &petri_net = worker.petri_net;
+        while (true)
+        {
+            size_t level = Level(petri_net);
+            if (level < birth_level)
+            {
+                return;
+            }
+            for (size_t crossed = split_level + 1; crossed <= level; crossed++)
+            {
+                for (size_t copy = 1; copy < _splitting_factor_list[crossed - 1]; copy++)
+                {
+                    if (pending_count == worker.branch_pool.size())
+                    {
+                        worker.branch_pool.emplace_back();
+                    }
+                    Branch &branch = worker.branch_pool[pending_count++];
+                    petri_net.SaveState(branch.state);
+                    branch.birth_level = crossed;
+                }
+            }
+            split_level = level;
+
+            double weight = _level_weight_list[level];
+            // a trajectory ends at the stopping predicate as in SimulateReplication
+            if (petri_net.IsStopped() || petri_net.GetNextFiringTime() >= _end_time)
+            {
+                double stop_time = petri_net.IsStopped() ? petri_net.GetTime() : _end_time;
+                _cumulative_estimator.InputSample(source_index, petri_net, stop_time - petri_net.GetTime(),
+                                                  weight * petri_net.GetMeanLikelihoodRatio(stop_time));
+                _transient_estimator.InputSample(source_index, petri_net, 1.0,
+                                                 weight * petri_net.GetLikelihoodRatio(stop_time));
+                return;
+            }
+            _cumulative_estimator.InputSample(source_index, petri_net, petri_net.GetDuration(),
+                                              weight * petri_net.GetMeanLikelihoodRatio(
+                                                      petri_net.GetNextFiringTime()));
+            petri_net.NextState(worker.generator);
+        }
+    }
+}
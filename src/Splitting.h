@@ -0,0 +1,80 @@
+//
+
+#ifndef SPNP_SPLITTING_H
+#define SPNP_SPLITTING_H
+
+#include <atomic>
+#include <thread>
+#include "PetriNetModel/PetriNetModel.h"
+#include "Estimating.h"
+
+namespace Splitting
+{
+    using namespace PetriNetModel;
+    using namespace Estimating;
+
+    // thresholds have to be strictly increasing, with one splitting factor (at least 1) each
+    class InvalidSplitting : public std::exception
+    {
+    };
+
+    // RESTART multilevel splitting. The importance function maps markings to levels through the thresholds. A
+    // trajectory that crosses threshold i upwards is split into splitting_factor[i] copies: it continues itself
+    // and the extra copies (retrials) start from a snapshot of its state, clocks included, so any firing time
+    // distribution works; only exponential clocks are redrawn for the retrials. A retrial is killed as soon as it
+    // falls below the threshold it was born at. Rewards of a trajectory are weighted by one over the product of the
+    // splitting factors of its current level, so the estimates are those of plain simulation. A trajectory ends at
+    // the stopping predicate of the net, if any. Root trajectories are spread over worker threads.
+    class RestartSimulator
+    {
+    public:
+        typedef std::function<double(const PetriNet &)> ImportanceFuncType;
+    private:
+        struct Branch
+        {
+            PetriNetState state;
+            size_t birth_level;
+        };
+        struct Worker
+        {
+            PetriNet petri_net;
+            DefaultUniformRandomNumberGenerator generator;
+            vector<Branch> branch_pool; //pending retrials of the current root, reused between roots
+        };
+        const PetriNetCreator &_creator;
+        size_t _worker_count;
+        double _end_time;
+        ImportanceFuncType _importance_func;
+        vector<double> _threshold_list;
+        vector<size_t> _splitting_factor_list;
+        vector<double> _level_weight_list;
+        MeanEstimator _cumulative_estimator;
+        MeanEstimator _transient_estimator;
+        std::atomic<uint32_t> _next_root;
+    public:
+        RestartSimulator(const PetriNetCreator &creator, size_t worker_count, double end_time,
+                         const ImportanceFuncType &importance_func, const vector<double> &threshold_list,
+                         const vector<size_t> &splitting_factor_list);
+
+        RestartSimulator(const RestartSimulator &) = delete;
+
+        // simulates root_count root trajectories with their retrials; worker i is seeded with seed + i
+        void Run(uint32_t root_count, unsigned long seed);
+
+        MeanEstimator &GetCumulativeEstimator()
+        { return _cumulative_estimator; }
+
+        MeanEstimator &GetTransientEstimator()
+        { return _transient_estimator; }
+
+    private:
+        size_t Level(const PetriNet &petri_net) const;
+
+        void RunWorker(size_t source_index, uint32_t root_count, unsigned long seed);
+
+        void RunBranch(size_t source_index, Worker &worker, size_t birth_level, size_t split_level,
+                       size_t &pending_count);
+    };
+}
+
+#endif //SPNP_SPLITTING_H
@@ -45,12 +45,58 @@ namespace Statistics
         return x;
     }
 
+    // the continued fraction of I_x(a, b) by the modified Lentz method, converging fast for x < (a + 1) / (a + b + 2)
+    static double IncompleteBetaFraction(double x, double a, double b)
+    {
+        const double tiny = 1e-300;
+        double c = 1.0;
+        double d = 1.0 - (a + b) * x / (a + 1.0);
+        d = 1.0 / (std::abs(d) < tiny ? tiny : d);
+        double fraction = d;
+        for (int m = 1; m <= 1000; m++)
+        {
+            for (int step = 0; step < 2; step++)
+            {
+                double numerator = step == 0 ? m * (b - m) * x / ((a + 2 * m - 1) * (a + 2 * m)) :
+                                   -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 2 * m + 1));
+                d = 1.0 + numerator * d;
+                d = 1.0 / (std::abs(d) < tiny ? tiny : d);
+                c = 1.0 + numerator / c;
+                c = std::abs(c) < tiny ? tiny : c;
+                fraction *= d * c;
+                if (step == 1 && std::abs(d * c - 1.0) < 1e-14)
+                {
+                    return fraction;
+                }
+            }
+        }
+        return fraction;
+    }
+
+    double RegularizedIncompleteBeta(double x, double a, double b)
+    {
+        if (x <= 0.0)
+        {
+            return 0.0;
+        }
+        if (x >= 1.0)
+        {
+            return 1.0;
+        }
+        double log_front = std::lgamma(a + b) - std::lgamma(a) - std::lgamma(b) + a * std::log(x) +
+                           b * std::log1p(-x);
+        if (x < (a + 1.0) / (a + b + 2.0))
+        {
+            return std::exp(log_front) * IncompleteBetaFraction(x, a, b) / a;
+        }
+        return 1.0 - std::exp(log_front) * IncompleteBetaFraction(1.0 - x, b, a) / b;
+    }
+
 
 
     std::function<double(double uniform_rand_num)> Exp(double lambda)
     {
-        return [lambda](double p)
-        { return -std::log(1 - p) / lambda; };
+        return ExpSampler{lambda};
     }
 
     std::function<double(double uniform_rand_num)> ParetoTrunc(double alpha, double m, double n)
@@ -78,4 +124,237 @@ namespace Statistics
         };
     }
 
+    long PoissonVariate(double mean, UniformRandomNumberGenerator &generator)
+    {
+        if (mean <= 0.0)
+        {
+            return 0;
+        }
+        if (mean < 10.0)
+        {
+            double u = generator.GetVariate();
+            double p = std::exp(-mean);
+            double cumulative = p;
+            long k = 0;
+            while (u > cumulative && p > 0.0)
+            {
+                k++;
+                p *= mean / k;
+                cumulative += p;
+            }
+            return k;
+        }
+        double smu = std::sqrt(mean);
+        double b = 0.931 + 2.53 * smu;
+        double a = -0.059 + 0.02483 * b;
+        double inv_alpha = 1.1239 + 1.1328 / (b - 3.4);
+        double vr = 0.9277 - 3.6224 / (b - 2.0);
+        double log_mean = std::log(mean);
+        while (true)
+        {
+            double u = generator.GetVariate() - 0.5;
+            double v = generator.GetVariate();
+            double us = 0.5 - std::abs(u);
+            long k = (long) std::floor((2.0 * a / us + b) * u + mean + 0.43);
+            if (us >= 0.07 && v <= vr)
+            {
+                return k;
+            }
+            if (k < 0 || (us < 0.013 && v > us))
+            {
+                continue;
+            }
+            if (std::log(v) + std::log(inv_alpha) - std::log(a / (us * us) + b) <=
+                -mean + k * log_mean - std::lgamma(k + 1.0))
+            {
+                return k;
+            }
+        }
+    }
+
+    AliasTable::AliasTable(const std::vector<double> &weight_list) :
+            _probability(weight_list.size(), 1.0), _alias(weight_list.size())
+    {
+        double total_weight = 0.0;
+        for (double weight:weight_list)
+        {
+            total_weight += weight;
+        }
+        std::vector<size_t> small_list;
+        std::vector<size_t> large_list;
+        for (size_t i = 0; i < weight_list.size(); i++)
+        {
+            _alias[i] = i;
+            _probability[i] = weight_list[i] * weight_list.size() / total_weight;
+            if (_probability[i] < 1.0)
+            {
+                small_list.push_back(i);
+            } else
+            {
+                large_list.push_back(i);
+            }
+        }
+        while (!small_list.empty() && !large_list.empty())
+        {
+            size_t small = small_list.back();
+            size_t large = large_list.back();
+            small_list.pop_back();
+            _alias[small] = large;
+            _probability[large] -= 1.0 - _probability[small];
+            if (_probability[large] < 1.0)
+            {
+                large_list.pop_back();
+                small_list.push_back(large);
+            }
+        }
+        // leftovers are only off from 1 by rounding errors
+        for (size_t i:small_list)
+        {
+            _probability[i] = 1.0;
+        }
+        for (size_t i:large_list)
+        {
+            _probability[i] = 1.0;
+        }
+    }
+
+    uint64_t MixSeed(uint64_t lhs, uint64_t rhs)
+    {
+        uint64_t z = lhs ^ (rhs + 0x9E3779B97F4A7C15ULL + (lhs << 6) + (lhs >> 2));
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    bool SolveLinearSystem(std::vector<double> &a, std::vector<double> &b, size_t n)
+    {
+        for (size_t col = 0; col < n; col++)
+        {
+            size_t pivot = col;
+            for (size_t row = col + 1; row < n; row++)
+            {
+                if (std::abs(a[row * n + col]) > std::abs(a[pivot * n + col]))
+                {
+                    pivot = row;
+                }
+            }
+            if (a[pivot * n + col] == 0.0)
+            {
+                return false;
+            }
+            if (pivot != col)
+            {
+                for (size_t k = 0; k < n; k++)
+                {
+                    std::swap(a[col * n + k], a[pivot * n + k]);
+                }
+                std::swap(b[col], b[pivot]);
+            }
+            double diag = a[col * n + col];
+            for (size_t row = col + 1; row < n; row++)
+            {
+                double factor = a[row * n + col] / diag;
+                if (factor == 0.0)
+                {
+                    continue;
+                }
+                for (size_t k = col; k < n; k++)
+                {
+                    a[row * n + k] -= factor * a[col * n + k];
+                }
+                b[row] -= factor * b[col];
+            }
+        }
+        for (size_t row = n; row-- > 0;)
+        {
+            double sum = b[row];
+            for (size_t k = row + 1; k < n; k++)
+            {
+                sum -= a[row * n + k] * b[k];
+            }
+            b[row] = sum / a[row * n + row];
+        }
+        return true;
+    }
+    LatticeUniformRandomNumberGenerator::LatticeUniformRandomNumberGenerator(uint64_t point_count, size_t dimension,
+                                                                             uint64_t korobov_generator) :
+            _point_count(point_count), _shift(dimension, 0.0)
+    {
+        auto generating_vector = [point_count, dimension](uint64_t a)
+        {
+            std::vector<uint64_t> vec(dimension);
+            uint64_t power = 1;
+            for (size_t j = 0; j < dimension; j++)
+            {
+                vec[j] = power;
+                power = power * a % point_count;
+            }
+            return vec;
+        };
+        if (korobov_generator != 0)
+        {
+            _generating_vector = generating_vector(korobov_generator % point_count);
+            return;
+        }
+        // P2 = -1 + 1/n sum_i prod_j (1 + 2 pi^2 B2({i z_j / n})) over a sample of candidates, on the leading
+        // dimensions, which matter most for short replications
+        const size_t candidate_count = 64;
+        const size_t criterion_dimension = std::min<size_t>(dimension, 8);
+        const double pi = std::acos(-1.0); //M_PI is not standard C++
+        SplitMixUniformRandomNumberGenerator candidate_generator;
+        candidate_generator.Seed(point_count);
+        double best_criterion = std::numeric_limits<double>::infinity();
+        uint64_t best = 1;
+        for (size_t candidate = 0; candidate < candidate_count && point_count > 2; candidate++)
+        {
+            uint64_t a = 2 + (uint64_t) (candidate_generator.GetVariate() * (point_count - 2));
+            uint64_t gcd_lhs = a;
+            uint64_t gcd_rhs = point_count;
+            while (gcd_rhs != 0)
+            {
+                std::swap(gcd_lhs, gcd_rhs);
+                gcd_rhs %= gcd_lhs;
+            }
+            if (gcd_lhs != 1) //the points would collapse onto a sublattice
+            {
+                continue;
+            }
+            std::vector<uint64_t> vec = generating_vector(a);
+            double criterion = -1.0;
+            for (uint64_t i = 0; i < point_count; i++)
+            {
+                double product = 1.0;
+                for (size_t j = 0; j < criterion_dimension; j++)
+                {
+                    double x = (double) (i * vec[j] % point_count) / point_count;
+                    product *= 1.0 + 2.0 * pi * pi * (x * x - x + 1.0 / 6.0);
+                }
+                criterion += product / point_count;
+            }
+            if (criterion < best_criterion)
+            {
+                best_criterion = criterion;
+                best = a;
+            }
+        }
+        _generating_vector = generating_vector(best);
+    }
+
+    void LatticeUniformRandomNumberGenerator::Randomize(UniformRandomNumberGenerator &generator)
+    {
+        for (double &shift:_shift)
+        {
+            shift = generator.GetVariate();
+        }
+        _padding_seed = (uint64_t) (generator.GetVariate() * 9007199254740992.0);
+        _next_point = 0;
+    }
+
+    void LatticeUniformRandomNumberGenerator::StartReplication()
+    {
+        _point = _next_point;
+        _next_point = (_next_point + 1) % _point_count;
+        _coordinate = 0;
+        _padding.Seed(MixSeed(_padding_seed, _point));
+    }
 }
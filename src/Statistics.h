@@ -6,15 +6,32 @@
 #define SPNP_DISTRIBUTION_H
 
 #include <cmath>
+#include <cstdint>
 #include <limits>
 #include <random>
 #include <functional>
 #include <chrono>
+#include <vector>
+#include <algorithm>
+#include <sstream>
+#include <string>
 
 namespace Statistics
 {
     double StdNormQuantile(double p);
 
+    // I_x(a, b), the distribution function of Beta(a, b) at x
+    double RegularizedIncompleteBeta(double x, double a, double b);
+
+    // the sampler behind Exp(), so that exponential firing times can be recognized by target<ExpSampler>()
+    struct ExpSampler
+    {
+        double lambda;
+
+        double operator()(double p) const
+        { return -std::log(1 - p) / lambda; }
+    };
+
     std::function<double(double uniform_rand_num)> Exp(double lambda);
 
     std::function<double(double uniform_rand_num)> ParetoTrunc(double alpha, double m, double n);
@@ -23,12 +40,38 @@ namespace Statistics
 
     std::function<double(double uniform_rand_num)> Deterministic(double t);
 
+    // Walker's alias method: draws an index with probability proportional to its weight from one uniform number.
+    class AliasTable
+    {
+    private:
+        std::vector<double> _probability;
+        std::vector<size_t> _alias;
+    public:
+        AliasTable() = default;
+
+        AliasTable(const std::vector<double> &weight_list);
+
+        size_t Sample(double uniform_rand_num) const
+        {
+            double scaled = uniform_rand_num * _probability.size();
+            size_t index = std::min((size_t) scaled, _probability.size() - 1);
+            return (scaled - index) < _probability[index] ? index : _alias[index];
+        }
+
+        size_t Size() const
+        { return _probability.size(); }
+    };
+
 
     class UniformRandomNumberGenerator
     {
     public:
         virtual double GetVariate() = 0;
 
+        // called before every replication; generators that allocate their numbers per replication start over
+        virtual void StartReplication()
+        { }
+
         virtual ~UniformRandomNumberGenerator()
         { }
     };
@@ -58,8 +101,152 @@ namespace Statistics
             _generator.seed(seed);
         }
 
+        // the position in the stream, for checkpoints
+        std::string GetState() const
+        {
+            std::ostringstream ss;
+            ss << _generator;
+            return ss.str();
+        }
+
+        // false if the state is corrupt, leaving the generator as it was
+        bool SetState(const std::string &state)
+        {
+            std::istringstream ss(state);
+            std::default_random_engine generator;
+            ss >> generator;
+            if (!ss || !(ss >> std::ws).eof())
+            {
+                return false;
+            }
+            _generator = generator;
+            _uniform_dist.reset();
+            return true;
+        }
+
+    };
+
+    // SplitMix64: a single word of state, so it is cheap to seed one stream per transition and replication.
+    // An antithetic stream returns 1 - u for the same seed.
+    class SplitMixUniformRandomNumberGenerator : public UniformRandomNumberGenerator
+    {
+    private:
+        uint64_t _state = 0;
+        bool _antithetic = false;
+    public:
+        virtual double GetVariate() override
+        {
+            uint64_t z = (_state += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            z ^= z >> 31;
+            double u = (z >> 11) * (1.0 / 9007199254740992.0);
+            return _antithetic ? 1.0 - u - (1.0 / 9007199254740992.0) : u;
+        }
+
+        void Seed(uint64_t seed, bool antithetic = false)
+        {
+            _state = seed;
+            _antithetic = antithetic;
+        }
+    };
+
+    // hashes the words into a seed, so that related streams (e.g. consecutive replications) are unrelated
+    uint64_t MixSeed(uint64_t lhs, uint64_t rhs);
+
+    // Antithetic variates: records the numbers drawn from the base generator during a replication and replays them
+    // as 1 - u during its twin. A twin that needs more numbers than were recorded draws fresh ones.
+    class AntitheticUniformRandomNumberGenerator : public UniformRandomNumberGenerator
+    {
+    private:
+        UniformRandomNumberGenerator &_base;
+        std::vector<double> _record;
+        size_t _replay_position = 0;
+        bool _replaying = false;
+    public:
+        AntitheticUniformRandomNumberGenerator(UniformRandomNumberGenerator &base) : _base(base)
+        { }
+
+        virtual double GetVariate() override
+        {
+            if (!_replaying)
+            {
+                _record.push_back(_base.GetVariate());
+                return _record.back();
+            }
+            if (_replay_position < _record.size())
+            {
+                // stay in [0, 1) like the base generator
+                return std::nextafter(1.0 - _record[_replay_position++], 0.0);
+            }
+            return _base.GetVariate();
+        }
+
+        virtual void StartReplication() override
+        {
+            _record.clear();
+            _replaying = false;
+            _base.StartReplication();
+        }
+
+        void StartTwin()
+        {
+            _replay_position = 0;
+            _replaying = true;
+        }
+    };
+
+    // Randomized quasi-Monte Carlo with a randomly shifted Korobov lattice rule of n points. Replication i after
+    // Randomize() uses lattice point i (mod n), and the j-th number it draws is coordinate j of that point, i.e.
+    // frac(i * a^j / n + shift_j). Numbers beyond the lattice dimension are pseudo random. Each randomization
+    // draws a new shift, so the averages over the n points of independent randomizations are independent unbiased
+    // estimates, and their spread gives the confidence interval.
+    class LatticeUniformRandomNumberGenerator : public UniformRandomNumberGenerator
+    {
+    private:
+        uint64_t _point_count;
+        std::vector<uint64_t> _generating_vector;
+        std::vector<double> _shift;
+        uint64_t _next_point = 0;
+        uint64_t _point = 0;
+        size_t _coordinate = 0;
+        uint64_t _padding_seed = 0;
+        SplitMixUniformRandomNumberGenerator _padding;
+    public:
+        // A korobov_generator of 0 picks one with a small worst-case error (P2 criterion) for the dimension.
+        // point_count must not exceed 2^32.
+        LatticeUniformRandomNumberGenerator(uint64_t point_count, size_t dimension, uint64_t korobov_generator = 0);
+
+        void Randomize(UniformRandomNumberGenerator &generator);
+
+        virtual void StartReplication() override;
+
+        virtual double GetVariate() override
+        {
+            if (_coordinate >= _generating_vector.size())
+            {
+                return _padding.GetVariate();
+            }
+            double u = (double) (_point * _generating_vector[_coordinate] % _point_count) / _point_count +
+                       _shift[_coordinate];
+            _coordinate++;
+            return u >= 1.0 ? u - 1.0 : u;
+        }
+
+        uint64_t GetKorobovGenerator() const
+        { return _generating_vector.size() > 1 ? _generating_vector[1] : 1; }
+
+        uint64_t GetPointCount() const
+        { return _point_count; }
     };
 
+    // inversion for small means, Hormann's transformed rejection (PTRS) for large ones
+    long PoissonVariate(double mean, UniformRandomNumberGenerator &generator);
+
+    // Solves a * x = b in place by Gaussian elimination with partial pivoting; a (n x n, row major) is overwritten
+    // and b receives x. Returns false if a is singular.
+    bool SolveLinearSystem(std::vector<double> &a, std::vector<double> &b, size_t n);
+
 }
 
 
@@ -0,0 +1,292 @@
+//
+
+#include <cstring>
+#include "Trace.h"
+
+namespace Trace
+{
+    static const char Magic[8] = {'S', 'P', 'N', 'P', 'T', 'R', 'C', '1'};
+
+    enum RecordTag : uint8_t
+    {
+        StartTag = 0, //followed by a keyframe
+        KeyframeTag = 1,
+        EventTag = 2,
+        EndTag = 3,
+    };
+
+    static uint64_t ZigZag(int64_t value)
+    { return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63); }
+
+    static int64_t UnZigZag(uint64_t value)
+    { return (int64_t) (value >> 1) ^ -(int64_t) (value & 1); }
+
+    TraceWriter::TraceWriter(const string &path, const PetriNetCreator &creator, size_t keyframe_interval) :
+            _stream(path, std::ios::binary | std::ios::trunc), _place_count(creator.GetPlaceCmdList().size()),
+            _keyframe_interval(keyframe_interval)
+    {
+        if (!_stream)
+        {
+            throw TraceIOError();
+        }
+        _buffer.reserve(BufferSize);
+        for (char c:Magic)
+        {
+            WriteByte((uint8_t) c);
+        }
+        WriteVarint(_place_count);
+        WriteVarint(creator.GetTransitionCmdList().size());
+    }
+
+    TraceWriter::~TraceWriter()
+    {
+        FlushBuffer();
+    }
+
+    void TraceWriter::WriteVarint(uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            WriteByte((uint8_t) (value | 0x80));
+            value >>= 7;
+        }
+        WriteByte((uint8_t) value);
+    }
+
+    void TraceWriter::WriteDouble(double value)
+    {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        for (int i = 0; i < 8; i++)
+        {
+            WriteByte((uint8_t) (bits >> (8 * i)));
+        }
+    }
+
+    void TraceWriter::WriteKeyframe(const PetriNet &petri_net)
+    {
+        for (size_t p_index = 0; p_index < _place_count; p_index++)
+        {
+            WriteVarint(ZigZag(petri_net.GetPlaceMark(p_index)));
+        }
+        _event_count = 0;
+    }
+
+    void TraceWriter::FlushBuffer()
+    {
+        _stream.write(_buffer.data(), _buffer.size());
+        _buffer.clear();
+    }
+
+    void TraceWriter::Flush()
+    {
+        FlushBuffer();
+        _stream.flush();
+        if (!_stream)
+        {
+            throw TraceIOError();
+        }
+    }
+
+    void TraceWriter::BeginReplication(PetriNet &petri_net)
+    {
+        if (petri_net.HasFluidPlaces() || petri_net.IsImportanceSampling())
+        {
+            throw TraceNotSupported();
+        }
+        petri_net.SetFiringLog(&_firing_log);
+        _firing_log.clear();
+        _last_time = petri_net.GetTime();
+        WriteByte(StartTag);
+        WriteKeyframe(petri_net);
+    }
+
+    void TraceWriter::RecordEvent(const PetriNet &petri_net)
+    {
+        WriteByte(EventTag);
+        WriteDouble(petri_net.GetTime() - _last_time);
+        _last_time = petri_net.GetTime();
+        WriteVarint(_firing_log.size());
+        for (const auto &firing:_firing_log)
+        {
+            // the low bit tells whether a firing count follows
+            WriteVarint(firing.first << 1 | (firing.second != 1 ? 1 : 0));
+            if (firing.second != 1)
+            {
+                WriteVarint((uint64_t) firing.second);
+            }
+        }
+        _firing_log.clear();
+        if (++_event_count == _keyframe_interval)
+        {
+            WriteByte(KeyframeTag);
+            WriteKeyframe(petri_net);
+        }
+    }
+
+    void TraceWriter::EndReplication(PetriNet &petri_net, double end_time)
+    {
+        petri_net.SetFiringLog(nullptr);
+        WriteByte(EndTag);
+        WriteDouble(end_time - _last_time);
+    }
+
+    // buffered sequential reading, throwing InvalidTrace on truncation
+    class TraceReader
+    {
+    private:
+        std::ifstream _stream;
+        vector<char> _buffer;
+        size_t _position = 0;
+        size_t _size = 0;
+
+        bool Refill()
+        {
+            _stream.read(_buffer.data(), _buffer.size());
+            _size = (size_t) _stream.gcount();
+            _position = 0;
+            return _size > 0;
+        }
+
+    public:
+        TraceReader(const string &path) : _stream(path, std::ios::binary), _buffer(1 << 20)
+        {
+            if (!_stream)
+            {
+                throw TraceIOError();
+            }
+        }
+
+        // false at the end of the trace
+        bool TryReadByte(uint8_t &byte)
+        {
+            if (_position == _size && !Refill())
+            {
+                return false;
+            }
+            byte = (uint8_t) _buffer[_position++];
+            return true;
+        }
+
+        uint8_t ReadByte()
+        {
+            uint8_t byte;
+            if (!TryReadByte(byte))
+            {
+                throw InvalidTrace();
+            }
+            return byte;
+        }
+
+        uint64_t ReadVarint()
+        {
+            uint64_t value = 0;
+            for (int shift = 0; shift < 64; shift += 7)
+            {
+                uint8_t byte = ReadByte();
+                value |= (uint64_t) (byte & 0x7f) << shift;
+                if (byte < 0x80)
+                {
+                    return value;
+                }
+            }
+            throw InvalidTrace();
+        }
+
+        double ReadDouble()
+        {
+            uint64_t bits = 0;
+            for (int i = 0; i < 8; i++)
+            {
+                bits |= (uint64_t) ReadByte() << (8 * i);
+            }
+            double value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+    };
+
+    static void ReadKeyframe(TraceReader &reader, vector<Mark> &mark_list, PetriNet &petri_net)
+    {
+        for (auto &mark:mark_list)
+        {
+            mark = (Mark) UnZigZag(reader.ReadVarint());
+        }
+        petri_net.ReplayMarking(mark_list);
+    }
+
+    uint64_t ReplayTrace(const string &path, const PetriNetCreator &creator, MeanEstimator &cumulative_estimator,
+                         MeanEstimator &transient_estimator, size_t source_index)
+    {
+        PetriNet petri_net = creator.CreatePetriNet();
+        TraceReader reader(path);
+        for (char c:Magic)
+        {
+            if (reader.ReadByte() != (uint8_t) c)
+            {
+                throw InvalidTrace();
+            }
+        }
+        size_t transition_count = creator.GetTransitionCmdList().size();
+        vector<Mark> mark_list(creator.GetPlaceCmdList().size());
+        if (reader.ReadVarint() != mark_list.size() || reader.ReadVarint() != transition_count)
+        {
+            throw InvalidTrace();
+        }
+        uint64_t replication_count = 0;
+        uint8_t tag;
+        while (reader.TryReadByte(tag))
+        {
+            if (tag != StartTag)
+            {
+                throw InvalidTrace();
+            }
+            ReadKeyframe(reader, mark_list, petri_net);
+            double time = 0.0;
+            bool ended = false;
+            while (!ended)
+            {
+                switch (reader.ReadByte())
+                {
+                    case KeyframeTag:
+                        ReadKeyframe(reader, mark_list, petri_net);
+                        break;
+                    case EventTag:
+                    {
+                        double duration = reader.ReadDouble();
+                        petri_net.ReplayTime(time, time + duration);
+                        cumulative_estimator.InputSample(source_index, petri_net, duration);
+                        uint64_t firing_count = reader.ReadVarint();
+                        for (uint64_t i = 0; i < firing_count; i++)
+                        {
+                            uint64_t code = reader.ReadVarint();
+                            long count = (code & 1) ? (long) reader.ReadVarint() : 1;
+                            if ((code >> 1) >= transition_count)
+                            {
+                                throw InvalidTrace();
+                            }
+                            petri_net.ReplayFiring(code >> 1, count);
+                        }
+                        time += duration;
+                        break;
+                    }
+                    case EndTag:
+                    {
+                        double duration = reader.ReadDouble();
+                        petri_net.ReplayTime(time, time + duration);
+                        cumulative_estimator.InputSample(source_index, petri_net, duration);
+                        transient_estimator.InputSample(source_index, petri_net, 1.0);
+                        cumulative_estimator.SubmitMean(source_index);
+                        transient_estimator.SubmitMean(source_index);
+                        replication_count++;
+                        ended = true;
+                        break;
+                    }
+                    default:
+                        throw InvalidTrace();
+                }
+            }
+        }
+        return replication_count;
+    }
+}
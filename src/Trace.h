@@ -0,0 +1,94 @@
+//
+
+#ifndef SPNP_TRACE_H
+#define SPNP_TRACE_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "PetriNetModel/PetriNetModel.h"
+#include "Estimating.h"
+
+namespace Trace
+{
+    using namespace PetriNetModel;
+    using namespace Estimating;
+    using std::string;
+    using std::vector;
+
+    // fluid levels and likelihood ratios are not recorded
+    class TraceNotSupported : public std::exception
+    {
+    };
+
+    class TraceIOError : public std::exception
+    {
+    };
+
+    // the trace is truncated, corrupt or was recorded from another net
+    class InvalidTrace : public std::exception
+    {
+    };
+
+    // Binary trajectory recording. A trace starts with a header (magic, place and transition counts); every
+    // replication then starts with a keyframe of the full marking and consists of event records, each holding the
+    // time since the previous event and the firings it made (immediate ones and leaps included) as varint
+    // transition indices. Keyframes are repeated every keyframe_interval events, so that replays resynchronize.
+    class TraceWriter
+    {
+    private:
+        static const size_t BufferSize = 1 << 20;
+
+        std::ofstream _stream;
+        vector<char> _buffer;
+        size_t _place_count;
+        size_t _keyframe_interval;
+        vector<std::pair<size_t, long>> _firing_log;
+        size_t _event_count = 0; //since the last keyframe
+        double _last_time = 0.0;
+
+        void WriteByte(uint8_t byte)
+        {
+            if (_buffer.size() == BufferSize)
+            {
+                FlushBuffer();
+            }
+            _buffer.push_back((char) byte);
+        }
+
+        void WriteVarint(uint64_t value);
+
+        void WriteDouble(double value);
+
+        void WriteKeyframe(const PetriNet &petri_net);
+
+        void FlushBuffer();
+
+    public:
+        TraceWriter(const string &path, const PetriNetCreator &creator, size_t keyframe_interval = 1024);
+
+        TraceWriter(const TraceWriter &) = delete;
+
+        ~TraceWriter();
+
+        // right after petri_net.Reset; the net logs its firings to the writer from then on
+        void BeginReplication(PetriNet &petri_net);
+
+        // right after petri_net.NextState
+        void RecordEvent(const PetriNet &petri_net);
+
+        // the replication was observed up to end_time; the net stops logging to the writer
+        void EndReplication(PetriNet &petri_net, double end_time);
+
+        void Flush();
+    };
+
+    // Feeds the estimators what SimulateReplication fed them while the trace was recorded, for any random
+    // variables on the marking, and submits every replication on its own; SubmitResult(source_index) then collects
+    // them as after a simulation. Returns the number of replications.
+    uint64_t ReplayTrace(const string &path, const PetriNetCreator &creator, MeanEstimator &cumulative_estimator,
+                         MeanEstimator &transient_estimator, size_t source_index = 0);
+}
+
+#endif //SPNP_TRACE_H
@@ -0,0 +1,60 @@
+//
+// Merges result files of independent runs and prints the confidence interval of every variable:
+//     merge_results [-o merged_file] result_file...
+
+#include <cstring>
+#include <iostream>
+#include "Estimating.h"
+
+using namespace Estimating;
+
+int main(int argc, char *argv[])
+{
+    string output_path;
+    vector<string> input_path_list;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            output_path = argv[++i];
+        } else
+        {
+            input_path_list.push_back(argv[i]);
+        }
+    }
+    if (input_path_list.empty())
+    {
+        std::cerr << "usage: " << argv[0] << " [-o merged_file] result_file..." << std::endl;
+        return 2;
+    }
+    ResultSet merged;
+    for (const string &path:input_path_list)
+    {
+        try
+        {
+            merged += ResultSet::Read(path);
+        } catch (const Serialization::SerializationError &)
+        {
+            std::cerr << path << ": not a readable result file" << std::endl;
+            return 1;
+        }
+    }
+    for (size_t index = 0; index < merged.Size(); index++)
+    {
+        const SamplingResult &result = merged.GetResult(index);
+        std::cout << merged.GetName(index) << ": " << ConfidenceInterval(result).ToString() << " (weight "
+                  << result.TotalWeight() << ")" << std::endl;
+    }
+    if (!output_path.empty())
+    {
+        try
+        {
+            merged.Write(output_path);
+        } catch (const Serialization::SerializationError &)
+        {
+            std::cerr << output_path << ": cannot be written" << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
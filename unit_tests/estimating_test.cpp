@@ -9,6 +9,8 @@
 #include <random>
 #include <chrono>
 #include <utility>
+#include <cstdio>
+#include <fstream>
 
 using namespace Estimating;
 using namespace PetriNetModel;
@@ -215,3 +217,129 @@ TEST(SamplingSummary_test, AverageStandardDeviationTest)
 }
 
 
+
+TEST(LogHistogram_test, QuantileTest)
+{
+    // exponential samples split over two histograms, merged like per-worker results
+    std::mt19937_64 engine(2016);
+    std::exponential_distribution<double> distribution(1.0);
+    LogHistogram histogram[2];
+    for (int i = 0; i < 100000; i++)
+    {
+        histogram[i % 2].AddNewSample(distribution(engine) - 0.5, 1.0);
+    }
+    histogram[0] += histogram[1];
+    ASSERT_EQ(histogram[0].TotalWeight(), 100000.0);
+    for (double probability: {0.1, 0.5, 0.9, 0.99})
+    {
+        double exact = -std::log(1.0 - probability) - 0.5;
+        double estimate = histogram[0].Quantile(probability);
+        std::pair<double, double> interval = histogram[0].QuantileInterval(probability);
+        ASSERT_NEAR(estimate, exact, 0.01 * std::abs(exact) + 0.01);
+        ASSERT_LE(interval.first, estimate);
+        ASSERT_GE(interval.second, estimate);
+        ASSERT_LT(interval.first, exact + 0.01);
+        ASSERT_GT(interval.second, exact - 0.01);
+    }
+    ASSERT_LT(histogram[0].BucketCount(), 2000);
+
+    // buckets of another accuracy do not line up
+    LogHistogram coarse(0.05);
+    coarse.AddNewSample(2.0, 1.0);
+    ASSERT_THROW(histogram[0] += coarse, HistogramMismatch);
+    ASSERT_EQ(histogram[0].TotalWeight(), 100000.0);
+    LogHistogram empty;
+    empty += coarse;
+    ASSERT_EQ(empty.Quantile(0.5), coarse.Quantile(0.5));
+
+    // a loaded accuracy is checked
+    std::stringstream stream;
+    Serialization::Writer writer(stream);
+    coarse.Save(writer);
+    Serialization::Reader reader(stream);
+    ASSERT_EQ(LogHistogram::Load(reader).Quantile(0.5), coarse.Quantile(0.5));
+    std::stringstream corrupt;
+    Serialization::Writer corrupt_writer(corrupt);
+    corrupt_writer.WriteDouble(-1.0);
+    for (int i = 0; i < 3; i++)
+    {
+        corrupt_writer.WriteDouble(0.0);
+    }
+    corrupt_writer.WriteUint64(0);
+    corrupt_writer.WriteUint64(0);
+    Serialization::Reader corrupt_reader(corrupt);
+    ASSERT_THROW(LogHistogram::Load(corrupt_reader), Serialization::SerializationError);
+}
+
+TEST(SamplingSummary_test, BatchTest)
+{
+    // large offset, small spread: the variance sum is prone to cancellation
+    std::mt19937_64 engine(2016);
+    std::uniform_real_distribution<double> distribution(0.0, 1.0);
+    vector<double> samples, weights;
+    for (int i = 0; i < 1003; i++)
+    {
+        samples.push_back(1e9 + distribution(engine));
+        weights.push_back(0.5 + distribution(engine));
+    }
+    SamplingResult sequential;
+    BatchedSamplingResult batched;
+    long double weight_sum = 0.0, weighted_sum = 0.0;
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        sequential.AddNewSample(samples[i], weights[i]);
+        batched.AddNewSample(samples[i], weights[i]);
+        weight_sum += weights[i];
+        weighted_sum += (long double) weights[i] * samples[i];
+    }
+    long double average = weighted_sum / weight_sum, variance_sum = 0.0;
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        variance_sum += weights[i] * (samples[i] - average) * (samples[i] - average);
+    }
+    const SamplingResult &result = batched.GetResult();
+    ASSERT_DOUBLE_EQ(result.TotalWeight(), sequential.TotalWeight());
+    ASSERT_NEAR(result.Average(), (double) average, 1e-6);
+    ASSERT_LE(std::abs(result.VarianceSum() - (double) variance_sum),
+              std::abs(sequential.VarianceSum() - (double) variance_sum) + 1e-6 * (double) variance_sum);
+    ASSERT_NEAR(result.VarianceSum(), (double) variance_sum, 1e-6 * (double) variance_sum);
+    ASSERT_NEAR(result.EffectiveBase(), sequential.EffectiveBase(), 1e-9);
+}
+
+TEST(ResultSet_test, MergeFilesTest)
+{
+    // two jobs with different seeds merge into the result of one job over all samples
+    std::default_random_engine engine(7);
+    std::exponential_distribution<double> distribution(2.0);
+    SamplingResult whole, part[2];
+    for (int i = 0; i < 2000; i++)
+    {
+        double sample = distribution(engine);
+        whole.AddNewSample(sample, 1.0);
+        part[i % 2].AddNewSample(sample, 1.0);
+    }
+    for (int job = 0; job < 2; job++)
+    {
+        ResultSet result_set;
+        result_set.Add("time", part[job]);
+        result_set.Add("count", SamplingResult::FromMoments(job, 0.0, 1.0, 1.0));
+        result_set.Write("estimating_test_results." + std::to_string(job));
+    }
+    ResultSet merged = ResultSet::Read("estimating_test_results.0");
+    merged += ResultSet::Read("estimating_test_results.1");
+    ASSERT_EQ(merged.Size(), 2u);
+    ASSERT_EQ(merged.GetName(0), "time");
+    const SamplingResult &time = *merged.Find("time");
+    ASSERT_DOUBLE_EQ(time.TotalWeight(), whole.TotalWeight());
+    ASSERT_NEAR(time.Average(), whole.Average(), 1e-12);
+    ASSERT_NEAR(time.VarianceSum(), whole.VarianceSum(), 1e-9);
+    ASSERT_DOUBLE_EQ(time.EffectiveBase(), whole.EffectiveBase());
+    ASSERT_DOUBLE_EQ(merged.Find("count")->Average(), 0.5);
+    ASSERT_EQ(merged.Find("missing"), nullptr);
+
+    std::ofstream("estimating_test_results.1", std::ios::trunc) << "not a result file";
+    ASSERT_THROW(ResultSet::Read("estimating_test_results.1"), Serialization::SerializationError);
+    ASSERT_THROW(ResultSet::Read("estimating_test_results.2"), Serialization::SerializationError);
+    std::remove("estimating_test_results.0");
+    std::remove("estimating_test_results.1");
+}
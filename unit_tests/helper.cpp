@@ -166,4 +166,29 @@ string GetStateName(const PetriNet &pn)
             break;
     }
     return (server + user);
-}
\ No newline at end of file
+}
+
+PetriNetCreator TwoStageNet()
+{
+    PetriNetCreator creator;
+    creator.AddPlace("a", 1);
+    creator.AddPlace("b", 0);
+    creator.AddPlace("c", 0);
+    creator.AddTransition("ab", Statistics::Exp(1.0));
+    creator.AddTransition("bc", Statistics::Exp(2.0));
+    creator.AddArc("ab", "a", Arc::Type::Input);
+    creator.AddArc("ab", "b", Arc::Type::Output);
+    creator.AddArc("bc", "b", Arc::Type::Input);
+    creator.AddArc("bc", "c", Arc::Type::Output);
+    return creator;
+}
+
+Estimating::RandomVariable PlaceVariable(const PetriNetCreator &creator, const string &name)
+{
+    size_t p_index = creator.GetPlaceIndex(name);
+    return Estimating::RandomVariable(name, [p_index](const PetriNet &pn, double &value)
+    {
+        value = pn.GetPlaceMark(p_index);
+        return true;
+    });
+}
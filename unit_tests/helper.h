@@ -3,6 +3,7 @@
 //
 
 #include <PetriNetModel/PetriNetModel.h>
+#include "Estimating.h"
 
 using namespace PetriNetModel;
 
@@ -22,3 +23,8 @@ PetriNetCreator ComplexPetriNet();
 
 string GetStateName(const PetriNet &pn);
 
+// a -> b -> c at rates 1 and 2, with one token in a; not committed
+PetriNetCreator TwoStageNet();
+
+// the marking of the place
+Estimating::RandomVariable PlaceVariable(const PetriNetCreator &creator, const string &name);
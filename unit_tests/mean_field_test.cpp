@@ -0,0 +1,93 @@
+//
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include "MeanField.h"
+#include "Statistics.h"
+#include "helper.h"
+
+using namespace MeanField;
+
+static MeanFieldVariable PlaceMean(const string &name)
+{
+    return MeanFieldVariable(name, [name](const MeanFieldState &state, double &value)
+    {
+        value = state.GetPlaceMean(name);
+        return true;
+    });
+}
+
+TEST(mean_field_test, immigration_death)
+{
+    // arrivals at rate 2, every customer leaves at rate 0.5: E[x(t)] = 4 (1 - exp(-0.5 t))
+    PetriNetCreator creator;
+    creator.AddPlace("customer", 0);
+    creator.AddTransition("arrive", Statistics::Exp(2.0));
+    creator.AddTransition("leave", Statistics::Exp(0.5));
+    creator.AddArc("arrive", "customer", Arc::Type::Output);
+    creator.AddArc("leave", "customer", Arc::Type::Input);
+    creator.SetServerPolicy("leave", Transition::ServerPolicy::InfiniteServer);
+    creator.Commit();
+
+    MeanFieldSolver solver(creator);
+    solver.AddRandomVariable(PlaceMean("customer"));
+    MeanFieldResult result = solver.Solve(10.0, 11);
+    const auto &time_list = result.GetTimeList();
+    const auto &value_list = result.GetValueList("customer");
+    ASSERT_EQ(time_list.size(), 11);
+    for (size_t i = 0; i < time_list.size(); i++)
+    {
+        ASSERT_NEAR(value_list[i], 4.0 * (1.0 - std::exp(-0.5 * time_list[i])), 1e-4);
+    }
+}
+
+TEST(mean_field_test, replicated_subnet)
+{
+    SubnetTemplate server;
+    server.AddPlace("up", 1);
+    server.AddPlace("down", 0);
+    server.AddTransition("fail", 0.5);
+    server.AddTransition("repair", 1.0);
+    server.AddArc("fail", "up", Arc::Type::Input);
+    server.AddArc("fail", "down", Arc::Type::Output);
+    server.AddArc("repair", "down", Arc::Type::Input);
+    server.AddArc("repair", "up", Arc::Type::Output);
+
+    PetriNetCreator creator;
+    creator.AddReplicatedSubnet("server", server, 100000);
+    creator.Commit();
+
+    // rates six orders of magnitude apart from the observation scale still integrate in few steps
+    MeanFieldSolver solver(creator);
+    solver.AddRandomVariable(PlaceMean(PetriNetCreator::ReplicaName("server", "down")));
+    MeanFieldResult result = solver.Solve(1e6, 3);
+    ASSERT_NEAR(result.GetValueList(0).back(), 100000 * 0.5 / 1.5, 1e-2);
+}
+
+TEST(mean_field_test, not_applicable)
+{
+    PetriNetCreator creator;
+    creator.AddPlace("p", 1);
+    creator.AddImmediateTransition("t");
+    creator.AddArc("t", "p", Arc::Type::Input);
+    creator.Commit();
+    try
+    {
+        MeanFieldSolver solver(creator);
+        FAIL();
+    } catch (MeanFieldNotApplicable)
+    {
+        return;
+    }
+}
+
+TEST(mean_field_test, diverging)
+{
+    PetriNetCreator creator;
+    creator.AddPlace("p", 1);
+    creator.AddTransition("t", Statistics::Exp(std::numeric_limits<double>::quiet_NaN()));
+    creator.AddArc("t", "p", Arc::Type::Input);
+    creator.Commit();
+    MeanFieldSolver solver(creator);
+    ASSERT_THROW(solver.Solve(1.0, 2), MeanFieldDiverged);
+}
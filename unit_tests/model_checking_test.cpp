@@ -0,0 +1,75 @@
+//
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <iostream>
+#include "ModelChecking.h"
+#include "helper.h"
+
+using namespace ModelChecking;
+
+TEST(model_checking_test, incomplete_beta)
+{
+    ASSERT_NEAR(Statistics::RegularizedIncompleteBeta(0.3, 1.0, 1.0), 0.3, 1e-12);
+    ASSERT_NEAR(Statistics::RegularizedIncompleteBeta(0.3, 2.0, 1.0), 0.09, 1e-12);
+    ASSERT_NEAR(Statistics::RegularizedIncompleteBeta(0.9, 1.0, 3.0), 1.0 - std::pow(0.1, 3.0), 1e-12);
+}
+
+TEST(model_checking_test, time_bounded_reachability)
+{
+    PetriNetCreator creator = TwoStageNet();
+    creator.Commit();
+    size_t c_index = creator.GetPlaceIndex("c");
+    // P(F[0,1] c) = 1 - 2 exp(-1) + exp(-2), about 0.4
+    PathFormula reach_c = PathFormula::Eventually([c_index](const PetriNet &pn)
+                                                  { return pn.GetPlaceMark(c_index) > 0; }, 1.0);
+    PathFormula avoid_c = PathFormula::Globally([c_index](const PetriNet &pn)
+                                                { return pn.GetPlaceMark(c_index) == 0; }, 1.0);
+    ModelChecker checker(creator, 4);
+
+    SprtTest sprt_low(0.3, 0.02);
+    ASSERT_EQ(checker.Check(reach_c, sprt_low, 100000, 1), Verdict::AtLeast);
+    std::cout << "SPRT: " << checker.GetObservationCount() << " trajectories" << std::endl;
+    // estimating p to +-0.02 at 95% would take about 2300
+    ASSERT_LT(checker.GetObservationCount(), 1000);
+    SprtTest sprt_high(0.5, 0.02);
+    ASSERT_EQ(checker.Check(reach_c, sprt_high, 100000, 1), Verdict::Below);
+    ASSERT_EQ(checker.Check(avoid_c, sprt_high, 100000, 1), Verdict::AtLeast);
+
+    BayesianTest bayes_low(0.3);
+    ASSERT_EQ(checker.Check(reach_c, bayes_low, 100000, 2), Verdict::AtLeast);
+    std::cout << "Bayes: " << checker.GetObservationCount() << " trajectories" << std::endl;
+    BayesianTest bayes_high(0.5);
+    ASSERT_EQ(checker.Check(reach_c, bayes_high, 100000, 2), Verdict::Below);
+
+    // c is only reached through b, where "a" is no longer marked
+    size_t a_index = creator.GetPlaceIndex("a");
+    PathFormula until_c = PathFormula::Until([a_index](const PetriNet &pn)
+                                             { return pn.GetPlaceMark(a_index) > 0; },
+                                             [c_index](const PetriNet &pn)
+                                             { return pn.GetPlaceMark(c_index) > 0; }, 1.0);
+    SprtTest sprt_rare(0.01, 0.005);
+    ASSERT_EQ(checker.Check(until_c, sprt_rare, 100000, 3), Verdict::Below);
+    ASSERT_EQ(checker.GetSatisfiedCount(), 0);
+
+    ASSERT_THROW(SprtTest(0.01, 0.02), InvalidSequentialTest);
+}
+
+TEST(model_checking_test, stopping_predicate)
+{
+    // trajectories end when b is marked, before c can be reached
+    PetriNetCreator creator = TwoStageNet();
+    size_t b_index = creator.GetPlaceIndex("b");
+    size_t c_index = creator.GetPlaceIndex("c");
+    creator.SetStoppingPredicate({"b"}, [b_index](const PetriNet &pn)
+    { return pn.GetPlaceMark(b_index) > 0; });
+    creator.Commit();
+    PathFormula reach_c = PathFormula::Eventually([c_index](const PetriNet &pn)
+                                                  { return pn.GetPlaceMark(c_index) > 0; }, 1000.0);
+    PetriNet pn = creator.CreatePetriNet();
+    Statistics::DefaultUniformRandomNumberGenerator generator(42);
+    for (int i = 0; i < 100; i++)
+    {
+        ASSERT_FALSE(reach_c.Check(pn, generator));
+    }
+}
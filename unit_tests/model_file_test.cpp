@@ -0,0 +1,131 @@
+//
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include "ModelFile.h"
+#include "helper.h"
+
+using namespace ModelFile;
+
+static const char *TwoStageModel =
+        "# two stages with a choice\n"
+        "place a 1\n"
+        "place b\n"
+        "place c 0   # absorbing\n"
+        "transition ab exp 1.0\n"
+        "transition bc weibull 2 0.5 identical\n"
+        "immediate skip 0.5 2\n"
+        "arc ab a input\n"
+        "arc ab b output 2\n"
+        "arc bc b input\n"
+        "arc bc c output\n"
+        "arc skip c inhibitor 3\n";
+
+TEST(model_file_test, parse)
+{
+    CompiledModel model = CompiledModel::Parse(TwoStageModel, TwoStageModel + std::strlen(TwoStageModel));
+    ASSERT_EQ(model.GetPlaceCount(), 3u);
+    ASSERT_EQ(model.GetTransitionCount(), 3u);
+    ASSERT_EQ(model.GetArcCount(), 5u);
+    PetriNetCreator creator;
+    model.Build(creator);
+    creator.Commit();
+    ASSERT_EQ(creator.GetPlaceIndex("c"), 2u);
+    ASSERT_EQ(creator.GetPlaceCmdList()[0].init_mark, 1);
+    const CreateTransitionCmd &bc = creator.GetTransitionCmdList()[creator.GetTransitionIndex("bc")];
+    ASSERT_EQ(bc.resampling_policy, Transition::ResamplingPolicy::Identical);
+    ASSERT_DOUBLE_EQ(bc.firing_time_func(1.0 - std::exp(-1.0)), 0.5);
+    const CreateTransitionCmd &skip = creator.GetTransitionCmdList()[creator.GetTransitionIndex("skip")];
+    ASSERT_TRUE(skip.immediate);
+    ASSERT_DOUBLE_EQ(skip.weight, 0.5);
+    ASSERT_EQ(skip.priority, 2);
+    const CreateArcCmd &arc = creator.GetArcCmdList()[1];
+    ASSERT_EQ(arc.place_index, creator.GetPlaceIndex("b"));
+    ASSERT_EQ(arc.type, Arc::Type::Output);
+    ASSERT_EQ(arc.multiplicity, 2);
+    ASSERT_EQ(creator.GetArcCmdList()[4].type, Arc::Type::Inhibitor);
+
+    // named distributions beyond the built-in ones
+    SamplerRegistry registry;
+    registry.AddSampler("erlang2", 1, [](const vector<double> &parameter_list)
+    {
+        double rate = parameter_list[0];
+        return [rate](double u)
+        { return 2.0 * -std::log(1.0 - u) / rate; };
+    });
+    const string text = "place p 1\ntransition t erlang2 4\narc t p input\n";
+    PetriNetCreator erlang_creator;
+    CompiledModel::Parse(text.data(), text.data() + text.size(), registry).Build(erlang_creator, registry);
+    ASSERT_EQ(erlang_creator.GetTransitionCmdList().size(), 1u);
+    ASSERT_THROW(CompiledModel::Parse(text.data(), text.data() + text.size()), ModelSyntaxError);
+
+    for (const string &bad:vector<string>{"place a\nplace a\n", "place a x\n", "place a\ntransition t exp\n",
+                            "place a\narc t a input\n", "place a\ntransition t exp 1 sometimes\n",
+                            "place a\ntransition t exp 1\narc t a sideways\n", "token a\n"})
+    {
+        try
+        {
+            CompiledModel::Parse(bad.data(), bad.data() + bad.size());
+            FAIL() << bad;
+        } catch (const ModelSyntaxError &error)
+        {
+            ASSERT_EQ(error.GetLine(), (size_t) std::count(bad.begin(), bad.end(), '\n')) << bad;
+        }
+    }
+}
+
+TEST(model_file_test, cache)
+{
+    // a generated model: a ring of stations, each with a few thousand arcs
+    const string model_path = "model_file_test.spn";
+    const string cache_path = "model_file_test.spnc";
+    const size_t station_count = 20000;
+    {
+        std::ofstream model(model_path, std::ios::trunc);
+        for (size_t i = 0; i < station_count; i++)
+        {
+            model << "place station_queue_" << i << " " << (i % 3) << "\n";
+        }
+        for (size_t i = 0; i < station_count; i++)
+        {
+            model << "transition station_service_" << i << " exp " << 1.0 + i % 7 << "\n";
+            model << "arc station_service_" << i << " station_queue_" << i << " input\n";
+            model << "arc station_service_" << i << " station_queue_" << (i + 1) % station_count << " output\n";
+        }
+    }
+    std::remove(cache_path.c_str());
+    auto start = std::chrono::steady_clock::now();
+    PetriNetCreator parsed;
+    LoadModel(model_path, cache_path, parsed);
+    auto parsed_time = std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+    PetriNetCreator cached;
+    LoadModel(model_path, cache_path, cached);
+    auto cached_time = std::chrono::steady_clock::now() - start;
+    std::cout << "parsed in " << std::chrono::duration<double>(parsed_time).count() << " s, loaded from cache in "
+              << std::chrono::duration<double>(cached_time).count() << " s" << std::endl;
+
+    ASSERT_EQ(cached.GetArcCmdList().size(), 2 * station_count);
+    ASSERT_EQ(cached.GetPlaceIndex("station_queue_17"), 17u);
+    ASSERT_EQ(cached.GetArcCmdList()[2 * 17 + 1].place_index, 18u);
+    ASSERT_EQ(cached.GetPlaceCmdList()[5].init_mark, parsed.GetPlaceCmdList()[5].init_mark);
+    ASSERT_DOUBLE_EQ(cached.GetTransitionCmdList()[9].firing_time_func(0.5),
+                     parsed.GetTransitionCmdList()[9].firing_time_func(0.5));
+    CompiledModel model;
+    ASSERT_FALSE(CompiledModel::LoadCache(cache_path, model)); //of another source
+
+    // a cache that does not fit is rebuilt
+    std::ofstream(cache_path, std::ios::trunc) << "SPNPMDL1 but truncated";
+    PetriNetCreator rebuilt;
+    LoadModel(model_path, cache_path, rebuilt);
+    ASSERT_EQ(rebuilt.GetArcCmdList().size(), 2 * station_count);
+    ASSERT_THROW(LoadModel(model_path + ".missing", cache_path, rebuilt), ModelIOError);
+    std::remove(model_path.c_str());
+    std::remove(cache_path.c_str());
+}
@@ -104,3 +104,431 @@ TEST(petri_net_model_test, complex_firing)
 }
 
 
+TEST(petri_net_model_test, replicated_subnet)
+{
+    SubnetTemplate server;
+    server.AddPlace("up", 1);
+    server.AddPlace("down", 0);
+    server.AddTransition("fail", 0.1);
+    server.AddTransition("repair", 1.0);
+    server.AddArc("fail", "up", Arc::Type::Input);
+    server.AddArc("fail", "down", Arc::Type::Output);
+    server.AddArc("repair", "down", Arc::Type::Input);
+    server.AddArc("repair", "up", Arc::Type::Output);
+
+    PetriNetCreator creator;
+    creator.AddReplicatedSubnet("server", server, 100);
+    creator.Commit();
+
+    Statistics::DefaultUniformRandomNumberGenerator generator;
+    PetriNet pn = creator.CreatePetriNet();
+    pn.Reset(generator);
+    GTEST_ASSERT_EQ(pn.GetPlaceMark("server.up"), 100);
+    GTEST_ASSERT_EQ(pn.GetPlaceMark("server.down"), 0);
+    for (int i = 0; i < 1000; i++)
+    {
+        pn.NextState(generator);
+        GTEST_ASSERT_EQ(pn.GetPlaceMark("server.up") + pn.GetPlaceMark("server.down"), 100);
+    }
+}
+
+TEST(petri_net_model_test, invalid_replicated_subnet)
+{
+    SubnetTemplate subnet;
+    subnet.AddPlace("a", 1);
+    subnet.AddPlace("b", 1);
+    subnet.AddTransition("t", 1.0);
+    subnet.AddArc("t", "a", Arc::Type::Input);
+    subnet.AddArc("t", "b", Arc::Type::Output);
+
+    PetriNetCreator creator;
+    ASSERT_THROW(creator.AddReplicatedSubnet("sub", subnet, 10), InvalidSubnet);
+
+    // failures leave no half-built copies behind
+    SubnetTemplate shared;
+    shared.AddPlace("idle", 1);
+    shared.AddPlace("busy", 0);
+    shared.AddTransition("start", 1.0);
+    shared.AddTransition("end", 1.0);
+    ASSERT_THROW(shared.AddTransition("end", 2.0), DuplicateName);
+    shared.AddArc("start", "idle", Arc::Type::Input);
+    shared.AddArc("start", "busy", Arc::Type::Output);
+    shared.AddArc("start", "jobs", Arc::Type::Input);
+    shared.AddArc("end", "busy", Arc::Type::Input);
+    shared.AddArc("end", "idle", Arc::Type::Output);
+    ASSERT_THROW(creator.AddReplicatedSubnet("sub", shared, 10), NameNotFound);
+    ASSERT_EQ(creator.GetPlaceCmdList().size(), 0u);
+    ASSERT_EQ(creator.GetTransitionCmdList().size(), 0u);
+    creator.AddPlace("jobs", 5);
+    creator.AddPlace(PetriNetCreator::ReplicaName("sub", "busy"), 0);
+    ASSERT_THROW(creator.AddReplicatedSubnet("sub", shared, 10), DuplicateName);
+    ASSERT_EQ(creator.GetPlaceCmdList().size(), 2u);
+    ASSERT_EQ(creator.GetTransitionCmdList().size(), 0u);
+    ASSERT_EQ(creator.GetArcCmdList().size(), 0u);
+    creator.AddReplicatedSubnet("other", shared, 10);
+    ASSERT_EQ(creator.GetArcCmdList().size(), 5u);
+    ASSERT_EQ(creator.GetArcCmdList()[2].place_index, creator.GetPlaceIndex("jobs"));
+}
+
+TEST(petri_net_model_test, immediate_transition)
+{
+    PetriNetCreator creator;
+    creator.AddPlace("idle", 1);
+    creator.AddPlace("choice", 0);
+    creator.AddPlace("left", 0);
+    creator.AddPlace("right", 0);
+    creator.AddPlace("urgent", 0);
+    creator.AddTransition("request", Exp(1.0));
+    creator.AddImmediateTransition("go_left", 1.0);
+    creator.AddImmediateTransition("go_right", 3.0);
+    creator.AddImmediateTransition("go_urgent", 1.0, 1);
+    creator.AddArc("request", "idle", Arc::Type::Input);
+    creator.AddArc("request", "choice", Arc::Type::Output);
+    creator.AddArc("go_left", "choice", Arc::Type::Input);
+    creator.AddArc("go_left", "left", Arc::Type::Output);
+    creator.AddArc("go_left", "idle", Arc::Type::Output);
+    creator.AddArc("go_right", "choice", Arc::Type::Input);
+    creator.AddArc("go_right", "right", Arc::Type::Output);
+    creator.AddArc("go_right", "idle", Arc::Type::Output);
+    // fires once at the start, before anything else
+    creator.AddArc("go_urgent", "urgent", Arc::Type::Inhibitor);
+    creator.AddArc("go_urgent", "urgent", Arc::Type::Output);
+    creator.Commit();
+
+    Statistics::DefaultUniformRandomNumberGenerator generator(123456);
+    PetriNet pn = creator.CreatePetriNet();
+    pn.Reset(generator);
+    GTEST_ASSERT_EQ(pn.GetPlaceMark("urgent"), 1);
+    int firing_count = 10000;
+    for (int i = 0; i < firing_count; i++)
+    {
+        pn.NextState(generator);
+        GTEST_ASSERT_EQ(pn.GetPlaceMark("choice"), 0);
+        GTEST_ASSERT_EQ(pn.GetPlaceMark("idle"), 1);
+    }
+    GTEST_ASSERT_EQ(pn.GetPlaceMark("left") + pn.GetPlaceMark("right"), firing_count);
+    ASSERT_NEAR(pn.GetPlaceMark("right") / (double) firing_count, 0.75, 0.02);
+
+    PetriNetCreator invalid;
+    for (double weight:{0.0, -1.0, std::numeric_limits<double>::quiet_NaN(),
+                        std::numeric_limits<double>::infinity()})
+    {
+        ASSERT_THROW(invalid.AddImmediateTransition("t", weight), InvalidWeight);
+    }
+}
+
+TEST(petri_net_model_test, immediate_priority)
+{
+    // a higher priority transition preempts a conflicting one of lower priority, whatever their weights
+    PetriNetCreator creator;
+    creator.AddPlace("idle", 1);
+    creator.AddPlace("choice", 0);
+    creator.AddPlace("low", 0);
+    creator.AddPlace("high", 0);
+    creator.AddTransition("request", Exp(1.0));
+    creator.AddImmediateTransition("go_low", 100.0, 0);
+    creator.AddImmediateTransition("go_high", 1.0, 1);
+    creator.AddArc("request", "idle", Arc::Type::Input);
+    creator.AddArc("request", "choice", Arc::Type::Output);
+    for (string target:{"low", "high"})
+    {
+        creator.AddArc("go_" + target, "choice", Arc::Type::Input);
+        creator.AddArc("go_" + target, target, Arc::Type::Output);
+        creator.AddArc("go_" + target, "idle", Arc::Type::Output);
+    }
+    creator.Commit();
+
+    Statistics::DefaultUniformRandomNumberGenerator generator(42);
+    PetriNet pn = creator.CreatePetriNet();
+    pn.Reset(generator);
+    for (int i = 0; i < 1000; i++)
+    {
+        pn.NextState(generator);
+    }
+    GTEST_ASSERT_EQ(pn.GetPlaceMark("low"), 0);
+    GTEST_ASSERT_EQ(pn.GetPlaceMark("high"), 1000);
+}
+
+TEST(petri_net_model_test, timeless_trap)
+{
+    PetriNetCreator creator;
+    creator.AddPlace("p1", 1);
+    creator.AddPlace("p2", 0);
+    creator.AddImmediateTransition("t1");
+    creator.AddImmediateTransition("t2");
+    creator.AddArc("t1", "p1", Arc::Type::Input);
+    creator.AddArc("t1", "p2", Arc::Type::Output);
+    creator.AddArc("t2", "p2", Arc::Type::Input);
+    creator.AddArc("t2", "p1", Arc::Type::Output);
+    creator.Commit();
+
+    Statistics::DefaultUniformRandomNumberGenerator generator;
+    PetriNet pn = creator.CreatePetriNet();
+    try
+    {
+        pn.Reset(generator);
+        FAIL();
+    } catch (TimelessTrap)
+    {
+        return;
+    }
+}
+
+class CountingUniformRandomNumberGenerator : public Statistics::DefaultUniformRandomNumberGenerator
+{
+public:
+    size_t count = 0;
+
+    virtual double GetVariate() override
+    {
+        count++;
+        return DefaultUniformRandomNumberGenerator::GetVariate();
+    }
+};
+
+TEST(petri_net_model_test, markovian_engine)
+{
+    PetriNetCreator creator;
+    creator.AddPlace("up", 10);
+    creator.AddPlace("down", 0);
+    creator.AddTransition("fail", Exp(0.1));
+    creator.AddTransition("repair", Exp(1.0));
+    creator.SetServerPolicy("fail", Transition::ServerPolicy::InfiniteServer);
+    creator.AddArc("fail", "up", Arc::Type::Input);
+    creator.AddArc("fail", "down", Arc::Type::Output);
+    creator.AddArc("repair", "down", Arc::Type::Input);
+    creator.AddArc("repair", "up", Arc::Type::Output);
+    creator.Commit();
+
+    CountingUniformRandomNumberGenerator generator;
+    PetriNet pn = creator.CreatePetriNet();
+    ASSERT_TRUE(pn.IsMarkovian());
+    pn.Reset(generator);
+    GTEST_ASSERT_EQ(generator.count, 2u);
+    for (int i = 0; i < 1000; i++)
+    {
+        double time = pn.GetTime();
+        pn.NextState(generator);
+        ASSERT_GE(pn.GetTime(), time);
+        GTEST_ASSERT_EQ(pn.GetPlaceMark("up") + pn.GetPlaceMark("down"), 10);
+    }
+    // one random number per event
+    GTEST_ASSERT_EQ(generator.count, 1002u);
+
+    ASSERT_FALSE(ComplexPetriNet().CreatePetriNet().IsMarkovian());
+}
+
+TEST(petri_net_model_test, fluid_place)
+{
+    PetriNetCreator creator;
+    creator.AddPlace("alarmed", 0);
+    size_t tank_index = creator.AddFluidPlace("tank", 0.0, 10.0);
+    creator.AddTransition("fill", Deterministic(1000.0));
+    creator.AddTransition("alarm", Deterministic(0.0));
+    creator.AddFluidArc("fill", "tank", FluidArc::Type::Inflow, 2.0);
+    creator.AddFluidArc("alarm", "tank", FluidArc::Type::Threshold, 5.0);
+    creator.AddArc("alarm", "alarmed", Arc::Type::Inhibitor);
+    creator.AddArc("alarm", "alarmed", Arc::Type::Output);
+    creator.Commit();
+
+    Statistics::DefaultUniformRandomNumberGenerator generator;
+    PetriNet pn = creator.CreatePetriNet();
+    ASSERT_FALSE(pn.IsMarkovian());
+    pn.Reset(generator);
+    ASSERT_DOUBLE_EQ(pn.GetNextFiringTime(), 2.5);
+    ASSERT_DOUBLE_EQ(pn.GetMeanFluidLevel(tank_index), 2.5);
+    pn.NextState(generator); //threshold crossed
+    ASSERT_DOUBLE_EQ(pn.GetFluidLevel("tank"), 5.0);
+    GTEST_ASSERT_EQ(pn.GetPlaceMark("alarmed"), 0);
+    pn.NextState(generator); //alarm fires
+    ASSERT_DOUBLE_EQ(pn.GetTime(), 2.5);
+    GTEST_ASSERT_EQ(pn.GetPlaceMark("alarmed"), 1);
+    ASSERT_DOUBLE_EQ(pn.GetNextFiringTime(), 5.0);
+    pn.NextState(generator); //tank full
+    ASSERT_DOUBLE_EQ(pn.GetFluidLevel(tank_index), 10.0);
+    ASSERT_DOUBLE_EQ(pn.GetNextFiringTime(), 1000.0);
+}
+
+TEST(petri_net_model_test, fluid_buffer)
+{
+    // a buffer alternately filled and drained, where draining stops at a level of 10
+    PetriNetCreator creator;
+    creator.AddPlace("filling", 1);
+    creator.AddPlace("draining", 0);
+    size_t buffer_index = creator.AddFluidPlace("buffer", 0.0, 100.0);
+    creator.AddTransition("switch_to_drain", Exp(1.0));
+    creator.AddTransition("switch_to_fill", Exp(1.0));
+    creator.AddTransition("drain", Deterministic(1e9));
+    creator.AddArc("switch_to_drain", "filling", Arc::Type::Input);
+    creator.AddArc("switch_to_drain", "draining", Arc::Type::Output);
+    creator.AddArc("switch_to_fill", "draining", Arc::Type::Input);
+    creator.AddArc("switch_to_fill", "filling", Arc::Type::Output);
+    creator.AddArc("drain", "draining", Arc::Type::Input);
+    creator.AddArc("drain", "draining", Arc::Type::Output);
+    creator.AddFluidArc("switch_to_drain", "buffer", FluidArc::Type::Inflow, 30.0);
+    creator.AddFluidArc("drain", "buffer", FluidArc::Type::Threshold, 10.0);
+    creator.AddFluidArc("drain", "buffer", FluidArc::Type::Outflow, 20.0);
+    creator.Commit();
+
+    Statistics::DefaultUniformRandomNumberGenerator generator(123456);
+    PetriNet pn = creator.CreatePetriNet();
+    pn.Reset(generator);
+    bool reached_threshold = false;
+    for (int i = 0; i < 10000; i++)
+    {
+        pn.NextState(generator);
+        double level = pn.GetFluidLevel(buffer_index);
+        reached_threshold = reached_threshold || level >= 10.0;
+        ASSERT_GE(level, reached_threshold ? 10.0 : 0.0);
+        ASSERT_LE(level, 100.0);
+    }
+    ASSERT_TRUE(reached_threshold);
+}
+
+
+TEST(petri_net_model_test, save_restore_state)
+{
+    PetriNetCreator creator = ComplexPetriNet();
+    size_t place_count = creator.GetPlaceCmdList().size();
+    PetriNet pn = creator.CreatePetriNet();
+    PetriNet copy = creator.CreatePetriNet();
+    Statistics::DefaultUniformRandomNumberGenerator generator(123);
+    pn.Reset(generator);
+    for (int i = 0; i < 100; i++)
+    {
+        pn.NextState(generator);
+    }
+    PetriNetState state;
+    pn.SaveState(state);
+    copy.RestoreState(state);
+
+    // both continue identically with identical random numbers
+    Statistics::DefaultUniformRandomNumberGenerator generator1(456);
+    Statistics::DefaultUniformRandomNumberGenerator generator2(456);
+    for (int i = 0; i < 100; i++)
+    {
+        pn.NextState(generator1);
+        copy.NextState(generator2);
+        ASSERT_EQ(pn.GetTime(), copy.GetTime());
+        ASSERT_EQ(pn.GetNextFiringTime(), copy.GetNextFiringTime());
+        for (size_t p_index = 0; p_index < place_count; p_index++)
+        {
+            ASSERT_EQ(pn.GetPlaceMark(p_index), copy.GetPlaceMark(p_index));
+        }
+    }
+}
+
+TEST(petri_net_model_test, bulk_construction)
+{
+    // a large ring with a single token, which can only move on
+    size_t place_count = 200000;
+    PetriNetCreator creator;
+    creator.Reserve(place_count, place_count, 3 * place_count);
+    vector<CreatePlaceCmd> place_list;
+    for (size_t p_index = 0; p_index < place_count; p_index++)
+    {
+        place_list.push_back(CreatePlaceCmd{"p" + std::to_string(p_index), p_index == 0 ? 1 : 0});
+    }
+    GTEST_ASSERT_EQ(creator.AddPlaces(place_list), 0);
+    vector<CreateTransitionCmd> transition_list;
+    vector<CreateArcCmd> arc_list;
+    for (size_t t_index = 0; t_index < place_count; t_index++)
+    {
+        transition_list.push_back(CreateTransitionCmd{"t" + std::to_string(t_index), Exp(1.0), Transition::Different});
+        arc_list.push_back({t_index, t_index, Arc::Type::Input, 1});
+        arc_list.push_back({t_index, (t_index + 1) % place_count, Arc::Type::Output, 1});
+        arc_list.push_back({t_index, (t_index * 7919 + 13) % place_count, Arc::Type::Inhibitor, 2});
+    }
+    GTEST_ASSERT_EQ(creator.AddTransitions(transition_list), 0);
+    creator.AddArcs(arc_list);
+
+    // failed bulk adds leave the creator as it was
+    ASSERT_THROW(creator.AddPlaces({CreatePlaceCmd{"extra", 0}, CreatePlaceCmd{"p7", 0}}), DuplicateName);
+    ASSERT_THROW(creator.AddTransitions({CreateTransitionCmd{"extra", Exp(1.0), Transition::Different},
+                                         CreateTransitionCmd{"t7", Exp(1.0), Transition::Different}}), DuplicateName);
+    ASSERT_THROW(creator.GetTransitionIndex("extra"), NameNotFound);
+    ASSERT_THROW(creator.AddArcs({{0, 0, Arc::Type::Input, 1}, {0, place_count, Arc::Type::Input, 1}}),
+                 NameNotFound);
+    GTEST_ASSERT_EQ(creator.AddPlace("extra", 0), place_count);
+    GTEST_ASSERT_EQ(creator.GetArcCmdList().size(), 3 * place_count);
+    GTEST_ASSERT_EQ(creator.GetPlaceIndex("p12345"), 12345);
+    GTEST_ASSERT_EQ(creator.GetTransitionIndex("t12345"), 12345);
+    ASSERT_THROW(creator.GetPlaceIndex("t1"), NameNotFound);
+    creator.Commit();
+
+    PetriNet pn = creator.CreatePetriNet();
+    Statistics::DefaultUniformRandomNumberGenerator generator(1234);
+    pn.Reset(generator);
+    for (size_t i = 1; i <= 1000; i++)
+    {
+        pn.NextState(generator);
+        GTEST_ASSERT_EQ(pn.GetPlaceMark(i - 1), 0);
+        GTEST_ASSERT_EQ(pn.GetPlaceMark(i), 1);
+    }
+}
+
+TEST(petri_net_model_test, affected_transitions)
+{
+    // as built by the original std::set based construction
+    vector<vector<size_t>> complex_affected{{0, 1, 3}, {0, 1, 3}, {0, 2, 3}, {0, 2, 3}, {0, 3, 4, 5}, {0, 3, 4, 5}};
+    PetriNetCreator complex = ComplexPetriNet();
+    PetriNet complex_pn = complex.CreatePetriNet();
+    GTEST_ASSERT_EQ(complex_pn.GetConflictSetCount(), 0);
+    for (size_t t_index = 0; t_index < complex_affected.size(); t_index++)
+    {
+        ASSERT_EQ(complex_pn.GetAffectedTransitionIndex(t_index), complex_affected[t_index]);
+        ASSERT_TRUE(complex_pn.GetAffectedConflictSet(t_index).empty());
+    }
+
+    PetriNetCreator creator;
+    creator.AddPlace("p0", 1);
+    creator.AddPlace("p1", 0);
+    creator.AddPlace("p2", 0);
+    creator.AddPlace("p3", 0);
+    creator.AddPlace("p4", 0);
+    creator.AddTransition("tA", Exp(1.0));
+    creator.AddImmediateTransition("i0", 1.0);
+    creator.AddTransition("tB", Exp(2.0));
+    creator.AddImmediateTransition("i1", 2.0);
+    creator.AddImmediateTransition("i2", 1.0);
+    creator.AddImmediateTransition("i3", 1.0, 1);
+    creator.AddImmediateTransition("i4", 1.0);
+    creator.AddImmediateTransition("i5", 1.0, 1);
+    creator.AddArc("tA", "p0", Arc::Input);
+    creator.AddArc("tA", "p1", Arc::Output);
+    creator.AddArc("tA", "p3", Arc::Output);
+    creator.AddArc("i1", "p2", Arc::Input);
+    creator.AddArc("i1", "p0", Arc::Output);
+    creator.AddArc("i2", "p2", Arc::Input);
+    creator.AddArc("i2", "p1", Arc::Input);
+    creator.AddArc("i2", "p4", Arc::Output);
+    creator.AddArc("i0", "p1", Arc::Input);
+    creator.AddArc("i0", "p0", Arc::Output);
+    creator.AddArc("i3", "p1", Arc::Input);
+    creator.AddArc("i3", "p3", Arc::Output);
+    creator.AddArc("tB", "p4", Arc::Input);
+    creator.AddArc("tB", "p2", Arc::Output);
+    creator.AddArc("tB", "p1", Arc::Inhibitor);
+    creator.AddArc("i4", "p3", Arc::Input);
+    creator.AddArc("i4", "p0", Arc::Output);
+    creator.AddArc("i5", "p3", Arc::Input);
+    creator.AddArc("i5", "p4", Arc::Inhibitor);
+    creator.AddArc("i5", "p0", Arc::Output);
+    creator.Commit();
+    PetriNet pn = creator.CreatePetriNet();
+
+    // i0, i1 and i2 share input places at priority 0; i3 and i5 are alone at priority 1
+    vector<vector<size_t>> conflict_set{{5}, {7}, {1, 3, 4}, {6}};
+    GTEST_ASSERT_EQ(pn.GetConflictSetCount(), conflict_set.size());
+    for (size_t set_index = 0; set_index < conflict_set.size(); set_index++)
+    {
+        ASSERT_EQ(pn.GetConflictSetTransitionIndex(set_index), conflict_set[set_index]);
+    }
+    vector<vector<size_t>> affected{{0, 2}, {0, 2}, {2}, {0}, {2}, {2}, {0}, {0}};
+    vector<vector<size_t>> affected_set{{0, 1, 2, 3}, {0, 2}, {1, 2}, {2}, {0, 1, 2}, {0, 1, 2, 3}, {1, 3}, {1, 3}};
+    for (size_t t_index = 0; t_index < affected.size(); t_index++)
+    {
+        ASSERT_EQ(pn.GetAffectedTransitionIndex(t_index), affected[t_index]);
+        ASSERT_EQ(pn.GetAffectedConflictSet(t_index), affected_set[t_index]);
+    }
+}
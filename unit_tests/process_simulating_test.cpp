@@ -0,0 +1,69 @@
+//
+
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include "ProcessSimulating.h"
+#include "helper.h"
+
+using namespace Simulating;
+
+TEST(process_simulating_test, same_result_as_threads)
+{
+    PetriNetCreator creator = TwoStageNet();
+    creator.Commit();
+    PetriNetMultiSimulator threads(creator, 3, 1.0);
+    ProcessMultiSimulator processes(creator, 3, 1.0);
+    for (SimulatorBackend *backend:{(SimulatorBackend *) &threads, (SimulatorBackend *) &processes})
+    {
+        backend->GetCumulativeEstimator().AddRandomVariable(PlaceVariable(creator, "b"));
+        backend->GetTransientEstimator().AddRandomVariable(PlaceVariable(creator, "c"));
+    }
+    threads.SetSeed(5);
+    processes.SetSeed(5);
+    processes.SetPublishInterval(100);
+    threads.Run(30000);
+    SimulatorController controller(processes);
+    controller.Start(30000);
+    while (!controller.WaitFor(0.01))
+    { }
+    ASSERT_EQ(processes.GetFailedWorkerCount(), 0u);
+
+    for (bool transient:{false, true})
+    {
+        const SamplingResult &expected = (transient ? threads.GetTransientEstimator() :
+                                          threads.GetCumulativeEstimator()).GetRandomVariableList()[0]
+                .GetSamplingResult();
+        const SamplingResult &actual = (transient ? processes.GetTransientEstimator() :
+                                        processes.GetCumulativeEstimator()).GetRandomVariableList()[0]
+                .GetSamplingResult();
+        ASSERT_EQ(actual.TotalWeight(), expected.TotalWeight());
+        ASSERT_EQ(actual.Average(), expected.Average());
+        ASSERT_EQ(actual.VarianceSum(), expected.VarianceSum());
+    }
+    ASSERT_THROW(processes.SaveCheckpoint("unused"), CheckpointNotSupported);
+}
+
+TEST(process_simulating_test, worker_crash_is_isolated)
+{
+    PetriNetCreator creator = TwoStageNet();
+    creator.Commit();
+    ProcessMultiSimulator processes(creator, 2, 1.0);
+    processes.GetCumulativeEstimator().AddRandomVariable(PlaceVariable(creator, "b"));
+    // a faulty reward, which every worker process hits after its first publications
+    processes.GetTransientEstimator().AddRandomVariable(RandomVariable("faulty", [](const PetriNet &, double &value)
+    {
+        static int call_count = 0;
+        if (++call_count > 250)
+        {
+            std::abort();
+        }
+        value = 1.0;
+        return true;
+    }));
+    processes.SetPublishInterval(100);
+    processes.Run(10000);
+    ASSERT_EQ(processes.GetFailedWorkerCount(), 2u);
+    const SamplingResult &result = processes.GetTransientEstimator().GetRandomVariableList()[0].GetSamplingResult();
+    ASSERT_DOUBLE_EQ(result.TotalWeight(), 2 * 200.0);
+    ASSERT_DOUBLE_EQ(result.Average(), 1.0);
+}
@@ -4,6 +4,7 @@
 #include <gtest/gtest.h>
 #include <Simulating.h>
 #include <PetriNetModel/PetriNetModel.h>
+#include <cmath>
 #include <iostream>
 #include "helper.h"
 
@@ -178,4 +179,669 @@ TEST(SimulatingTest, Complex)
     string result = controller.ResultToString();
     std::cout << result << std::endl;
 
-};
\ No newline at end of file
+};
+TEST(SimulatingTest, ReplicatedSubnet)
+{
+    // 50 independent servers sharing one place that counts completed repairs
+    SubnetTemplate server;
+    server.AddPlace("up", 1);
+    server.AddPlace("down", 0);
+    server.AddTransition("fail", 0.5);
+    server.AddTransition("repair", 1.0);
+    server.AddArc("fail", "up", Arc::Type::Input);
+    server.AddArc("fail", "down", Arc::Type::Output);
+    server.AddArc("repair", "down", Arc::Type::Input);
+    server.AddArc("repair", "up", Arc::Type::Output);
+    server.AddArc("repair", "repaired", Arc::Type::Output);
+
+    PetriNetCreator creator;
+    creator.AddPlace("repaired", 0);
+    creator.AddReplicatedSubnet("server", server, 50);
+    creator.Commit();
+    size_t down_index = creator.GetPlaceIndex("server.down");
+
+    MeanEstimator cumulative_estimator(1);
+    cumulative_estimator.AddRandomVariable(RandomVariable("Down servers", [down_index](const PetriNet &pn, double &value)
+    {
+        value = pn.GetPlaceMark(down_index);
+        return true;
+    }));
+    MeanEstimator transient_estimator(1);
+
+    Statistics::DefaultUniformRandomNumberGenerator generator(123456);
+    PetriNetSimulator simulator(creator, cumulative_estimator, transient_estimator, 100.0, 0);
+    simulator.Run(200, generator);
+    simulator.SubmitResult();
+
+    ConfidenceInterval interval = cumulative_estimator.GetRandomVariableList()[0].GetSamplingResult();
+    std::cout << interval.ToString() << std::endl;
+    ASSERT_NEAR(interval.Median(), 50.0 * 0.5 / 1.5, 0.5);
+}
+
+static double SimulateQueueLength(PetriNetCreator &creator, double end_time, int iteration_count)
+{
+    size_t queue_index = creator.GetPlaceIndex("queue");
+    MeanEstimator cumulative_estimator(1);
+    cumulative_estimator.AddRandomVariable(RandomVariable("Queue length", [queue_index](const PetriNet &pn, double &value)
+    {
+        value = pn.GetPlaceMark(queue_index);
+        return true;
+    }));
+    MeanEstimator transient_estimator(1);
+
+    Statistics::DefaultUniformRandomNumberGenerator generator(123456);
+    PetriNetSimulator simulator(creator, cumulative_estimator, transient_estimator, end_time, 0);
+    simulator.Run(iteration_count, generator);
+    simulator.SubmitResult();
+
+    ConfidenceInterval interval = cumulative_estimator.GetRandomVariableList()[0].GetSamplingResult();
+    std::cout << interval.ToString() << std::endl;
+    return interval.Median();
+}
+
+TEST(SimulatingTest, ServerPolicy)
+{
+    PetriNetCreator infinite_server;
+    infinite_server.AddPlace("queue", 0);
+    infinite_server.AddTransition("arrive", Exp(5.0));
+    infinite_server.AddTransition("serve", Exp(1.0));
+    infinite_server.SetServerPolicy("serve", Transition::ServerPolicy::InfiniteServer);
+    infinite_server.AddArc("arrive", "queue", Arc::Type::Output);
+    infinite_server.AddArc("serve", "queue", Arc::Type::Input);
+    infinite_server.Commit();
+    ASSERT_NEAR(SimulateQueueLength(infinite_server, 1000.0, 100), 5.0, 0.1);
+
+    PetriNetCreator two_servers;
+    two_servers.AddPlace("queue", 0);
+    two_servers.AddTransition("arrive", Exp(1.0));
+    two_servers.AddTransition("serve", Exp(1.0));
+    ASSERT_THROW(two_servers.SetServerPolicy("serve", Transition::ServerPolicy::MultipleServer, 0),
+                 InvalidServerCount);
+    ASSERT_THROW(two_servers.SetServerPolicy("serve", Transition::ServerPolicy::MultipleServer, -2),
+                 InvalidServerCount);
+    two_servers.SetServerPolicy("serve", Transition::ServerPolicy::MultipleServer, 2);
+    two_servers.AddArc("arrive", "queue", Arc::Type::Output);
+    two_servers.AddArc("serve", "queue", Arc::Type::Input);
+    two_servers.Commit();
+    ASSERT_NEAR(SimulateQueueLength(two_servers, 1000.0, 100), 4.0 / 3.0, 0.05);
+
+    // a marking dependent rate reproducing the two servers
+    PetriNetCreator rate_func;
+    size_t queue_index = rate_func.AddPlace("queue", 0);
+    rate_func.AddTransition("arrive", Exp(1.0));
+    rate_func.AddTransition("serve", Exp(1.0));
+    rate_func.SetMarkingDependentRate("serve", [queue_index](const PetriNet &pn)
+    { return std::min(pn.GetPlaceMark(queue_index), 2); });
+    rate_func.AddArc("arrive", "queue", Arc::Type::Output);
+    rate_func.AddArc("serve", "queue", Arc::Type::Input);
+    rate_func.Commit();
+    ASSERT_NEAR(SimulateQueueLength(rate_func, 1000.0, 100), 4.0 / 3.0, 0.05);
+}
+
+TEST(SimulatingTest, TauLeaping)
+{
+    // immigration-death process with a mean population of 2000
+    PetriNetCreator creator;
+    size_t population_index = creator.AddPlace("population", 2000);
+    creator.AddTransition("immigrate", Exp(2000.0));
+    creator.AddTransition("die", Exp(1.0));
+    creator.SetServerPolicy("die", Transition::ServerPolicy::InfiniteServer);
+    creator.AddArc("immigrate", "population", Arc::Type::Output);
+    creator.AddArc("die", "population", Arc::Type::Input);
+    creator.Commit();
+
+    Statistics::DefaultUniformRandomNumberGenerator generator(123456);
+    PetriNet exact = creator.CreatePetriNet();
+    PetriNet leaping = creator.CreatePetriNet();
+    leaping.SetTauLeaping(0.03);
+    size_t exact_event_count = 0;
+    size_t leaping_event_count = 0;
+    for (exact.Reset(generator); exact.GetNextFiringTime() < 10.0; exact.NextState(generator))
+    {
+        exact_event_count++;
+    }
+    for (leaping.Reset(generator); leaping.GetNextFiringTime() < 10.0; leaping.NextState(generator))
+    {
+        leaping_event_count++;
+    }
+    std::cout << "exact events: " << exact_event_count << ", leaps: " << leaping_event_count << std::endl;
+    ASSERT_LT(leaping_event_count * 20, exact_event_count);
+
+    MeanEstimator cumulative_estimator(1);
+    cumulative_estimator.AddRandomVariable(RandomVariable("Population", [population_index](const PetriNet &pn, double &value)
+    {
+        value = pn.GetPlaceMark(population_index);
+        return true;
+    }));
+    MeanEstimator transient_estimator(1);
+    PetriNetSimulator simulator(creator, cumulative_estimator, transient_estimator, 100.0, 0);
+    simulator.SetTauLeaping(0.03);
+    simulator.Run(20, generator);
+    simulator.SubmitResult();
+    ConfidenceInterval interval = cumulative_estimator.GetRandomVariableList()[0].GetSamplingResult();
+    std::cout << interval.ToString() << std::endl;
+    ASSERT_NEAR(interval.Median(), 2000.0, 20.0);
+
+    // from an empty population only the immigration, which has no input place, can fire at first
+    PetriNetCreator empty;
+    size_t empty_index = empty.AddPlace("population", 0);
+    empty.AddTransition("immigrate", Exp(2000.0));
+    empty.AddTransition("die", Exp(1.0));
+    empty.SetServerPolicy("die", Transition::ServerPolicy::InfiniteServer);
+    empty.AddArc("immigrate", "population", Arc::Type::Output);
+    empty.AddArc("die", "population", Arc::Type::Input);
+    empty.Commit();
+    PetriNet filling = empty.CreatePetriNet();
+    filling.SetTauLeaping(0.03);
+    size_t step_count = 0;
+    for (filling.Reset(generator); filling.GetNextFiringTime() < 5.0; filling.NextState(generator))
+    {
+        ASSERT_TRUE(std::isfinite(filling.GetNextFiringTime()));
+        step_count++;
+    }
+    // the mean population at time 5 is 2000 (1 - exp(-5)), with a standard deviation of about 45
+    std::cout << "steps: " << step_count << ", population: " << filling.GetPlaceMark(empty_index) << std::endl;
+    ASSERT_LT(step_count, exact_event_count / 40);
+    ASSERT_NEAR(filling.GetPlaceMark(empty_index), 2000.0 * -std::expm1(-5.0), 200.0);
+}
+
+TEST(SimulatingTest, FluidReward)
+{
+    // a tank filled at rate 2 by a transition that fires long after the end time
+    PetriNetCreator creator;
+    size_t tank_index = creator.AddFluidPlace("tank", 0.0, 100.0);
+    creator.AddTransition("fill", Deterministic(1000.0));
+    creator.AddFluidArc("fill", "tank", FluidArc::Type::Inflow, 2.0);
+    creator.Commit();
+
+    MeanEstimator cumulative_estimator(1);
+    cumulative_estimator.AddRandomVariable(RandomVariable("Tank", [tank_index](const PetriNet &pn, double &value)
+    {
+        value = pn.GetMeanFluidLevel(tank_index);
+        return true;
+    }));
+    MeanEstimator transient_estimator(1);
+    transient_estimator.AddRandomVariable(RandomVariable("Tank", [tank_index](const PetriNet &pn, double &value)
+    {
+        value = pn.GetFluidLevel(tank_index);
+        return true;
+    }));
+    Statistics::DefaultUniformRandomNumberGenerator generator(123456);
+    PetriNetSimulator simulator(creator, cumulative_estimator, transient_estimator, 10.0, 0);
+    simulator.Run(2, generator);
+    simulator.SubmitResult();
+    ASSERT_DOUBLE_EQ(cumulative_estimator.GetRandomVariableList()[0].GetSamplingResult().Average(), 10.0);
+    ASSERT_DOUBLE_EQ(transient_estimator.GetRandomVariableList()[0].GetSamplingResult().Average(), 20.0);
+
+    // stopped when the tank reaches 5, at time 2.5
+    PetriNetCreator stopped;
+    size_t stopped_tank_index = stopped.AddFluidPlace("tank", 0.0, 100.0);
+    stopped.AddPlace("alarmed", 0);
+    stopped.AddTransition("fill", Deterministic(1000.0));
+    stopped.AddTransition("alarm", Deterministic(0.0));
+    stopped.AddFluidArc("fill", "tank", FluidArc::Type::Inflow, 2.0);
+    stopped.AddFluidArc("alarm", "tank", FluidArc::Type::Threshold, 5.0);
+    stopped.AddArc("alarm", "alarmed", Arc::Type::Inhibitor);
+    stopped.AddArc("alarm", "alarmed", Arc::Type::Output);
+    stopped.SetStoppingPredicate({"alarmed"}, [](const PetriNet &pn)
+    { return pn.GetPlaceMark("alarmed") > 0; });
+    stopped.Commit();
+    MeanEstimator stopped_transient_estimator(1);
+    stopped_transient_estimator.AddRandomVariable(
+            RandomVariable("Tank", [stopped_tank_index](const PetriNet &pn, double &value)
+            {
+                value = pn.GetFluidLevel(stopped_tank_index);
+                return true;
+            }));
+    MeanEstimator stopped_cumulative_estimator(1);
+    PetriNetSimulator stopped_simulator(stopped, stopped_cumulative_estimator, stopped_transient_estimator, 10.0, 0);
+    stopped_simulator.Run(2, generator);
+    stopped_simulator.SubmitResult();
+    ASSERT_DOUBLE_EQ(stopped_transient_estimator.GetRandomVariableList()[0].GetSamplingResult().Average(), 5.0);
+}
+
+static ConfidenceInterval SimulateFailureProbability(PetriNetCreator &creator, const vector<string> &place_names,
+                                                     double end_time, int iteration_count)
+{
+    vector<size_t> place_index_list;
+    for (const auto &name:place_names)
+    {
+        place_index_list.push_back(creator.GetPlaceIndex(name));
+    }
+    MeanEstimator cumulative_estimator(1);
+    MeanEstimator transient_estimator(1);
+    transient_estimator.AddRandomVariable(RandomVariable("Failed", [place_index_list](const PetriNet &pn, double &value)
+    {
+        value = 1.0;
+        for (size_t p_index:place_index_list)
+        {
+            value = pn.GetPlaceMark(p_index) > 0 ? value : 0.0;
+        }
+        return true;
+    }));
+
+    Statistics::DefaultUniformRandomNumberGenerator generator(123456);
+    PetriNetSimulator simulator(creator, cumulative_estimator, transient_estimator, end_time, 0);
+    simulator.Run(iteration_count, generator);
+    simulator.SubmitResult();
+
+    ConfidenceInterval interval = transient_estimator.GetRandomVariableList()[0].GetSamplingResult();
+    std::cout << interval.ToString() << std::endl;
+    return interval;
+}
+
+TEST(SimulatingTest, ImportanceSampling)
+{
+    // a component failing with probability about 1e-7 by time 1
+    PetriNetCreator creator;
+    creator.AddPlace("up", 1);
+    creator.AddPlace("failed", 0);
+    creator.AddTransition("fail", Exp(1e-7));
+    creator.AddArc("fail", "up", Arc::Type::Input);
+    creator.AddArc("fail", "failed", Arc::Type::Output);
+    creator.SetBias("fail", 1e6);
+    creator.Commit();
+    ConfidenceInterval interval = SimulateFailureProbability(creator, {"failed"}, 1.0, 10000);
+    ASSERT_LT(interval.RelativeError(), 0.1);
+    ASSERT_NEAR(interval.Median(), -std::expm1(-1e-7), 3e-9);
+
+    // two repairable components are down at the same time with probability
+    // (a / (a + b) (1 - exp(-(a + b) t)))^2, a = 1e-4, b = 1, t = 1
+    PetriNetCreator system;
+    for (string name:{"a", "b"})
+    {
+        system.AddPlace(name + ".up", 1);
+        system.AddPlace(name + ".down", 0);
+        system.AddTransition(name + ".fail", Exp(1e-4));
+        system.AddTransition(name + ".repair", Exp(1.0));
+        system.AddArc(name + ".fail", name + ".up", Arc::Type::Input);
+        system.AddArc(name + ".fail", name + ".down", Arc::Type::Output);
+        system.AddArc(name + ".repair", name + ".down", Arc::Type::Input);
+        system.AddArc(name + ".repair", name + ".up", Arc::Type::Output);
+        system.SetBias(name + ".fail", 1e4);
+    }
+    system.SetFailureBiasing({"a.fail", "b.fail"}, 0.5);
+    system.Commit();
+    interval = SimulateFailureProbability(system, {"a.down", "b.down"}, 1.0, 10000);
+    double component = 1e-4 / (1.0 + 1e-4) * -std::expm1(-(1.0 + 1e-4));
+    ASSERT_LT(interval.RelativeError(), 0.1);
+    ASSERT_NEAR(interval.Median(), component * component, 3 * interval.Error());
+
+    // a single component is down with probability a / (a + b) (1 - exp(-(a + b) t)), a = b = 1, t = 3; the biasing
+    // passes through the states with only the repair or only the failure enabled
+    PetriNetCreator component_net;
+    component_net.AddPlace("up", 1);
+    component_net.AddPlace("down", 0);
+    component_net.AddTransition("fail", Exp(1.0));
+    component_net.AddTransition("repair", Exp(1.0));
+    component_net.AddArc("fail", "up", Arc::Type::Input);
+    component_net.AddArc("fail", "down", Arc::Type::Output);
+    component_net.AddArc("repair", "down", Arc::Type::Input);
+    component_net.AddArc("repair", "up", Arc::Type::Output);
+    component_net.SetFailureBiasing({"fail"}, 0.5);
+    component_net.Commit();
+    interval = SimulateFailureProbability(component_net, {"down"}, 3.0, 10000);
+    ASSERT_NEAR(interval.Median(), 0.5 * -std::expm1(-6.0), 4 * interval.Error());
+}
+
+static SamplingResult SimulateTimeAverage(const PetriNetCreator &creator, const string &name, bool antithetic,
+                                          bool control, UniformRandomNumberGenerator &generator,
+                                          int replication_count = 10000)
+{
+    MeanEstimator cumulative_estimator(1);
+    MeanEstimator transient_estimator(1);
+    cumulative_estimator.AddRandomVariable(PlaceVariable(creator, name));
+    if (control)
+    {
+        // the time average of "a" over [0, 1] is 1 - exp(-1)
+        cumulative_estimator.AddControlVariate(PlaceVariable(creator, "a"), -std::expm1(-1.0));
+    }
+    PetriNetSimulator simulator(creator, cumulative_estimator, transient_estimator, 1.0, 0);
+    simulator.SetAntithetic(antithetic);
+    simulator.Run(antithetic ? replication_count / 2 : replication_count, generator);
+    simulator.SubmitResult();
+    return cumulative_estimator.GetRandomVariableList()[0].GetSamplingResult();
+}
+
+TEST(SimulatingTest, VarianceReduction)
+{
+    PetriNetCreator creator = TwoStageNet();
+    creator.Commit();
+    Statistics::DefaultUniformRandomNumberGenerator generator(123456);
+
+    // same number of replications, the pairs of antithetic runs are negatively correlated
+    SamplingResult plain = SimulateTimeAverage(creator, "a", false, false, generator);
+    SamplingResult antithetic = SimulateTimeAverage(creator, "a", true, false, generator);
+    std::cout << ConfidenceInterval(plain).ToString() << " " << ConfidenceInterval(antithetic).ToString() << std::endl;
+    ASSERT_NEAR(antithetic.Average(), -std::expm1(-1.0), 3 * antithetic.AverageStandardDeviation());
+    ASSERT_LT(antithetic.AverageVariance(), plain.AverageVariance() / 2.0);
+
+    // "b" is filled by "a", so the known mean of "a" corrects it
+    plain = SimulateTimeAverage(creator, "b", false, false, generator);
+    SamplingResult controlled = SimulateTimeAverage(creator, "b", false, true, generator);
+    std::cout << ConfidenceInterval(plain).ToString() << " " << ConfidenceInterval(controlled).ToString() << std::endl;
+    ASSERT_NEAR(controlled.Average(), plain.Average(), 3 * plain.AverageStandardDeviation());
+    ASSERT_LT(controlled.AverageVariance(), plain.AverageVariance());
+}
+
+TEST(SimulatingTest, CommonRandomNumbers)
+{
+    // a variant with an extra, unrelated transition sees the same firing times for the shared transitions
+    PetriNetCreator creator = TwoStageNet();
+    creator.Commit();
+    PetriNetCreator variant = TwoStageNet();
+    variant.AddPlace("audit", 1);
+    variant.AddTransition("check", Exp(5.0));
+    variant.AddArc("check", "audit", Arc::Type::Input);
+    variant.AddArc("check", "audit", Arc::Type::Output);
+    variant.Commit();
+
+    Statistics::DefaultUniformRandomNumberGenerator generator(1);
+    Statistics::DefaultUniformRandomNumberGenerator variant_generator(2);
+    PetriNet pn = creator.CreatePetriNet();
+    PetriNet variant_pn = variant.CreatePetriNet();
+    pn.SetCommonRandomNumbers(42);
+    variant_pn.SetCommonRandomNumbers(42);
+    for (int i = 0; i < 100; i++)
+    {
+        pn.Reset(generator);
+        variant_pn.Reset(variant_generator);
+        vector<double> time_list;
+        for (; pn.GetNextFiringTime() < 1e9; pn.NextState(generator))
+        {
+            time_list.push_back(pn.GetNextFiringTime());
+        }
+        while (variant_pn.GetPlaceMark("c") == 0)
+        {
+            variant_pn.NextState(variant_generator);
+        }
+        ASSERT_EQ(time_list.size(), 2u);
+        ASSERT_DOUBLE_EQ(variant_pn.GetTime(), time_list[1]);
+    }
+}
+
+TEST(SimulatingTest, RandomizedQuasiMonteCarlo)
+{
+    // the time average of "b" over [0, 1] is (1 - exp(-1)) - (1 - exp(-2)) / 2
+    PetriNetCreator creator = TwoStageNet();
+    creator.Commit();
+    double exact = -std::expm1(-1.0) + std::expm1(-2.0) / 2.0;
+
+    RqmcSimulator rqmc(creator, 2, 1.0, 1021, 4);
+    rqmc.GetCumulativeEstimator().AddRandomVariable(PlaceVariable(creator, "b"));
+    rqmc.Run(16, 123456);
+    SamplingResult randomized = rqmc.GetCumulativeEstimator().GetRandomVariableList()[0].GetSamplingResult();
+
+    Statistics::DefaultUniformRandomNumberGenerator generator(123456);
+    SamplingResult plain = SimulateTimeAverage(creator, "b", false, false, generator, 16 * 1021);
+    std::cout << ConfidenceInterval(randomized).ToString() << " " << ConfidenceInterval(plain).ToString()
+              << std::endl;
+    ASSERT_NEAR(randomized.Average(), exact, 3 * randomized.AverageStandardDeviation());
+    ASSERT_LT(randomized.AverageVariance(), plain.AverageVariance() / 10.0);
+}
+
+TEST(SimulatingTest, ConditionalSojourn)
+{
+    PetriNetCreator creator = TwoStageNet();
+    creator.Commit();
+    double exact = -std::expm1(-1.0) + std::expm1(-2.0) / 2.0;
+    SamplingResult result[2];
+    for (int conditional = 0; conditional < 2; conditional++)
+    {
+        MeanEstimator cumulative_estimator(1);
+        MeanEstimator transient_estimator(1);
+        cumulative_estimator.AddRandomVariable(PlaceVariable(creator, "b"));
+        PetriNetSimulator simulator(creator, cumulative_estimator, transient_estimator, 1.0, 0);
+        simulator.SetConditionalSojourn(conditional == 1);
+        Statistics::DefaultUniformRandomNumberGenerator generator(123456);
+        simulator.Run(10000, generator);
+        simulator.SubmitResult();
+        result[conditional] = cumulative_estimator.GetRandomVariableList()[0].GetSamplingResult();
+        std::cout << ConfidenceInterval(result[conditional]).ToString() << std::endl;
+    }
+    ASSERT_NEAR(result[1].Average(), exact, 3 * result[1].AverageStandardDeviation());
+    ASSERT_LT(result[1].AverageVariance(), result[0].AverageVariance());
+
+    PetriNetCreator fluid;
+    fluid.AddFluidPlace("tank", 0.0);
+    fluid.Commit();
+    MeanEstimator estimator(1);
+    PetriNetSimulator simulator(fluid, estimator, estimator, 1.0, 0);
+    ASSERT_THROW(simulator.SetConditionalSojourn(true), ConditionalSojournNotSupported);
+}
+
+TEST(SimulatingTest, RateSensitivity)
+{
+    // d/d lambda of the time average of "a" over [0, 1], (1 - exp(-lambda)) / lambda, and of P(a = 1 at 1), exp(-lambda)
+    double cumulative_exact = 2.0 * std::exp(-1.0) - 1.0;
+    double transient_exact = -std::exp(-1.0);
+    for (double bias: {1.0, 2.0})
+    {
+        PetriNetCreator creator = TwoStageNet();
+        size_t parameter_index = creator.AddRateParameter("lambda", {"ab"});
+        creator.SetBias("ab", bias);
+        creator.Commit();
+        MeanEstimator cumulative_estimator(1);
+        MeanEstimator transient_estimator(1);
+        cumulative_estimator.AddRandomVariable(CumulativeDerivative(PlaceVariable(creator, "a"), parameter_index,
+                                                                    "lambda"));
+        transient_estimator.AddRandomVariable(TransientDerivative(PlaceVariable(creator, "a"), parameter_index,
+                                                                  "lambda"));
+        PetriNetSimulator simulator(creator, cumulative_estimator, transient_estimator, 1.0, 0);
+        Statistics::DefaultUniformRandomNumberGenerator generator(123456);
+        simulator.Run(20000, generator);
+        simulator.SubmitResult();
+        const SamplingResult &cumulative = cumulative_estimator.GetRandomVariableList()[0].GetSamplingResult();
+        const SamplingResult &transient = transient_estimator.GetRandomVariableList()[0].GetSamplingResult();
+        std::cout << ConfidenceInterval(cumulative).ToString() << std::endl;
+        std::cout << ConfidenceInterval(transient).ToString() << std::endl;
+        ASSERT_NEAR(cumulative.Average(), cumulative_exact, 3 * cumulative.AverageStandardDeviation());
+        ASSERT_NEAR(transient.Average(), transient_exact, 3 * transient.AverageStandardDeviation());
+    }
+
+    // stopped at the first failure, so P(stopped by 1) = 1 - exp(-lambda), with derivative exp(-lambda)
+    PetriNetCreator stopped;
+    stopped.AddPlace("up", 2);
+    size_t down_index = stopped.AddPlace("down", 0);
+    stopped.AddTransition("fail", Exp(1.0));
+    stopped.AddArc("fail", "up", Arc::Type::Input);
+    stopped.AddArc("fail", "down", Arc::Type::Output);
+    size_t fail_index = stopped.AddRateParameter("lambda", {"fail"});
+    stopped.SetStoppingPredicate({"down"}, [down_index](const PetriNet &pn)
+    { return pn.GetPlaceMark(down_index) > 0; });
+    stopped.Commit();
+    MeanEstimator stopped_cumulative_estimator(1);
+    MeanEstimator stopped_transient_estimator(1);
+    stopped_transient_estimator.AddRandomVariable(TransientDerivative(HittingProbability(), fail_index, "lambda"));
+    PetriNetSimulator stopped_simulator(stopped, stopped_cumulative_estimator, stopped_transient_estimator, 1.0, 0);
+    Statistics::DefaultUniformRandomNumberGenerator generator(123456);
+    stopped_simulator.Run(20000, generator);
+    stopped_simulator.SubmitResult();
+    const SamplingResult &hitting = stopped_transient_estimator.GetRandomVariableList()[0].GetSamplingResult();
+    std::cout << ConfidenceInterval(hitting).ToString() << std::endl;
+    ASSERT_NEAR(hitting.Average(), std::exp(-1.0), 3 * hitting.AverageStandardDeviation());
+
+    PetriNetCreator creator = TwoStageNet();
+    creator.AddTransition("slow", Deterministic(1.0));
+    ASSERT_THROW(creator.AddRateParameter("slow", {"slow"}), InvalidRateParameter);
+}
+
+TEST(SimulatingTest, ParameterSweep)
+{
+    PetriNetCreator creator = TwoStageNet();
+    creator.Commit();
+    SweepSimulator sweep(creator, 4, 1.0);
+    sweep.AddParameter({"ab"}, Exp);
+    vector<double> rate_list{0.5, 1.0, 2.0};
+    for (double rate: rate_list)
+    {
+        sweep.AddDesignPoint({rate});
+    }
+    ASSERT_THROW(sweep.AddDesignPoint({1.0, 2.0}), InvalidDesignPoint);
+    sweep.AddCumulativeVariable(PlaceVariable(creator, "a"));
+    sweep.AddTransientVariable(PlaceVariable(creator, "c"));
+    sweep.SetCommonRandomNumbers(2016);
+    sweep.Run(1000, 123456);
+    for (size_t point_index = 0; point_index < rate_list.size(); point_index++)
+    {
+        double rate = rate_list[point_index];
+        // the time average of "a" over [0, 1] is (1 - exp(-rate)) / rate
+        const SamplingResult &result =
+                sweep.GetCumulativeEstimator(point_index).GetRandomVariableList()[0].GetSamplingResult();
+        std::cout << ConfidenceInterval(result).ToString() << std::endl;
+        ASSERT_NEAR(result.Average(), -std::expm1(-rate) / rate, 3 * result.AverageStandardDeviation());
+    }
+    // a faster "ab" reaches "c" more often
+    const SamplingResult &slow = sweep.GetTransientEstimator(0).GetRandomVariableList()[0].GetSamplingResult();
+    const SamplingResult &fast = sweep.GetTransientEstimator(2).GetRandomVariableList()[0].GetSamplingResult();
+    ASSERT_LT(slow.Average(), fast.Average());
+
+    ASSERT_THROW(creator.CreatePetriNet().SetFiringTimeFunc(creator.GetTransitionIndex("ab"), Deterministic(1.0)),
+                 InvalidFiringTimeFunc);
+}
+
+TEST(SimulatingTest, AdaptiveSweep)
+{
+    PetriNetCreator creator = TwoStageNet();
+    creator.Commit();
+    SweepSimulator sweep(creator, 4, 1.0);
+    sweep.AddParameter({"ab"}, Exp);
+    // the time average of "a" over [0, 1], (1 - exp(-rate)) / rate, is smallest for the last point
+    vector<double> rate_list{0.5, 1.0, 1.8, 2.0};
+    for (double rate: rate_list)
+    {
+        sweep.AddDesignPoint({rate});
+    }
+    sweep.AddCumulativeVariable(PlaceVariable(creator, "a"));
+    SweepDecision selection(SweepDecision::Minimum, false, 0);
+    ASSERT_TRUE(sweep.RunAdaptive(selection, 100, 400, 200000, 123456));
+    ASSERT_EQ(sweep.GetSelectedPoint(), 3);
+    for (size_t point_index = 0; point_index < rate_list.size(); point_index++)
+    {
+        std::cout << rate_list[point_index] << ": " << sweep.GetReplicationCount(point_index) << std::endl;
+    }
+    // the clearly worse first point is left alone, the close contenders get the replications
+    ASSERT_LT(sweep.GetReplicationCount(0), sweep.GetReplicationCount(2) / 4);
+    ASSERT_LT(sweep.GetReplicationCount(1), sweep.GetReplicationCount(3) / 4);
+
+    SweepDecision threshold(SweepDecision::Threshold, false, 0, 0.6);
+    ASSERT_TRUE(sweep.RunAdaptive(threshold, 100, 400, 200000, 123456));
+    for (size_t point_index = 0; point_index < rate_list.size(); point_index++)
+    {
+        ConfidenceInterval interval(sweep.GetCumulativeEstimator(point_index).GetRandomVariableList()[0]
+                                            .GetSamplingResult());
+        ASSERT_TRUE(interval.LowerBound() > 0.6 || interval.UpperBound() < 0.6);
+    }
+    ASSERT_LT(sweep.GetReplicationCount(0), sweep.GetReplicationCount(1));
+}
+
+TEST(SimulatingTest, FirstPassageTime)
+{
+    PetriNetCreator creator = TwoStageNet();
+    size_t c_index = creator.GetPlaceIndex("c");
+    creator.SetStoppingPredicate({"c"}, [c_index](const PetriNet &pn)
+    { return pn.GetPlaceMark(c_index) > 0; });
+    creator.Commit();
+    // the hitting time of "c" is Exp(1) + Exp(2), with mean 1.5 and P(T <= 1) = 1 - 2 exp(-1) + exp(-2)
+    for (double end_time: {1.0, 1000.0})
+    {
+        MeanEstimator cumulative_estimator(1);
+        MeanEstimator transient_estimator(1);
+        cumulative_estimator.AddRandomVariable(PlaceVariable(creator, "a"));
+        transient_estimator.AddRandomVariable(HittingProbability());
+        transient_estimator.AddRandomVariable(CensoredHittingTime(end_time));
+        PetriNetSimulator simulator(creator, cumulative_estimator, transient_estimator, end_time, 0);
+        Statistics::DefaultUniformRandomNumberGenerator generator(123456);
+        simulator.Run(10000, generator);
+        simulator.SubmitResult();
+        const SamplingResult &probability = transient_estimator.GetRandomVariableList()[0].GetSamplingResult();
+        const SamplingResult &hitting_time = transient_estimator.GetRandomVariableList()[1].GetSamplingResult();
+        std::cout << ConfidenceInterval(probability).ToString() << " " << ConfidenceInterval(hitting_time).ToString()
+                  << std::endl;
+        if (end_time == 1.0)
+        {
+            double exact = 1.0 - 2.0 * std::exp(-1.0) + std::exp(-2.0);
+            ASSERT_NEAR(probability.Average(), exact, 3 * probability.AverageStandardDeviation());
+        } else
+        {
+            ASSERT_EQ(probability.Average(), 1.0);
+            ASSERT_NEAR(hitting_time.Average(), 1.5, 3 * hitting_time.AverageStandardDeviation());
+            // "a" is marked for two thirds of the time up to the hit
+            const SamplingResult &a = cumulative_estimator.GetRandomVariableList()[0].GetSamplingResult();
+            ASSERT_NEAR(a.Average(), 1.0 / 1.5, 0.02);
+        }
+    }
+}
+
+TEST(SimulatingTest, ReplicationQuantiles)
+{
+    PetriNetCreator creator = TwoStageNet();
+    creator.Commit();
+    PetriNetMultiSimulator simulator(creator, 2, 1.0);
+    simulator.GetCumulativeEstimator().AddRandomVariable(PlaceVariable(creator, "a"));
+    simulator.Run(20000);
+    // the time average of "a" over [0, 1] is min(T, 1) with T ~ Exp(1), so its median is log(2)
+    const LogHistogram &histogram = simulator.GetCumulativeEstimator().GetRandomVariableList()[0].GetHistogram();
+    ASSERT_EQ(histogram.TotalWeight(), 20000.0);
+    std::pair<double, double> interval = histogram.QuantileInterval(0.5);
+    std::cout << histogram.Quantile(0.5) << " [" << interval.first << ", " << interval.second << "]" << std::endl;
+    ASSERT_LT(interval.first, std::log(2.0) * 1.01);
+    ASSERT_GT(interval.second, std::log(2.0) * 0.99);
+    ASSERT_NEAR(histogram.Quantile(0.9), 1.0, 0.01);
+}
+
+TEST(SimulatingTest, CheckpointResume)
+{
+    PetriNetCreator creator = TwoStageNet();
+    creator.Commit();
+    const string path = "simulating_test_checkpoint";
+    auto configure = [&creator](PetriNetMultiSimulator &simulator)
+    {
+        simulator.GetCumulativeEstimator().AddRandomVariable(PlaceVariable(creator, "b"));
+        simulator.GetTransientEstimator().AddRandomVariable(PlaceVariable(creator, "c"));
+        simulator.SetSeed(11);
+    };
+    PetriNetMultiSimulator uninterrupted(creator, 2, 1.0);
+    configure(uninterrupted);
+    uninterrupted.Run(20000);
+
+    // preempted part way, then continued by another simulator
+    PetriNetMultiSimulator preempted(creator, 2, 1.0);
+    configure(preempted);
+    preempted.RunAsync(20000);
+    preempted.SaveCheckpoint(path);
+    preempted.Stop();
+    preempted.Wait();
+    preempted.SaveCheckpoint(path);
+    PetriNetMultiSimulator resumed(creator, 2, 1.0);
+    configure(resumed);
+    resumed.Resume(path);
+
+    for (auto estimator_pair:{std::make_pair(&uninterrupted.GetCumulativeEstimator(),
+                                             &resumed.GetCumulativeEstimator()),
+                              std::make_pair(&uninterrupted.GetTransientEstimator(),
+                                             &resumed.GetTransientEstimator())})
+    {
+        const RandomVariable &expected = estimator_pair.first->GetRandomVariableList()[0];
+        const RandomVariable &actual = estimator_pair.second->GetRandomVariableList()[0];
+        ASSERT_EQ(actual.GetSamplingResult().TotalWeight(), expected.GetSamplingResult().TotalWeight());
+        ASSERT_EQ(actual.GetSamplingResult().Average(), expected.GetSamplingResult().Average());
+        ASSERT_EQ(actual.GetSamplingResult().VarianceSum(), expected.GetSamplingResult().VarianceSum());
+        ASSERT_EQ(actual.GetHistogram().Quantile(0.9), expected.GetHistogram().Quantile(0.9));
+    }
+
+    // the random variables have to match
+    PetriNetMultiSimulator other(creator, 2, 1.0);
+    other.GetCumulativeEstimator().AddRandomVariable(PlaceVariable(creator, "a"));
+    other.GetTransientEstimator().AddRandomVariable(PlaceVariable(creator, "c"));
+    ASSERT_THROW(other.Resume(path), Serialization::SerializationError);
+    std::remove(path.c_str());
+
+    // a corrupt generator state is refused
+    Statistics::DefaultUniformRandomNumberGenerator generator(5);
+    string state = generator.GetState();
+    ASSERT_FALSE(generator.SetState("not a generator state"));
+    ASSERT_FALSE(generator.SetState(state + " 1"));
+    ASSERT_EQ(generator.GetState(), state);
+    ASSERT_TRUE(generator.SetState(state));
+}
@@ -0,0 +1,126 @@
+//
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <iostream>
+#include "Splitting.h"
+#include "helper.h"
+
+using namespace Splitting;
+
+TEST(splitting_test, immigration_death_overflow)
+{
+    // the population at time 1 is Poisson with mean 1 - exp(-1); P(population >= 8) is about 3.5e-7
+    PetriNetCreator creator;
+    size_t population_index = creator.AddPlace("population", 0);
+    creator.AddTransition("immigrate", Statistics::Exp(1.0));
+    creator.AddTransition("die", Statistics::Exp(1.0));
+    creator.SetServerPolicy("die", Transition::ServerPolicy::InfiniteServer);
+    creator.AddArc("immigrate", "population", Arc::Type::Output);
+    creator.AddArc("die", "population", Arc::Type::Input);
+    creator.Commit();
+
+    RestartSimulator simulator(creator, 4, 1.0, [population_index](const PetriNet &pn)
+                               { return pn.GetPlaceMark(population_index); },
+                               {2, 3, 4, 5, 6, 7, 8}, {4, 4, 5, 6, 7, 8, 9});
+    simulator.GetTransientEstimator().AddRandomVariable(
+            RandomVariable("Overflow", [population_index](const PetriNet &pn, double &value)
+            {
+                value = pn.GetPlaceMark(population_index) >= 8 ? 1.0 : 0.0;
+                return true;
+            }));
+    simulator.Run(200000, 123456);
+
+    double mean = -std::expm1(-1.0);
+    double exact = 0.0;
+    double term = std::exp(-mean);
+    for (int k = 0; k < 8; k++)
+    {
+        exact += term;
+        term *= mean / (k + 1);
+    }
+    exact = 1.0 - exact;
+    ConfidenceInterval interval = simulator.GetTransientEstimator().GetRandomVariableList()[0].GetSamplingResult();
+    std::cout << interval.ToString() << " exact: " << exact << std::endl;
+    ASSERT_LT(interval.RelativeError(), 0.1);
+    ASSERT_NEAR(interval.Median(), exact, 3 * interval.Error());
+}
+
+TEST(splitting_test, invalid_thresholds)
+{
+    PetriNetCreator creator;
+    creator.AddPlace("p", 0);
+    creator.Commit();
+    auto importance_func = [](const PetriNet &pn)
+    { return 0.0; };
+    ASSERT_THROW(RestartSimulator(creator, 1, 1.0, importance_func, {2, 1}, {2, 2}), InvalidSplitting);
+    ASSERT_THROW(RestartSimulator(creator, 1, 1.0, importance_func, {1, 2}, {2}), InvalidSplitting);
+}
+
+TEST(splitting_test, stopping_predicate)
+{
+    // a -> b -> c -> a at rates 1, 2 and 5, stopped when c is first marked; the hit comes after Exp(1) + Exp(2), so
+    // P(T <= 1) = 1 - 2 exp(-1) + exp(-2), although c is usually empty again by time 1
+    PetriNetCreator creator;
+    creator.AddPlace("a", 1);
+    size_t b_index = creator.AddPlace("b", 0);
+    size_t c_index = creator.AddPlace("c", 0);
+    creator.AddTransition("ab", Statistics::Exp(1.0));
+    creator.AddTransition("bc", Statistics::Exp(2.0));
+    creator.AddTransition("ca", Statistics::Exp(5.0));
+    creator.AddArc("ab", "a", Arc::Type::Input);
+    creator.AddArc("ab", "b", Arc::Type::Output);
+    creator.AddArc("bc", "b", Arc::Type::Input);
+    creator.AddArc("bc", "c", Arc::Type::Output);
+    creator.AddArc("ca", "c", Arc::Type::Input);
+    creator.AddArc("ca", "a", Arc::Type::Output);
+    creator.SetStoppingPredicate({"c"}, [c_index](const PetriNet &pn)
+    { return pn.GetPlaceMark(c_index) > 0; });
+    creator.Commit();
+
+    RestartSimulator simulator(creator, 2, 1.0, [b_index, c_index](const PetriNet &pn)
+                               { return pn.GetPlaceMark(b_index) + 2 * pn.GetPlaceMark(c_index); },
+                               {1, 2}, {2, 2});
+    simulator.GetTransientEstimator().AddRandomVariable(HittingProbability());
+    simulator.Run(20000, 123456);
+    ConfidenceInterval interval = simulator.GetTransientEstimator().GetRandomVariableList()[0].GetSamplingResult();
+    double exact = 1.0 - 2.0 * std::exp(-1.0) + std::exp(-2.0);
+    ASSERT_NEAR(interval.Median(), exact, 3 * interval.Error());
+}
+
+TEST(splitting_test, immediate_transition)
+{
+    // immigration-death with the arrivals admitted by an immediate transition; the net is still Markovian, so the
+    // splits restore states of the next-reaction engine
+    PetriNetCreator creator;
+    creator.AddPlace("arrived", 0);
+    size_t population_index = creator.AddPlace("population", 0);
+    creator.AddTransition("immigrate", Statistics::Exp(1.0));
+    creator.AddImmediateTransition("admit");
+    creator.AddTransition("die", Statistics::Exp(1.0));
+    creator.SetServerPolicy("die", Transition::ServerPolicy::InfiniteServer);
+    creator.AddArc("immigrate", "arrived", Arc::Type::Output);
+    creator.AddArc("admit", "arrived", Arc::Type::Input);
+    creator.AddArc("admit", "population", Arc::Type::Output);
+    creator.AddArc("die", "population", Arc::Type::Input);
+    creator.Commit();
+    ASSERT_TRUE(creator.CreatePetriNet().IsMarkovian());
+
+    RestartSimulator simulator(creator, 2, 1.0, [population_index](const PetriNet &pn)
+                               { return pn.GetPlaceMark(population_index); },
+                               {2, 3}, {3, 3});
+    simulator.GetTransientEstimator().AddRandomVariable(
+            RandomVariable("Overflow", [population_index](const PetriNet &pn, double &value)
+            {
+                value = pn.GetPlaceMark(population_index) >= 4 ? 1.0 : 0.0;
+                return true;
+            }));
+    simulator.Run(20000, 123456);
+
+    // the population at time 1 is Poisson with mean 1 - exp(-1)
+    double mean = -std::expm1(-1.0);
+    double exact = 1.0 - std::exp(-mean) * (1.0 + mean + mean * mean / 2.0 + mean * mean * mean / 6.0);
+    ConfidenceInterval interval = simulator.GetTransientEstimator().GetRandomVariableList()[0].GetSamplingResult();
+    std::cout << interval.ToString() << " exact: " << exact << std::endl;
+    ASSERT_NEAR(interval.Median(), exact, 3 * interval.Error());
+}
@@ -0,0 +1,94 @@
+//
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include "Simulating.h"
+#include "helper.h"
+
+using namespace Simulating;
+using namespace Trace;
+
+TEST(trace_test, replay)
+{
+    PetriNetCreator creator = TwoStageNet();
+    creator.Commit();
+    const string prefix = "trace_test_replay";
+    // the trace is recorded while estimating "b" and replayed for "c"
+    PetriNetMultiSimulator simulator(creator, 2, 1.0);
+    simulator.GetCumulativeEstimator().AddRandomVariable(PlaceVariable(creator, "b"));
+    simulator.GetTransientEstimator().AddRandomVariable(PlaceVariable(creator, "b"));
+    simulator.SetTracePrefix(prefix);
+    simulator.SetCommonRandomNumbers(7);
+    simulator.Run(2000);
+
+    PetriNetMultiSimulator direct(creator, 2, 1.0);
+    direct.GetCumulativeEstimator().AddRandomVariable(PlaceVariable(creator, "c"));
+    direct.GetTransientEstimator().AddRandomVariable(PlaceVariable(creator, "c"));
+    direct.SetCommonRandomNumbers(7);
+    direct.Run(2000);
+
+    MeanEstimator cumulative_estimator(2);
+    MeanEstimator transient_estimator(2);
+    cumulative_estimator.AddRandomVariable(PlaceVariable(creator, "c"));
+    transient_estimator.AddRandomVariable(PlaceVariable(creator, "c"));
+    uint64_t replication_count = 0;
+    for (size_t i = 0; i < 2; i++)
+    {
+        replication_count += ReplayTrace(PetriNetMultiSimulator::TracePath(prefix, i), creator,
+                                         cumulative_estimator, transient_estimator, i);
+        cumulative_estimator.SubmitResult(i);
+        transient_estimator.SubmitResult(i);
+    }
+    ASSERT_EQ(replication_count, 2000u);
+    SamplingResult replayed = cumulative_estimator.GetRandomVariableList()[0].GetSamplingResult();
+    SamplingResult simulated = direct.GetCumulativeEstimator().GetRandomVariableList()[0].GetSamplingResult();
+    ASSERT_NEAR(replayed.Average(), simulated.Average(), 1e-9);
+    ASSERT_NEAR(replayed.AverageVariance(), simulated.AverageVariance(), 1e-9);
+    ASSERT_DOUBLE_EQ(transient_estimator.GetRandomVariableList()[0].GetSamplingResult().Average(),
+                     direct.GetTransientEstimator().GetRandomVariableList()[0].GetSamplingResult().Average());
+
+    // a trace does not replay on another net, nor when truncated
+    PetriNetCreator variant = TwoStageNet();
+    variant.AddPlace("d", 0);
+    variant.Commit();
+    const string path = PetriNetMultiSimulator::TracePath(prefix, 0);
+    ASSERT_THROW(ReplayTrace(path, variant, cumulative_estimator, transient_estimator), InvalidTrace);
+    std::ifstream input(path, std::ios::binary);
+    string content((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    std::ofstream(path, std::ios::binary | std::ios::trunc).write(content.data(), content.size() - 3);
+    ASSERT_THROW(ReplayTrace(path, creator, cumulative_estimator, transient_estimator), InvalidTrace);
+    ASSERT_THROW(ReplayTrace(prefix + ".missing", creator, cumulative_estimator, transient_estimator), TraceIOError);
+    for (size_t i = 0; i < 2; i++)
+    {
+        std::remove(PetriNetMultiSimulator::TracePath(prefix, i).c_str());
+    }
+}
+
+TEST(trace_test, writer_outlived_by_simulator)
+{
+    PetriNetCreator creator = TwoStageNet();
+    creator.Commit();
+    const string path = "trace_test_detach";
+    MeanEstimator cumulative_estimator(1);
+    MeanEstimator transient_estimator(1);
+    cumulative_estimator.AddRandomVariable(PlaceVariable(creator, "b"));
+    transient_estimator.AddRandomVariable(PlaceVariable(creator, "b"));
+    PetriNetSimulator simulator(creator, cumulative_estimator, transient_estimator, 1.0, 0);
+    Statistics::DefaultUniformRandomNumberGenerator generator(11);
+    {
+        TraceWriter writer(path, creator);
+        simulator.SetTraceWriter(&writer);
+        simulator.Run(100, generator);
+    }
+    // the net must not log into the destroyed writer any more
+    simulator.SetTraceWriter(nullptr);
+    simulator.Run(100, generator);
+
+    MeanEstimator replay_cumulative(1);
+    MeanEstimator replay_transient(1);
+    replay_cumulative.AddRandomVariable(PlaceVariable(creator, "b"));
+    replay_transient.AddRandomVariable(PlaceVariable(creator, "b"));
+    ASSERT_EQ(ReplayTrace(path, creator, replay_cumulative, replay_transient), 100u);
+    std::remove(path.c_str());
+}